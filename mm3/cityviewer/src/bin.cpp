@@ -0,0 +1,166 @@
+#include "bin.h"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+using namespace bin;
+
+const char* bin::Magic = "OTF0";
+
+static const size_t HeaderSize  = 16;
+static const size_t TocSize     = 8;
+static const size_t ContentSize = 52;
+static const size_t EffectSize  = 86;
+
+template<class T>
+static void get(const char* data, size_t offset, T& var)
+{
+	::memcpy(&var, data + offset, sizeof(var));
+}
+
+static void check(size_t offset, size_t size, size_t length, const char* what)
+{
+	if (offset > length || size > length - offset) {
+		std::ostringstream msg;
+		msg << "Unexpected end of file in " << what << ". Expected " << size << " bytes at offset " << offset << ", got " << (offset < length ? length - offset : 0) << ".";
+		throw std::runtime_error(msg.str());
+	}
+}
+
+Effect Object::getEffect(unsigned i) const
+{
+	const char* data = effects + i * EffectSize;
+
+	Effect effect;
+	get(data,  0, effect.data1);
+	get(data, 39, effect.soundIndex);
+	get(data, 43, effect.color);
+	get(data, 47, effect.data2);
+	get(data, 69, effect.unknown);
+	get(data, 73, effect.flareSize);
+	get(data, 77, effect.flareIntensity);
+	get(data, 78, effect.data3);
+	get(data, 79, effect.spotLength);
+	get(data, 83, effect.data4);
+
+	effect.sound = effect.soundIndex < sounds->size() ? (*sounds)[effect.soundIndex] : 0;
+
+	return effect;
+}
+
+ObjectEffects* ObjectEffects::readFile(std::ifstream& ifs)
+{
+	ObjectEffects* db = new ObjectEffects();
+
+	try {
+		ifs.seekg(0, std::ifstream::end);
+		db->buffer.resize(ifs.tellg());
+		ifs.seekg(0, std::ifstream::beg);
+		ifs.read(db->buffer.data(), db->buffer.size());
+
+		db->read(db->buffer.data(), db->buffer.size());
+	}
+	catch (...) {
+		delete db;
+		throw;
+	}
+
+	return db;
+}
+
+ObjectEffects* ObjectEffects::parse(const char* data, size_t length)
+{
+	ObjectEffects* db = new ObjectEffects();
+
+	try {
+		db->read(data, length);
+	}
+	catch (...) {
+		delete db;
+		throw;
+	}
+
+	return db;
+}
+
+void ObjectEffects::read(const char* data, size_t length)
+{
+	check(0, HeaderSize, length, "header");
+
+	if (::memcmp(data, Magic, 4) != 0) {
+		std::ostringstream msg;
+		msg << "Unexpected magic. Expected \"" << Magic << "\", got \"" << std::string(data, 4) << "\".";
+		throw std::runtime_error(msg.str());
+	}
+
+	uint16_t fileCount;
+	uint32_t soundsOffset;
+	get(data,  4, unknown0);
+	get(data,  6, fileCount);
+	get(data,  8, unknown1);
+	get(data, 10, unknown2);
+	get(data, 12, soundsOffset);
+
+	check(HeaderSize, fileCount * TocSize, length, "TOC");
+
+	// One record per TOC entry and a trailing one, stored back to back.
+	objects.resize(fileCount + 1);
+	index.reserve(fileCount);
+
+	size_t offset = HeaderSize + fileCount * TocSize;
+	for (unsigned i = 0; i <= fileCount; i++) {
+		Object& object = objects[i];
+		check(offset, ContentSize, length, "object");
+
+		if (i < fileCount) {
+			get(data, HeaderSize + i * TocSize, object.id);
+			index.emplace(object.id, i);
+		}
+		else {
+			object.id = 0;
+		}
+
+		get(data, offset +  0, object.effectCount);
+		get(data, offset +  2, object.blobSize);
+		get(data, offset +  3, object.blobIntensity);
+		get(data, offset +  4, object.unknown1);
+		get(data, offset +  8, object.color);
+		get(data, offset + 12, object.mass);
+		get(data, offset + 16, object.colSoundIndex);
+		get(data, offset + 20, object.colType);
+		get(data, offset + 24, object.unknowns);
+		offset += ContentSize;
+
+		check(offset, object.effectCount * EffectSize, length, "effects");
+		object.effects = data + offset;
+		object.sounds  = &sounds;
+		offset += object.effectCount * EffectSize;
+	}
+
+	// Sound names follow the records, each resolved once here.
+	if (soundsOffset >= offset && soundsOffset <= length) {
+		offset = soundsOffset;
+	}
+
+	while (offset < length) {
+		const char* name = data + offset;
+		const char* end = static_cast<const char*>(::memchr(name, '\0', length - offset));
+		if (!end) {
+			throw std::runtime_error("Unterminated sound name at end of file.");
+		}
+
+		sounds.push_back(name);
+		offset += end - name + 1;
+	}
+
+	for (Object& object : objects) {
+		object.colSound = getSound(object.colSoundIndex);
+	}
+}
+
+const Object* ObjectEffects::find(uint32_t id) const
+{
+	std::unordered_map<uint32_t, uint32_t>::const_iterator it = index.find(id);
+	return it != index.end() ? &objects[it->second] : 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bin
+{
+	extern const char* Magic;
+
+	enum ColType : uint32_t
+	{
+		Normal       = 0,
+		SpecialFlipL = 1,
+		SpecialT     = 2,
+	};
+
+	struct Color4b
+	{
+		uint8_t b, g, r, a;
+	};
+
+	struct Effect
+	{
+		uint8_t     data1[39];
+		uint32_t    soundIndex;
+		Color4b     color;
+		uint8_t     data2[22];
+		uint32_t    unknown;
+		float       flareSize;
+		uint8_t     flareIntensity;
+		uint8_t     data3;
+		float       spotLength;
+		uint8_t     data4[3];
+
+		const char* sound;      // Resolved soundIndex, null if out of range.
+	};
+
+	// Fixed part of an object record. Effects stay in the file data and are
+	// decoded on access.
+	class Object
+	{
+		public:
+			Effect getEffect(unsigned i) const;
+
+			uint32_t    id;
+			uint16_t    effectCount;
+			uint8_t     blobSize;
+			uint8_t     blobIntensity;
+			uint32_t    unknown1;
+			Color4b     color;
+			float       mass;
+			uint32_t    colSoundIndex;
+			ColType     colType;
+			uint32_t    unknowns[7];
+
+			const char* colSound;   // Resolved colSoundIndex, null if out of range.
+
+		private:
+			const char*                     effects;
+			const std::vector<const char*>* sounds;
+
+			friend class ObjectEffects;
+	};
+
+	class ObjectEffects
+	{
+		public:
+			// Read the whole stream once, objects point into the buffer.
+			static ObjectEffects* readFile(std::ifstream& ifs);
+			// Parse data in place, it must outlive the database.
+			static ObjectEffects* parse(const char* data, size_t length);
+
+			// Null for unknown ids.
+			const Object* find(uint32_t id) const;
+			// Trailing record without a TOC entry.
+			const Object* getDefault() const { return &objects.back(); }
+			const char*   getSound(uint32_t index) const { return index < sounds.size() ? sounds[index] : 0; }
+
+			// Objects point into the buffer and the sound list, a copy would point into this one.
+			ObjectEffects(const ObjectEffects&) = delete;
+			ObjectEffects& operator=(const ObjectEffects&) = delete;
+
+			uint16_t    unknown0;
+			uint16_t    unknown1;
+			uint16_t    unknown2;
+
+			std::vector<Object>      objects;
+			std::vector<const char*> sounds;
+
+		private:
+			ObjectEffects() {}
+			void read(const char* data, size_t length);
+
+			std::vector<char>                      buffer;
+			std::unordered_map<uint32_t, uint32_t> index;  // Object id to position in objects.
+	};
+}
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <sstream>
 
+#include "occ.h"
 #include "pak.h"
 #include "xbc.h"
 
@@ -390,6 +391,39 @@ bool dumpMaps(const xbc::Xbc* xbc, pak::Toc* toc)
 	return false;
 }
 
+// Cull rate of road and facade sections seen from street level in the middle of every cell.
+void printOcclusion(const xbc::Xbc* xbc, occ::Occluders* occluders)
+{
+	std::cout << "Occluders: " << occluders->getCount() << " (" << occluders->getSkipped() << " line sets skipped)" << std::endl;
+
+	const xbc::MeshSection* sections[2] = { xbc->roads.meshSections, xbc->facades.meshSections };
+	unsigned sectionCounts[2] = { xbc->roads.meshSectionCount, xbc->facades.meshSectionCount };
+
+	float cellWidth  = (xbc->aabb3.max.x - xbc->aabb3.min.x) / xbc->colCount;
+	float cellHeight = (xbc->aabb3.max.z - xbc->aabb3.min.z) / xbc->rowCount;
+
+	occluders->stats = occ::Stats();
+
+	for (unsigned y = 0; y < xbc->rowCount; y++) {
+		for (unsigned x = 0; x < xbc->colCount; x++) {
+			xbc::Vec3f eye = { xbc->aabb3.min.x + (x + 0.5f) * cellWidth, xbc->aabb3.min.y + 2.0f, xbc->aabb3.min.z + (y + 0.5f) * cellHeight };
+
+			for (unsigned s = 0; s < 2; s++) {
+				for (unsigned i = 0; i < sectionCounts[s]; i++) {
+					occluders->isHidden(eye, sections[s][i].aabb1);
+				}
+			}
+		}
+	}
+
+	const occ::Stats& stats = occluders->stats;
+	if (stats.queries) {
+		std::cout << "Sections hidden: " << stats.hidden << " of " << stats.queries << " (" << std::fixed << std::setprecision(1) << 100.0 * stats.hidden / stats.queries << "%)" << std::endl;
+		std::cout << "Occluder tests per section: " << (double)stats.occluderTests / stats.queries << std::endl;
+		std::cout.unsetf(std::ios_base::floatfield);
+	}
+}
+
 int main(int argc, char** argv)
 {
 	if (argc != 2) {
@@ -397,13 +431,15 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
-	std::string xbcFilename = argv[1], tocFilename = argv[1], pakFilename = argv[1];
+	std::string xbcFilename = argv[1], tocFilename = argv[1], pakFilename = argv[1], occFilename = argv[1];
 	xbcFilename.append(".xbc");
 	tocFilename.append(".toc");
 	pakFilename.append(".pak");
+	occFilename.append(".occ");
 
 	xbc::Xbc* xbc;
 	pak::Toc* toc;
+	occ::Occlusion* occlusion = 0;
 
 	std::ifstream ifs;
 	ifs.exceptions(std::ifstream::failbit | std::ifstream::badbit | std::ifstream::eofbit);
@@ -437,6 +473,22 @@ int main(int argc, char** argv)
 
 			ifs.close();
 		}
+		// OCC, optional
+		{
+			std::ifstream occIfs(occFilename, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+
+			if (occIfs.is_open()) {
+				occIfs.exceptions(std::ifstream::failbit | std::ifstream::badbit | std::ifstream::eofbit);
+				std::cout << "Reading \"" << occFilename << "\"" << std::endl;
+
+				std::streampos length = occIfs.tellg();
+				occIfs.seekg(0);
+
+				occlusion = occ::Occlusion::readFile(occIfs);
+
+				std::cout << "Finished reading with " << length - occIfs.tellg() << " bytes left in file" << std::endl << std::endl;
+			}
+		}
 		// PAK
 		{
 			std::cout << "Opening \"" << pakFilename << "\"" << std::endl;
@@ -450,6 +502,11 @@ int main(int argc, char** argv)
 
 		//dumpTextures(xbc, toc);
 		dumpMaps(xbc, toc);
+
+		if (occlusion) {
+			occ::Occluders occluders(occlusion);
+			printOcclusion(xbc, &occluders);
+		}
 	}
 	catch (const std::ios_base::failure&) {
 		std::cerr << "Exception: " << ::strerror(errno) << std::endl;
@@ -462,6 +519,7 @@ int main(int argc, char** argv)
 
 	delete xbc;
 	delete toc;
+	delete occlusion;
 
 	ifs.close();
 
@@ -0,0 +1,271 @@
+#include "occ.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+using namespace occ;
+
+Lines::Lines()
+{
+	indices = 0;
+}
+
+Lines::~Lines()
+{
+	if (indices) {
+		delete[] indices;
+	}
+}
+
+void Lines::read(std::ifstream& ifs)
+{
+	parse(ifs, lineCount);
+	indices = new uint16_t[lineCount * 2];
+	ifs.read(reinterpret_cast<char*>(indices), sizeof(uint16_t) * lineCount * 2);
+}
+
+Entry::Entry()
+{
+	lines = 0;
+	vertices = 0;
+	unknown0 = 0;
+	unknown1 = 0;
+}
+
+Entry::~Entry()
+{
+	if (lines) {
+		delete[] lines;
+	}
+
+	if (vertices) {
+		delete[] vertices;
+	}
+
+	if (unknown0) {
+		delete[] unknown0;
+	}
+
+	if (unknown1) {
+		delete[] unknown1;
+	}
+}
+
+void Entry::read(std::ifstream& ifs)
+{
+	parse(ifs, version);
+
+	parse(ifs, linesCount);
+	lines = new Lines[linesCount];
+	for (unsigned i = 0; i < linesCount; i++) {
+		lines[i].read(ifs);
+	}
+
+	parse(ifs, vertexCount);
+	vertices = new xbc::Vec3f[vertexCount];
+	ifs.read(reinterpret_cast<char*>(vertices), sizeof(xbc::Vec3f) * vertexCount);
+
+	parse(ifs, unknown0Count);
+	unknown0 = new xbc::Vec4f[unknown0Count];
+	ifs.read(reinterpret_cast<char*>(unknown0), sizeof(xbc::Vec4f) * unknown0Count);
+
+	parse(ifs, unknown1Count);
+	unknown1 = new xbc::Vec3f[unknown1Count];
+	ifs.read(reinterpret_cast<char*>(unknown1), sizeof(xbc::Vec3f) * unknown1Count);
+
+	parse(ifs, unknown2);
+}
+
+Occlusion::Occlusion()
+{
+	entries = 0;
+}
+
+Occlusion::~Occlusion()
+{
+	if (entries) {
+		delete[] entries;
+	}
+}
+
+void Occlusion::read(std::ifstream& ifs)
+{
+	parse(ifs, entryCount);
+	entries = new Entry[entryCount];
+	for (unsigned i = 0; i < entryCount; i++) {
+		entries[i].read(ifs);
+	}
+}
+
+Occlusion* Occlusion::readFile(std::ifstream& ifs)
+{
+	Occlusion* occlusion = new Occlusion();
+
+	occlusion->read(ifs);
+
+	return occlusion;
+}
+
+static inline xbc::Vec3f sub(const xbc::Vec3f& a, const xbc::Vec3f& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+static inline float      dot(const xbc::Vec3f& a, const xbc::Vec3f& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline xbc::Vec3f cross(const xbc::Vec3f& a, const xbc::Vec3f& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+static inline bool normalize(xbc::Vec3f& v)
+{
+	float length = std::sqrt(dot(v, v));
+	if (length < 1e-6f) {
+		return false;
+	}
+
+	v = { v.x / length, v.y / length, v.z / length };
+	return true;
+}
+
+Occluders::Occluders(const Occlusion* occlusion)
+{
+	skipped = 0;
+
+	for (unsigned e = 0; e < occlusion->entryCount; e++) {
+		const Entry& entry = occlusion->entries[e];
+
+		for (unsigned l = 0; l < entry.linesCount; l++) {
+			const Lines& lines = entry.lines[l];
+
+			// Vertex to its (at most two) neighbours, the set must be one closed loop.
+			std::map<uint16_t, std::vector<uint16_t>> neighbours;
+			bool valid = lines.lineCount >= 3;
+			for (unsigned i = 0; valid && i < lines.lineCount; i++) {
+				uint16_t a = lines.indices[i * 2], b = lines.indices[i * 2 + 1];
+				valid = a != b && a < entry.vertexCount && b < entry.vertexCount;
+				neighbours[a].push_back(b);
+				neighbours[b].push_back(a);
+			}
+
+			for (std::map<uint16_t, std::vector<uint16_t>>::value_type& v : neighbours) {
+				valid = valid && v.second.size() == 2;
+			}
+
+			std::vector<xbc::Vec3f> loop;
+			if (valid) {
+				uint16_t prev = lines.indices[0], cur = lines.indices[1];
+				loop.push_back(entry.vertices[prev]);
+				while (cur != lines.indices[0] && loop.size() <= lines.lineCount) {
+					loop.push_back(entry.vertices[cur]);
+					uint16_t next = neighbours[cur][0] == prev ? neighbours[cur][1] : neighbours[cur][0];
+					prev = cur;
+					cur = next;
+				}
+			}
+
+			if (loop.size() != lines.lineCount || !addLoop(loop)) {
+				skipped++;
+			}
+		}
+	}
+}
+
+bool Occluders::addLoop(const std::vector<xbc::Vec3f>& loop)
+{
+	unsigned count = loop.size();
+	if (count < 3) {
+		return false;
+	}
+
+	// Newell's method, robust for slightly non-planar loops.
+	Plane plane;
+	plane.normal = { 0.0f, 0.0f, 0.0f };
+	xbc::Vec3f center = { 0.0f, 0.0f, 0.0f };
+	for (unsigned i = 0; i < count; i++) {
+		const xbc::Vec3f& a = loop[i];
+		const xbc::Vec3f& b = loop[(i + 1) % count];
+		plane.normal.x += (a.y - b.y) * (a.z + b.z);
+		plane.normal.y += (a.z - b.z) * (a.x + b.x);
+		plane.normal.z += (a.x - b.x) * (a.y + b.y);
+		center = { center.x + a.x / count, center.y + a.y / count, center.z + a.z / count };
+	}
+
+	if (!normalize(plane.normal)) {
+		return false;
+	}
+	plane.distance = dot(plane.normal, center);
+
+	float size = 0.0f;
+	for (const xbc::Vec3f& v : loop) {
+		xbc::Vec3f d = sub(v, center);
+		size = std::max(size, dot(d, d));
+	}
+	float tolerance = std::sqrt(size) * 0.01f;
+
+	std::vector<Plane> loopEdges;
+	for (unsigned i = 0; i < count; i++) {
+		const xbc::Vec3f& a = loop[i];
+		const xbc::Vec3f& b = loop[(i + 1) % count];
+		const xbc::Vec3f& c = loop[(i + 2) % count];
+
+		// Planar and convex, a box inside every edge is then inside the polygon.
+		if (std::fabs(dot(plane.normal, a) - plane.distance) > tolerance || dot(cross(sub(b, a), sub(c, b)), plane.normal) < 0.0f) {
+			return false;
+		}
+
+		Plane edge;
+		edge.normal = cross(plane.normal, sub(b, a));
+		if (!normalize(edge.normal)) {
+			return false;
+		}
+		edge.distance = dot(edge.normal, a);
+		loopEdges.push_back(edge);
+	}
+
+	Occluder occluder;
+	occluder.plane     = plane;
+	occluder.firstEdge = edges.size();
+	occluder.edgeCount = count;
+
+	occluders.push_back(occluder);
+	edges.insert(edges.end(), loopEdges.begin(), loopEdges.end());
+
+	return true;
+}
+
+bool Occluders::isHidden(const xbc::Vec3f& eye, const xbc::BoundBox3& box)
+{
+	stats.queries++;
+
+	xbc::Vec3f corners[8];
+	for (unsigned i = 0; i < 8; i++) {
+		corners[i] = { i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z };
+	}
+
+	for (const Occluder& occluder : occluders) {
+		stats.occluderTests++;
+
+		const Plane& plane = occluder.plane;
+		float eyeSide = dot(plane.normal, eye) - plane.distance;
+
+		bool hidden = eyeSide != 0.0f;
+		for (unsigned i = 0; hidden && i < 8; i++) {
+			// Corner behind the plane, projected onto it towards the eye.
+			float side = dot(plane.normal, corners[i]) - plane.distance;
+			if (side * eyeSide >= 0.0f) {
+				hidden = false;
+				break;
+			}
+
+			xbc::Vec3f dir = sub(corners[i], eye);
+			float t = -eyeSide / dot(plane.normal, dir);
+			xbc::Vec3f p = { eye.x + dir.x * t, eye.y + dir.y * t, eye.z + dir.z * t };
+
+			for (unsigned e = occluder.firstEdge; hidden && e < occluder.firstEdge + occluder.edgeCount; e++) {
+				hidden = dot(edges[e].normal, p) >= edges[e].distance;
+			}
+		}
+
+		if (hidden) {
+			stats.hidden++;
+			return true;
+		}
+	}
+
+	return false;
+}
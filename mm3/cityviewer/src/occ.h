@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "util.h"
+#include "xbc.h"
+
+namespace occ
+{
+	class Lines : public util::Element
+	{
+		public:
+			Lines();
+			virtual ~Lines();
+			virtual void read(std::ifstream& ifs);
+
+			uint32_t     lineCount;
+			uint16_t*    indices;
+	};
+
+	class Entry : public util::Element
+	{
+		public:
+			Entry();
+			virtual ~Entry();
+			virtual void read(std::ifstream& ifs);
+
+			std::string  version;
+			uint32_t     linesCount;
+			Lines*       lines;
+			uint32_t     vertexCount;
+			xbc::Vec3f*  vertices;
+			uint32_t     unknown0Count;
+			xbc::Vec4f*  unknown0;
+			uint32_t     unknown1Count;
+			xbc::Vec3f*  unknown1;
+			float        unknown2[15];
+	};
+
+	class Occlusion : public util::Element
+	{
+		public:
+			Occlusion();
+			virtual ~Occlusion();
+
+			virtual void read(std::ifstream& ifs);
+			static Occlusion* readFile(std::ifstream& ifs);
+
+			uint32_t     entryCount;
+			Entry*       entries;
+	};
+
+	// Queries since the last reset.
+	struct Stats
+	{
+		Stats() : queries(0), hidden(0), occluderTests(0) {}
+
+		unsigned queries;
+		unsigned hidden;
+		unsigned occluderTests;
+	};
+
+	// Convex planar polygons made from line sets that form a single closed
+	// loop. Other line sets are skipped.
+	class Occluders
+	{
+		public:
+			Occluders(const Occlusion* occlusion);
+
+			// Whether a box is completely behind one occluder seen from eye.
+			bool isHidden(const xbc::Vec3f& eye, const xbc::BoundBox3& box);
+
+			unsigned getCount() const { return occluders.size(); }
+			unsigned getSkipped() const { return skipped; }
+
+			Stats stats;
+
+		private:
+			struct Plane
+			{
+				xbc::Vec3f normal;
+				float      distance;
+			};
+
+			struct Occluder
+			{
+				Plane    plane;
+				unsigned firstEdge;
+				unsigned edgeCount;
+			};
+
+			bool addLoop(const std::vector<xbc::Vec3f>& loop);
+
+			std::vector<Occluder> occluders;
+			std::vector<Plane>    edges;   // Perpendicular to the occluder plane, facing inwards.
+			unsigned              skipped;
+	};
+}
@@ -0,0 +1,158 @@
+#include "ani.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace ani;
+
+Animation* Animation::readFile(std::ifstream& ifs)
+{
+	Animation* animation = new Animation();
+
+	try {
+		parse(ifs, animation->version);
+		parse(ifs, animation->unknown);
+
+		uint32_t trackCount;
+		parse(ifs, trackCount);
+
+		animation->tracks.resize(trackCount);
+
+		for (Track& track : animation->tracks) {
+			parse(ifs, track.name);
+
+			uint32_t frameCount;
+			parse(ifs, frameCount);
+
+			if (!frameCount) {
+				std::ostringstream msg;
+				msg << "Track \"" << track.name << "\" has no frames.";
+				throw std::runtime_error(msg.str());
+			}
+
+			track.unknown.resize(frameCount);
+			ifs.read(reinterpret_cast<char*>(track.unknown.data()), frameCount * sizeof(float));
+
+			std::vector<Vec3f> vertices(frameCount * 2);
+			ifs.read(reinterpret_cast<char*>(vertices.data()), vertices.size() * sizeof(Vec3f));
+
+			for (unsigned c = 0; c < 6; c++) {
+				track.channels[c].resize(frameCount);
+			}
+
+			for (unsigned i = 0; i < frameCount; i++) {
+				for (unsigned v = 0; v < 2; v++) {
+					track.channels[v * 3 + 0][i] = vertices[i * 2 + v].x;
+					track.channels[v * 3 + 1][i] = vertices[i * 2 + v].y;
+					track.channels[v * 3 + 2][i] = vertices[i * 2 + v].z;
+				}
+			}
+		}
+	}
+	catch (...) {
+		delete animation;
+		throw;
+	}
+
+	return animation;
+}
+
+// Position within a track of frameCount frames, wrapped into [0, frameCount).
+static inline float wrap(float time, float frameCount, float inverse)
+{
+	float loops = time * inverse;
+	float whole = (float)(int)loops;
+	if (loops < whole) {
+		whole -= 1.0f;
+	}
+
+	float wrapped = std::max(time - whole * frameCount, 0.0f);
+	return wrapped < frameCount ? wrapped : 0.0f;
+}
+
+void Animation::sampleScalar(const float* times, unsigned count, Vec3f* out) const
+{
+	unsigned stride = tracks.size() * 2;
+
+	for (unsigned n = 0; n < count; n++) {
+		for (unsigned t = 0; t < tracks.size(); t++) {
+			const Track& track = tracks[t];
+			unsigned frameCount = track.getFrameCount();
+
+			float pos = wrap(times[n], (float)frameCount, 1.0f / frameCount);
+			unsigned a = (unsigned)(int)pos;
+			unsigned b = a + 1 < frameCount ? a + 1 : 0;
+			float blend = pos - (float)(int)a;
+
+			float v[6];
+			for (unsigned c = 0; c < 6; c++) {
+				float from = track.channels[c][a];
+				v[c] = from + (track.channels[c][b] - from) * blend;
+			}
+
+			out[n * stride + t * 2]     = { v[0], v[1], v[2] };
+			out[n * stride + t * 2 + 1] = { v[3], v[4], v[5] };
+		}
+	}
+}
+
+void Animation::sample(const float* times, unsigned count, Vec3f* out) const
+{
+	unsigned n = 0;
+
+#ifdef __SSE2__
+	// Four instances at a time: wrap times and blend each channel in one register.
+	unsigned stride = tracks.size() * 2;
+
+	for (; n + 4 <= count; n += 4) {
+		__m128 time = _mm_loadu_ps(times + n);
+
+		for (unsigned t = 0; t < tracks.size(); t++) {
+			const Track& track = tracks[t];
+			unsigned frameCount = track.getFrameCount();
+			__m128 frames = _mm_set1_ps((float)frameCount);
+
+			__m128 loops = _mm_mul_ps(time, _mm_set1_ps(1.0f / frameCount));
+			__m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(loops));
+			whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmplt_ps(loops, whole), _mm_set1_ps(1.0f)));
+
+			__m128 pos = _mm_max_ps(_mm_sub_ps(time, _mm_mul_ps(whole, frames)), _mm_setzero_ps());
+			pos = _mm_and_ps(pos, _mm_cmplt_ps(pos, frames));
+
+			__m128i first = _mm_cvttps_epi32(pos);
+			__m128 blend = _mm_sub_ps(pos, _mm_cvtepi32_ps(first));
+
+			alignas(16) int32_t a[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(a), first);
+
+			int32_t b[4];
+			for (unsigned i = 0; i < 4; i++) {
+				b[i] = (unsigned)a[i] + 1 < frameCount ? a[i] + 1 : 0;
+			}
+
+			alignas(16) float v[6][4];
+			for (unsigned c = 0; c < 6; c++) {
+				const float* channel = track.channels[c].data();
+				__m128 from = _mm_set_ps(channel[a[3]], channel[a[2]], channel[a[1]], channel[a[0]]);
+				__m128 to   = _mm_set_ps(channel[b[3]], channel[b[2]], channel[b[1]], channel[b[0]]);
+				_mm_store_ps(v[c], _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(to, from), blend)));
+			}
+
+			for (unsigned i = 0; i < 4; i++) {
+				out[(n + i) * stride + t * 2]     = { v[0][i], v[1][i], v[2][i] };
+				out[(n + i) * stride + t * 2 + 1] = { v[3][i], v[4][i], v[5][i] };
+			}
+		}
+	}
+
+	out += n * stride;
+#endif
+
+	sampleScalar(times + n, count - n, out);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ani
+{
+	struct Vec3f
+	{
+		float x, y, z;
+	};
+
+	// Keyframes of one bone. Each frame has two vertices, stored as one
+	// array per component: x, y, z of the first vertex, then of the second.
+	class Track
+	{
+		public:
+			unsigned getFrameCount() const { return unknown.size(); }
+
+			std::string        name;
+			std::vector<float> unknown;     // One per frame.
+			std::vector<float> channels[6];
+	};
+
+	class Animation
+	{
+		public:
+			static Animation* readFile(std::ifstream& ifs);
+
+			// Interpolate every track of many instances. Times are in frames
+			// and loop over each track, the last frame blends into the first.
+			// Writes two vertices per track and instance, instance by instance.
+			void sample(const float* times, unsigned count, Vec3f* out) const;
+			// Reference implementation, one instance at a time.
+			void sampleScalar(const float* times, unsigned count, Vec3f* out) const;
+
+			std::string        version;
+			float              unknown;
+			std::vector<Track> tracks;
+
+		private:
+			template<class T>
+			static void parse(std::istream& in, T& var) { in.read(reinterpret_cast<char*>(&var), sizeof(var)); }
+			static void parse(std::istream& in, std::string& var) { std::getline(in, var, '\0'); }
+	};
+}
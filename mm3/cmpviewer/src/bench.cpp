@@ -0,0 +1,706 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include "ani.h"
+#include "cache.h"
+#include "ccol.h"
+#include "cmp.h"
+#include "ske.h"
+#include "vertexcache.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Attributes
+{
+	float pos[3], normal[3], uv0[2], uv1[2], intensities[4];
+	unsigned ids[3];
+};
+
+// Reference path: per-vertex accessors, as drawMesh used to do.
+void decodeAccessors(cmp::MeshData* mesh, std::vector<Attributes>* out)
+{
+	cmp::BoundBox* b = &mesh->aabb;
+	float maxX = (b->min.x - b->max.x) * -1;
+	float maxY = (b->min.y - b->max.y) * -1;
+	float maxZ = (b->min.z - b->max.z) * -1;
+
+	out->resize(mesh->vertexCount2);
+
+	for (unsigned i = 0; i < mesh->vertexCount2; i++) {
+		cmp::Vertex* v = &mesh->vertices[i];
+		Attributes* a = &out->at(i);
+		a->pos[0] = v->getX(maxX);
+		a->pos[1] = v->getY(maxY);
+		a->pos[2] = -v->getZ(maxZ);
+		a->normal[0] = v->getNX();
+		a->normal[1] = v->getNY();
+		a->normal[2] = -v->getNZ();
+		a->uv0[0] = v->getU0();
+		a->uv0[1] = v->getV0();
+		a->uv1[0] = v->getU1();
+		a->uv1[1] = v->getV1();
+		a->intensities[0] = v->getAmbientIntensity();
+		a->intensities[1] = v->getSpecularIntensity();
+		a->intensities[2] = v->getSpecularPower();
+		a->intensities[3] = v->getEnvMapIntensity();
+		a->ids[0] = v->getMaterialId();
+		a->ids[1] = v->getMatrixId();
+		a->ids[2] = v->getDemolitionId();
+	}
+}
+
+// Synthetic mesh with random vertex data when no model is given.
+cmp::MeshData* randomMesh(unsigned count, unsigned seed)
+{
+	cmp::MeshData* mesh = new cmp::MeshData(cmp::Version115);
+	mesh->name = "random";
+	mesh->length = 1;
+	mesh->aabb = { { -1.0f, -0.5f, -2.0f }, { 1.0f, 1.0f, 2.5f } };
+	mesh->vertexCount2 = count;
+	mesh->vertices = new cmp::Vertex[count];
+
+	std::mt19937 rng(seed);
+	uint32_t* words = reinterpret_cast<uint32_t*>(mesh->vertices);
+	for (unsigned i = 0; i < count * sizeof(cmp::Vertex) / sizeof(uint32_t); i++) {
+		words[i] = rng();
+	}
+
+	return mesh;
+}
+
+double seconds(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool comparePacked(const std::vector<Attributes>& ref, const std::vector<cmp::PackedVertex>& packed, const cmp::BoundBox& aabb)
+{
+	float sx = (aabb.max.x - aabb.min.x) / 1024.0f;
+	float sy = (aabb.max.y - aabb.min.y) / 1024.0f;
+	float sz = (aabb.max.z - aabb.min.z) / 1024.0f;
+
+	// Positions go through a different float scaling, allow rounding differences.
+	auto near = [](float a, float b) { return std::fabs(a - b) <= 1e-5f * std::max(1.0f, std::fabs(a)); };
+
+	for (unsigned i = 0; i < packed.size(); i++) {
+		const Attributes& a = ref[i];
+		const cmp::PackedVertex& p = packed[i];
+		if (!near(a.pos[0], p.position[0] * sx) || !near(a.pos[1], p.position[1] * sy) || !near(a.pos[2], p.position[2] * sz) ||
+				a.normal[0] != p.normal[0] / 1024.0f || a.normal[1] != p.normal[1] / 1024.0f || a.normal[2] != p.normal[2] / 1024.0f ||
+				a.uv0[0] != p.uvs[0] / 1024.0f || a.uv0[1] != p.uvs[1] / 1024.0f || a.uv1[0] != p.uvs[2] / 1024.0f || a.uv1[1] != p.uvs[3] / 1024.0f ||
+				a.intensities[0] != p.intensities[0] / 256.0f || a.intensities[1] != p.intensities[1] / 256.0f ||
+				a.intensities[2] != p.intensities[2] / 256.0f || a.intensities[3] != p.intensities[3] / 256.0f ||
+				a.ids[0] != p.ids[0] || a.ids[1] != p.ids[1] || a.ids[2] != p.ids[2]) {
+			std::cerr << "Mismatch at vertex " << i << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void benchVertexPacking(cmp::MeshList& meshes, unsigned iterations)
+{
+	unsigned long long vertexCount = 0;
+	for (cmp::MeshData* mesh : meshes) {
+		vertexCount += mesh->vertexCount2;
+	}
+
+	std::vector<Attributes> ref;
+	std::vector<cmp::PackedVertex> packed;
+
+	for (cmp::MeshData* mesh : meshes) {
+		decodeAccessors(mesh, &ref);
+		packed.resize(mesh->vertexCount2);
+		mesh->packVertices(packed.data());
+		if (!comparePacked(ref, packed, mesh->aabb)) {
+			std::cerr << "Packed vertices differ from accessors in mesh \"" << mesh->name << "\"" << std::endl;
+			return;
+		}
+	}
+
+	Clock::time_point start = Clock::now();
+	for (unsigned i = 0; i < iterations; i++) {
+		for (cmp::MeshData* mesh : meshes) {
+			decodeAccessors(mesh, &ref);
+		}
+	}
+	double accessorTime = seconds(start);
+
+	start = Clock::now();
+	for (unsigned i = 0; i < iterations; i++) {
+		for (cmp::MeshData* mesh : meshes) {
+			packed.resize(mesh->vertexCount2);
+			mesh->packVertices(packed.data());
+		}
+	}
+	double packTime = seconds(start);
+
+	// Separate float arrays as previously uploaded: position, normal, 2 uvs, color, intensities, ids.
+	unsigned separateSize = (3 + 3 + 2 + 2 + 4 + 4) * sizeof(float) + 4;
+
+	double total = (double)vertexCount * iterations / 1e6;
+	std::cout << "Vertex packing, " << vertexCount << " vertices x " << iterations << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "  accessors:   " << std::setw(8) << total / accessorTime << " Mvertices/s" << std::endl;
+	std::cout << "  interleaved: " << std::setw(8) << total / packTime << " Mvertices/s" << std::endl;
+	std::cout << "  size:        " << std::setw(8) << sizeof(cmp::PackedVertex) << " bytes/vertex (was " << separateSize << ")" << std::endl;
+}
+
+// Triangle list of a regular grid in random triangle order.
+std::vector<uint16_t> shuffledGrid(unsigned size, unsigned seed)
+{
+	std::vector<uint16_t> indices;
+	for (unsigned y = 0; y + 1 < size; y++) {
+		for (unsigned x = 0; x + 1 < size; x++) {
+			uint16_t i = y * size + x;
+			uint16_t tris[6] = { i, (uint16_t)(i + 1), (uint16_t)(i + size), (uint16_t)(i + 1), (uint16_t)(i + size + 1), (uint16_t)(i + size) };
+			indices.insert(indices.end(), tris, tris + 6);
+		}
+	}
+
+	std::mt19937 rng(seed);
+	for (unsigned i = indices.size() / 3 - 1; i > 0; i--) {
+		unsigned j = rng() % (i + 1);
+		std::swap_ranges(indices.begin() + i * 3, indices.begin() + i * 3 + 3, indices.begin() + j * 3);
+	}
+
+	return indices;
+}
+
+void benchVertexCache(unsigned iterations)
+{
+	const unsigned size = 100;
+	std::vector<uint16_t> grid = shuffledGrid(size, 1);
+	std::vector<uint16_t> indices;
+	unsigned triangles = grid.size() / 3;
+
+	Clock::time_point start = Clock::now();
+	for (unsigned i = 0; i < iterations; i++) {
+		indices = grid;
+		vertexcache::optimize(indices.data(), indices.size(), size * size);
+	}
+	double time = seconds(start);
+
+	std::cout << "Vertex cache optimisation, " << triangles << " triangles x " << iterations << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "  ACMR before: " << std::setw(8) << (double)vertexcache::countMisses(grid.data(), grid.size(), size * size) / triangles << std::endl;
+	std::cout << "  ACMR after:  " << std::setw(8) << (double)vertexcache::countMisses(indices.data(), indices.size(), size * size) / triangles << std::endl;
+	std::cout << std::setprecision(1);
+	std::cout << "  optimise:    " << std::setw(8) << (double)triangles * iterations / time / 1e6 << " Mtriangles/s" << std::endl;
+}
+
+// Converting meshes against mapping them from the cache file.
+void benchSceneCache(const std::string& cmppath, cmp::MeshList& meshes, unsigned iterations)
+{
+	cache::SceneCache sceneCache(cmppath, meshes);
+	if (sceneCache.path.empty()) {
+		std::cerr << "No cache directory, skipping scene cache" << std::endl;
+		return;
+	}
+
+	Clock::time_point start = Clock::now();
+	for (unsigned i = 0; i < iterations; i++) {
+		sceneCache.build();
+	}
+	double buildTime = seconds(start) / iterations;
+
+	sceneCache.save();
+
+	start = Clock::now();
+	for (unsigned i = 0; i < iterations; i++) {
+		cache::SceneCache mapped(cmppath, meshes);
+		if (!mapped.load()) {
+			std::cerr << "Couldn't map \"" << mapped.path << "\"" << std::endl;
+			return;
+		}
+	}
+	double loadTime = seconds(start) / iterations;
+
+	const cache::Stats& stats = sceneCache.stats;
+	std::cout << "Scene cache, \"" << sceneCache.path << "\"" << std::endl;
+	std::cout << "  draw calls:  " << std::setw(8) << stats.primitives << " -> " << stats.batches << std::endl;
+	if (stats.triangles) {
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "  ACMR:        " << std::setw(8) << (double)stats.missesBefore / stats.triangles << " -> " << (double)stats.missesAfter / stats.triangles << std::endl;
+	}
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "  convert:     " << std::setw(8) << buildTime * 1e3 << " ms" << std::endl;
+	std::cout << "  hash + map:  " << std::setw(8) << loadTime  * 1e3 << " ms" << std::endl;
+}
+
+// Collision file with a soup of small random triangles, roughly car sized.
+std::vector<char> randomCollisionFile(unsigned triCount, unsigned seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> center(-1.0f, 1.0f), edge(-0.1f, 0.1f);
+
+	std::vector<float> vertices;
+	for (unsigned i = 0; i < triCount; i++) {
+		float c[3] = { center(rng) * 2.0f, center(rng), center(rng) };
+		for (unsigned j = 0; j < 3; j++) {
+			vertices.push_back(c[0] + edge(rng));
+			vertices.push_back(c[1] + edge(rng));
+			vertices.push_back(c[2] + edge(rng));
+		}
+	}
+
+	std::vector<char> data;
+	auto write = [&](const void* p, size_t size) { data.insert(data.end(), (const char*)p, (const char*)p + size); };
+	auto writeCount = [&](uint32_t count) { write(&count, sizeof(count)); };
+
+	writeCount(1);
+	write("random", 7);
+	writeCount(triCount * 3);
+	write(vertices.data(), vertices.size() * sizeof(float));
+	writeCount(0);
+	writeCount(0);
+	writeCount(triCount * 3);
+	for (uint32_t i = 0; i < triCount * 3; i++) {
+		write(&i, sizeof(i));
+	}
+
+	return data;
+}
+
+// Reference queries testing every triangle.
+float bruteRaycast(const ccol::Mesh& mesh, const ccol::Ray& ray)
+{
+	float best = ray.maxDistance;
+	const ccol::Vec3f& o = ray.origin;
+	const ccol::Vec3f& d = ray.direction;
+
+	for (unsigned t = 0; t < mesh.indexCount / 3; t++) {
+		ccol::Vec3f a = mesh.getVertex(mesh.getIndex(t * 3));
+		ccol::Vec3f b = mesh.getVertex(mesh.getIndex(t * 3 + 1));
+		ccol::Vec3f c = mesh.getVertex(mesh.getIndex(t * 3 + 2));
+
+		// Intersect the plane, then check barycentric coordinates.
+		float e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+		float e2[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+		float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		float denom = n[0] * d.x + n[1] * d.y + n[2] * d.z;
+		if (denom == 0.0f) {
+			continue;
+		}
+
+		float dist = (n[0] * (a.x - o.x) + n[1] * (a.y - o.y) + n[2] * (a.z - o.z)) / denom;
+		if (dist < 0.0f || dist >= best) {
+			continue;
+		}
+
+		float p[3] = { o.x + d.x * dist - a.x, o.y + d.y * dist - a.y, o.z + d.z * dist - a.z };
+		float d11 = e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2];
+		float d12 = e1[0] * e2[0] + e1[1] * e2[1] + e1[2] * e2[2];
+		float d22 = e2[0] * e2[0] + e2[1] * e2[1] + e2[2] * e2[2];
+		float dp1 = p[0] * e1[0] + p[1] * e1[1] + p[2] * e1[2];
+		float dp2 = p[0] * e2[0] + p[1] * e2[1] + p[2] * e2[2];
+		float det = d11 * d22 - d12 * d12;
+		float u = (d22 * dp1 - d12 * dp2) / det;
+		float v = (d11 * dp2 - d12 * dp1) / det;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f) {
+			best = dist;
+		}
+	}
+
+	return best;
+}
+
+unsigned bruteOverlap(const ccol::Mesh& mesh, const ccol::Sphere& sphere)
+{
+	unsigned count = 0;
+
+	// Sample the triangle densely, good enough for a sanity check.
+	for (unsigned t = 0; t < mesh.indexCount / 3; t++) {
+		ccol::Vec3f a = mesh.getVertex(mesh.getIndex(t * 3));
+		ccol::Vec3f b = mesh.getVertex(mesh.getIndex(t * 3 + 1));
+		ccol::Vec3f c = mesh.getVertex(mesh.getIndex(t * 3 + 2));
+
+		float r = sphere.radius;
+		if (std::min(std::min(a.x, b.x), c.x) > sphere.center.x + r || std::max(std::max(a.x, b.x), c.x) < sphere.center.x - r ||
+				std::min(std::min(a.y, b.y), c.y) > sphere.center.y + r || std::max(std::max(a.y, b.y), c.y) < sphere.center.y - r ||
+				std::min(std::min(a.z, b.z), c.z) > sphere.center.z + r || std::max(std::max(a.z, b.z), c.z) < sphere.center.z - r) {
+			continue;
+		}
+
+		float best = FLT_MAX;
+		const unsigned steps = 64;
+		for (unsigned i = 0; i <= steps; i++) {
+			for (unsigned j = 0; i + j <= steps; j++) {
+				float u = (float)i / steps, v = (float)j / steps;
+				float x = a.x + (b.x - a.x) * u + (c.x - a.x) * v - sphere.center.x;
+				float y = a.y + (b.y - a.y) * u + (c.y - a.y) * v - sphere.center.y;
+				float z = a.z + (b.z - a.z) * u + (c.z - a.z) * v - sphere.center.z;
+				best = std::min(best, x * x + y * y + z * z);
+			}
+		}
+
+		if (best <= sphere.radius * sphere.radius) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void benchCollision(const ccol::CollisionFile* file, unsigned queries)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	for (const ccol::Mesh& mesh : file->meshes) {
+		if (mesh.indexCount < 3) {
+			continue;
+		}
+
+		Clock::time_point start = Clock::now();
+		ccol::Bvh bvh(mesh);
+		double buildTime = seconds(start);
+
+		// Queries spread over the mesh bounds.
+		ccol::Vec3f min = mesh.getVertex(0), max = min;
+		for (unsigned i = 1; i < mesh.vertexCount; i++) {
+			ccol::Vec3f v = mesh.getVertex(i);
+			min = { std::min(min.x, v.x), std::min(min.y, v.y), std::min(min.z, v.z) };
+			max = { std::max(max.x, v.x), std::max(max.y, v.y), std::max(max.z, v.z) };
+		}
+		ccol::Vec3f center = { (min.x + max.x) / 2, (min.y + max.y) / 2, (min.z + max.z) / 2 };
+		ccol::Vec3f extent = { (max.x - min.x) / 2, (max.y - min.y) / 2, (max.z - min.z) / 2 };
+		float size = std::max(std::max(extent.x, extent.y), extent.z);
+		auto randomPoint = [&](float scale) {
+			return ccol::Vec3f({ center.x + unit(rng) * extent.x * scale, center.y + unit(rng) * extent.y * scale, center.z + unit(rng) * extent.z * scale });
+		};
+
+		std::vector<ccol::Ray> rays(queries);
+		for (ccol::Ray& ray : rays) {
+			ray.origin = randomPoint(2.0f);
+			ccol::Vec3f target = randomPoint(1.0f);
+			ccol::Vec3f d = { target.x - ray.origin.x, target.y - ray.origin.y, target.z - ray.origin.z };
+			float length = std::sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+			ray.direction = { d.x / length, d.y / length, d.z / length };
+			ray.maxDistance = size * 8.0f;
+		}
+
+		std::vector<ccol::Sphere> spheres(queries);
+		for (ccol::Sphere& sphere : spheres) {
+			sphere.center = randomPoint(1.0f);
+			sphere.radius = size * 0.05f;
+		}
+
+		std::vector<ccol::RayHit> hits(queries);
+		std::vector<ccol::SphereContact> contacts;
+
+		start = Clock::now();
+		bvh.raycast(rays.data(), rays.size(), hits.data());
+		double rayTime = seconds(start);
+
+		start = Clock::now();
+		bvh.overlap(spheres.data(), spheres.size(), &contacts);
+		double sphereTime = seconds(start);
+
+		// Check a sample against brute force, allowing for rounding and sampling error.
+		unsigned samples = std::min(queries, 200u), rayErrors = 0, sphereErrors = 0;
+		std::vector<unsigned> perSphere(queries, 0);
+		for (const ccol::SphereContact& contact : contacts) {
+			perSphere[contact.sphere]++;
+		}
+		for (unsigned i = 0; i < samples; i++) {
+			float ref = bruteRaycast(mesh, rays[i]);
+			if (std::fabs(ref - hits[i].distance) > 1e-3f * size) {
+				rayErrors++;
+			}
+			if (bruteOverlap(mesh, spheres[i]) > perSphere[i]) {
+				sphereErrors++;
+			}
+		}
+
+		std::cout << "Collision mesh \"" << mesh.name << "\", " << bvh.getTriangleCount() << " triangles, " << bvh.getNodeCount() << " nodes" << std::endl;
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "  build:       " << std::setw(8) << buildTime * 1e3 << " ms" << std::endl;
+		std::cout << std::setprecision(2);
+		std::cout << "  ray cast:    " << std::setw(8) << queries / rayTime / 1e6 << " Mqueries/s" << std::endl;
+		std::cout << "  sphere:      " << std::setw(8) << queries / sphereTime / 1e6 << " Mqueries/s, " << contacts.size() << " contacts" << std::endl;
+		if (rayErrors || sphereErrors) {
+			std::cerr << "  " << rayErrors << " ray and " << sphereErrors << " sphere queries of " << samples << " differ from brute force" << std::endl;
+		}
+	}
+}
+
+// Pedestrian-like hierarchy: spine with head, arms and legs of a few bones each.
+void randomSkeleton(ske::Skeleton* skeleton, unsigned seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	auto add = [&](int parent) {
+		skeleton->ids.push_back(skeleton->ids.size());
+		skeleton->names.push_back("bone");
+		skeleton->parents.push_back(parent);
+		skeleton->childCounts.push_back(0);
+		if (parent >= 0) {
+			skeleton->childCounts[parent]++;
+		}
+
+		// Rotation about a random axis, shifted outwards.
+		float a = unit(rng), c = std::cos(a), s = std::sin(a);
+		skeleton->vertices[0].push_back({ c, s, 0.0f });
+		skeleton->vertices[1].push_back({ -s, c, 0.0f });
+		skeleton->vertices[2].push_back({ 0.0f, 0.0f, 1.0f });
+		skeleton->vertices[3].push_back({ unit(rng) * 0.2f, 0.3f, unit(rng) * 0.2f });
+		return (int)skeleton->ids.size() - 1;
+	};
+
+	// Depth-first, as read from a file.
+	int pelvis = add(-1);
+	int spine = pelvis;
+	for (unsigned i = 0; i < 3; i++) {
+		spine = add(spine);
+	}
+	add(add(spine));
+	for (unsigned limb = 0; limb < 4; limb++) {
+		int bone = limb < 2 ? spine : pelvis;
+		for (unsigned i = 0; i < 4; i++) {
+			bone = add(bone);
+		}
+	}
+}
+
+// Reference: recursion over child lists, as a nested bone tree would be walked.
+void worldRecursive(const ske::Skeleton& skeleton, const std::vector<std::vector<unsigned>>& children, unsigned bone, const ske::Transform* local, ske::Transform* world)
+{
+	for (unsigned child : children[bone]) {
+		const ske::Transform& p = world[bone];
+		const ske::Transform& l = local[child];
+		ske::Transform& w = world[child];
+		const ske::Vec3f* in[4] = { &l.axes[0], &l.axes[1], &l.axes[2], &l.origin };
+		ske::Vec3f* out[4] = { &w.axes[0], &w.axes[1], &w.axes[2], &w.origin };
+		for (unsigned i = 0; i < 4; i++) {
+			float wt = i == 3 ? 1.0f : 0.0f;
+			out[i]->x = in[i]->x * p.axes[0].x + in[i]->y * p.axes[1].x + in[i]->z * p.axes[2].x + wt * p.origin.x;
+			out[i]->y = in[i]->x * p.axes[0].y + in[i]->y * p.axes[1].y + in[i]->z * p.axes[2].y + wt * p.origin.y;
+			out[i]->z = in[i]->x * p.axes[0].z + in[i]->y * p.axes[1].z + in[i]->z * p.axes[2].z + wt * p.origin.z;
+		}
+		worldRecursive(skeleton, children, child, local, world);
+	}
+}
+
+void benchSkeleton(const ske::Skeleton& skeleton, unsigned instances, unsigned iterations)
+{
+	unsigned count = skeleton.getBoneCount();
+
+	std::vector<ske::Transform> local(count * instances), world(count * instances), ref(count * instances);
+	for (unsigned n = 0; n < instances; n++) {
+		skeleton.getBindPose(&local[n * count]);
+	}
+
+	std::vector<std::vector<unsigned>> children(count);
+	for (unsigned i = 0; i < count; i++) {
+		if (skeleton.parents[i] >= 0) {
+			children[skeleton.parents[i]].push_back(i);
+		}
+	}
+
+	Clock::time_point start = Clock::now();
+	for (unsigned i = 0; i < iterations; i++) {
+		for (unsigned n = 0; n < instances; n++) {
+			ref[n * count] = local[n * count];
+			worldRecursive(skeleton, children, 0, &local[n * count], &ref[n * count]);
+		}
+	}
+	double recursiveTime = seconds(start);
+
+	start = Clock::now();
+	for (unsigned i = 0; i < iterations; i++) {
+		skeleton.computeWorldTransforms(local.data(), world.data(), instances);
+	}
+	double linearTime = seconds(start);
+
+	if (::memcmp(world.data(), ref.data(), world.size() * sizeof(ske::Transform))) {
+		std::cerr << "Linear world transforms differ from recursion" << std::endl;
+	}
+
+	double total = (double)count * instances * iterations / 1e6;
+	std::cout << "Skeleton, " << count << " bones x " << instances << " instances x " << iterations << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "  recursive:   " << std::setw(8) << total / recursiveTime << " Mbones/s" << std::endl;
+	std::cout << "  linear:      " << std::setw(8) << total / linearTime    << " Mbones/s" << std::endl;
+}
+
+// Walk cycle sized animation with random keyframes.
+void randomAnimation(ani::Animation* animation, unsigned trackCount, unsigned frameCount, unsigned seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	animation->tracks.resize(trackCount);
+	for (ani::Track& track : animation->tracks) {
+		track.name = "bone";
+		track.unknown.assign(frameCount, 0.0f);
+		for (unsigned c = 0; c < 6; c++) {
+			track.channels[c].resize(frameCount);
+			for (float& v : track.channels[c]) {
+				v = unit(rng);
+			}
+		}
+	}
+}
+
+void benchAnimation(const ani::Animation& animation, unsigned instances, unsigned iterations)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> time(-100.0f, 100.0f);
+
+	std::vector<float> times(instances);
+	for (float& t : times) {
+		t = time(rng);
+	}
+
+	unsigned count = instances * animation.tracks.size() * 2;
+	std::vector<ani::Vec3f> ref(count), out(count);
+
+	Clock::time_point start = Clock::now();
+	for (unsigned i = 0; i < iterations; i++) {
+		animation.sampleScalar(times.data(), instances, ref.data());
+	}
+	double scalarTime = seconds(start);
+
+	start = Clock::now();
+	for (unsigned i = 0; i < iterations; i++) {
+		animation.sample(times.data(), instances, out.data());
+	}
+	double batchTime = seconds(start);
+
+	if (::memcmp(ref.data(), out.data(), count * sizeof(ani::Vec3f))) {
+		std::cerr << "Batch sampling differs from scalar" << std::endl;
+	}
+
+	double total = (double)instances * iterations;
+	std::cout << "Animation, " << animation.tracks.size() << " tracks x " << instances << " instances x " << iterations << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "  scalar:      " << std::setw(8) << total / scalarTime / 1e3 << " kinstances/s" << std::endl;
+	std::cout << "  batch:       " << std::setw(8) << total / batchTime  / 1e3 << " kinstances/s" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 2) {
+		std::cerr << "Usage: " << argv[0] << " [filename.cmp|filename.ccol|filename.ske|filename.ani]" << std::endl;
+		return 1;
+	}
+
+	std::string path = argc == 2 ? argv[1] : "";
+	auto hasExtension = [&](const std::string& ext) { return path.size() > ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0; };
+	bool isCollision = hasExtension(".ccol");
+	bool isSkeleton  = hasExtension(".ske");
+	bool isAnimation = hasExtension(".ani");
+
+	cmp::RootNode* root = 0;
+	ccol::CollisionFile* collision = 0;
+	ske::Skeleton* skeleton = 0;
+	ani::Animation* animation = 0;
+	cmp::MeshList random;
+	cmp::MeshList meshes;
+
+	if (isCollision || isSkeleton || isAnimation) {
+		std::ifstream ifs;
+		ifs.exceptions(std::ifstream::failbit | std::ifstream::badbit | std::ifstream::eofbit);
+
+		try {
+			ifs.open(path, std::ifstream::in | std::ifstream::binary);
+			if (isCollision) {
+				collision = ccol::CollisionFile::readFile(ifs);
+			}
+			else if (isSkeleton) {
+				skeleton = ske::Skeleton::readFile(ifs);
+			}
+			else {
+				animation = ani::Animation::readFile(ifs);
+			}
+			ifs.close();
+		}
+		catch (const std::ios_base::failure&) {
+			std::cerr << "Exception: " << ::strerror(errno) << std::endl;
+			return 2;
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Exception: " << e.what() << std::endl;
+			return 3;
+		}
+	}
+	else if (!path.empty()) {
+		std::ifstream ifs;
+		ifs.exceptions(std::ifstream::failbit | std::ifstream::badbit | std::ifstream::eofbit);
+
+		try {
+			ifs.open(argv[1], std::ifstream::in | std::ifstream::binary);
+			root = cmp::RootNode::readFile(ifs);
+			ifs.close();
+		}
+		catch (const std::ios_base::failure&) {
+			std::cerr << "Exception: " << ::strerror(errno) << std::endl;
+			return 2;
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Exception: " << e.what() << std::endl;
+			return 3;
+		}
+
+		cmp::MeshList all;
+		root->findMeshes(&all);
+		for (cmp::MeshData* mesh : all) {
+			if (mesh->length) {
+				meshes.push_back(mesh);
+			}
+		}
+	}
+
+	if (!root) {
+		// Roughly a car: many small meshes.
+		for (unsigned i = 0; i < 50; i++) {
+			random.push_back(randomMesh(2000, i));
+		}
+		meshes = random;
+	}
+
+	benchVertexPacking(meshes, 50);
+	benchVertexCache(20);
+
+	if (root) {
+		benchSceneCache(path, meshes, 50);
+	}
+
+	std::vector<char> collisionData;
+	if (!collision) {
+		collisionData = randomCollisionFile(20000, 1);
+		collision = ccol::CollisionFile::parse(collisionData.data(), collisionData.size());
+	}
+	benchCollision(collision, 100000);
+
+	if (!skeleton) {
+		skeleton = new ske::Skeleton();
+		randomSkeleton(skeleton, 1);
+	}
+	benchSkeleton(*skeleton, 5000, 20);
+
+	if (!animation) {
+		animation = new ani::Animation();
+		randomAnimation(animation, 22, 30, 1);
+	}
+	benchAnimation(*animation, 5000, 20);
+
+	delete animation;
+	delete skeleton;
+	delete collision;
+	delete root;
+	for (cmp::MeshData* mesh : random) {
+		delete mesh;
+	}
+
+	return 0;
+}
@@ -0,0 +1,394 @@
+#include "cache.h"
+#include "vertexcache.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace cache;
+
+// Bump when the converted layout changes.
+static const uint32_t FormatVersion = 2;
+
+static const char Magic[4] = { 'C', 'M', 'P', 'C' };
+
+struct FileHeader
+{
+	char     magic[4];
+	uint32_t version;
+	uint64_t hash;
+	uint32_t meshCount;
+	uint32_t reserved;
+};
+
+struct FileMesh
+{
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t batchCount;
+	uint32_t reserved;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t batchOffset;
+};
+
+static uint64_t align(uint64_t offset)
+{
+	return (offset + 15) & ~(uint64_t)15;
+}
+
+static std::string cacheDirectory()
+{
+	const char* xdg = ::getenv("XDG_CACHE_HOME");
+	if (xdg && *xdg) {
+		return std::string(xdg) + "/cmpviewer";
+	}
+
+	const char* home = ::getenv("HOME");
+	if (home && *home) {
+		return std::string(home) + "/.cache/cmpviewer";
+	}
+
+	return "";
+}
+
+static void makeDirectories(const std::string& path)
+{
+	for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+		std::string dir = path.substr(0, pos);
+		if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+			std::ostringstream msg;
+			msg << "Couldn't create directory \"" << dir << "\": " << ::strerror(errno);
+			throw std::runtime_error(msg.str());
+		}
+
+		if (pos == std::string::npos) {
+			break;
+		}
+	}
+}
+
+uint64_t cache::hash(const void* data, size_t length, uint64_t seed)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t h = seed;
+
+	for (size_t i = 0; i < length; i++) {
+		h ^= bytes[i];
+		h *= 0x100000001B3ULL;
+	}
+
+	return h;
+}
+
+// Whether count elements at offset fit in size bytes, without wrapping around.
+static bool inRange(uint64_t offset, uint64_t count, uint64_t elemSize, uint64_t size)
+{
+	return offset <= size && count * elemSize <= size - offset;
+}
+
+// Batches are built per material of the mesh primitives, others are stale.
+static bool hasMaterial(const cmp::MeshData* mesh, uint32_t material)
+{
+	for (const cmp::Material* m : mesh->materials) {
+		if (m->material == material) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+SceneCache::SceneCache(const std::string& cmppath, const cmp::MeshList& meshes)
+{
+	mapping = 0;
+	mappingSize = 0;
+
+	for (cmp::MeshData* mesh : meshes) {
+		if (mesh->length) {
+			this->meshes.push_back(mesh);
+		}
+	}
+
+	hash = cache::hash(&FormatVersion, sizeof(FormatVersion));
+
+	std::ifstream ifs(cmppath, std::ifstream::in | std::ifstream::binary);
+	std::vector<char> chunk(0x10000);
+	while (ifs) {
+		ifs.read(chunk.data(), chunk.size());
+		hash = cache::hash(chunk.data(), ifs.gcount(), hash);
+	}
+
+	// Caching is disabled when the model can't be hashed.
+	std::string dir = cacheDirectory();
+	if (ifs.eof() && !dir.empty()) {
+		std::ostringstream name;
+		name << dir << "/" << std::hex;
+		name.width(16);
+		name.fill('0');
+		name << hash << ".cache";
+		path = name.str();
+	}
+}
+
+SceneCache::~SceneCache()
+{
+	if (mapping) {
+		::munmap(mapping, mappingSize);
+	}
+}
+
+bool SceneCache::load()
+{
+	if (path.empty()) {
+		return false;
+	}
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FileHeader)) {
+		::close(fd);
+		return false;
+	}
+
+	size_t size = st.st_size;
+	void* data = ::mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	const uint8_t* base = static_cast<const uint8_t*>(data);
+	const FileHeader* header = reinterpret_cast<const FileHeader*>(base);
+
+	bool valid = !::memcmp(header->magic, Magic, sizeof(Magic))
+		&& header->version == FormatVersion
+		&& header->hash == hash
+		&& header->meshCount == meshes.size()
+		&& sizeof(FileHeader) + (uint64_t)header->meshCount * sizeof(FileMesh) <= size;
+
+	std::vector<MeshBuffers> mapped;
+
+	for (uint32_t i = 0; valid && i < header->meshCount; i++) {
+		const FileMesh* entry = reinterpret_cast<const FileMesh*>(base + sizeof(FileHeader)) + i;
+
+		valid = entry->vertexCount == meshes[i]->vertexCount2
+			&& inRange(entry->vertexOffset, entry->vertexCount, sizeof(cmp::PackedVertex), size)
+			&& inRange(entry->indexOffset,  entry->indexCount,  sizeof(uint16_t),          size)
+			&& inRange(entry->batchOffset,  entry->batchCount,  sizeof(Batch),             size);
+
+		if (valid) {
+			MeshBuffers buffer;
+			buffer.vertices    = reinterpret_cast<const cmp::PackedVertex*>(base + entry->vertexOffset);
+			buffer.vertexCount = entry->vertexCount;
+			buffer.indices     = reinterpret_cast<const uint16_t*>(base + entry->indexOffset);
+			buffer.indexCount  = entry->indexCount;
+			buffer.batches     = reinterpret_cast<const Batch*>(base + entry->batchOffset);
+			buffer.batchCount  = entry->batchCount;
+
+			for (uint32_t j = 0; valid && j < buffer.batchCount; j++) {
+				const Batch& batch = buffer.batches[j];
+				valid = batch.type == cmp::Primitive::Type::TriangleList
+					&& (uint64_t)batch.offset + batch.count <= buffer.indexCount
+					&& hasMaterial(meshes[i], batch.material);
+			}
+
+			// Indices are uploaded as they are.
+			for (uint32_t j = 0; valid && j < buffer.indexCount; j++) {
+				valid = buffer.indices[j] < buffer.vertexCount;
+			}
+
+			mapped.push_back(buffer);
+		}
+	}
+
+	if (!valid) {
+		::munmap(data, size);
+		return false;
+	}
+
+	if (mapping) {
+		::munmap(mapping, mappingSize);
+	}
+
+	mapping = data;
+	mappingSize = size;
+	buffers = mapped;
+	converted.clear();
+
+	return true;
+}
+
+void SceneCache::build()
+{
+	converted.clear();
+	converted.resize(meshes.size());
+	buffers.resize(meshes.size());
+	stats = Stats();
+
+	for (unsigned i = 0; i < meshes.size(); i++) {
+		const cmp::MeshData* mesh = meshes[i];
+		Converted& out = converted[i];
+
+		out.vertices.resize(mesh->vertexCount2);
+		mesh->packVertices(out.vertices.data());
+
+		// Primitives of each material merged into one triangle list.
+		std::map<uint32_t, std::vector<uint16_t>> lists;
+		std::vector<uint16_t> original;
+
+		for (unsigned j = 0; j < mesh->primitives.size(); j++) {
+			const cmp::Primitive* primitive = mesh->primitives[j];
+			std::vector<uint16_t>& list = lists[mesh->materials.at(j)->material];
+			size_t first = list.size();
+
+			switch (primitive->type) {
+				case cmp::Primitive::Type::TriangleList:
+				{
+					const uint16_t* indices = mesh->indices + primitive->offset;
+					list.insert(list.end(), indices, indices + (primitive->count + 1) * 3);
+					break;
+				}
+				case cmp::Primitive::Type::TriangleStrip:
+					// Every other strip triangle has its winding flipped.
+					for (unsigned k = 0; k < (unsigned)primitive->count + 1; k++) {
+						uint16_t a = primitive->offset + k;
+						uint16_t b = a + 1;
+						uint16_t c = a + 2;
+						if (k & 1) {
+							std::swap(a, b);
+						}
+
+						list.push_back(a);
+						list.push_back(b);
+						list.push_back(c);
+					}
+					break;
+				default:
+					continue;
+			}
+
+			original.insert(original.end(), list.begin() + first, list.end());
+			stats.primitives++;
+		}
+
+		stats.missesBefore += vertexcache::countMisses(original.data(), original.size(), mesh->vertexCount2);
+
+		for (std::map<uint32_t, std::vector<uint16_t>>::value_type& list : lists) {
+			vertexcache::optimize(list.second.data(), list.second.size(), mesh->vertexCount2);
+
+			Batch batch;
+			batch.material = list.first;
+			batch.type     = cmp::Primitive::Type::TriangleList;
+			batch.offset   = out.indices.size();
+			batch.count    = list.second.size();
+
+			out.indices.insert(out.indices.end(), list.second.begin(), list.second.end());
+			out.batches.push_back(batch);
+		}
+
+		stats.batches     += out.batches.size();
+		stats.triangles   += out.indices.size() / 3;
+		stats.missesAfter += vertexcache::countMisses(out.indices.data(), out.indices.size(), mesh->vertexCount2);
+
+		MeshBuffers& buffer = buffers[i];
+		buffer.vertices    = out.vertices.data();
+		buffer.vertexCount = out.vertices.size();
+		buffer.indices     = out.indices.data();
+		buffer.indexCount  = out.indices.size();
+		buffer.batches     = out.batches.data();
+		buffer.batchCount  = out.batches.size();
+	}
+}
+
+void SceneCache::save()
+{
+	if (path.empty()) {
+		return;
+	}
+
+	makeDirectories(path.substr(0, path.rfind('/')));
+
+	FileHeader header;
+	::memcpy(header.magic, Magic, sizeof(Magic));
+	header.version   = FormatVersion;
+	header.hash      = hash;
+	header.meshCount = buffers.size();
+	header.reserved  = 0;
+
+	std::vector<FileMesh> entries(buffers.size());
+	uint64_t offset = sizeof(FileHeader) + entries.size() * sizeof(FileMesh);
+
+	for (unsigned i = 0; i < buffers.size(); i++) {
+		const MeshBuffers& buffer = buffers[i];
+		FileMesh& entry = entries[i];
+
+		entry.vertexCount  = buffer.vertexCount;
+		entry.indexCount   = buffer.indexCount;
+		entry.batchCount   = buffer.batchCount;
+		entry.reserved     = 0;
+		entry.vertexOffset = offset = align(offset);
+		offset += (uint64_t)buffer.vertexCount * sizeof(cmp::PackedVertex);
+		entry.indexOffset  = offset = align(offset);
+		offset += (uint64_t)buffer.indexCount * sizeof(uint16_t);
+		entry.batchOffset  = offset = align(offset);
+		offset += (uint64_t)buffer.batchCount * sizeof(Batch);
+	}
+
+	// Write next to the final file and rename, so readers never see a partial cache.
+	std::ostringstream tmppath;
+	tmppath << path << "." << ::getpid();
+
+	std::ofstream ofs;
+	ofs.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+	ofs.open(tmppath.str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+
+	static const char padding[16] = { 0 };
+	auto write = [&](const void* data, uint64_t length, uint64_t at) {
+		ofs.write(padding, at - (uint64_t)ofs.tellp());
+		ofs.write(static_cast<const char*>(data), length);
+	};
+
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	ofs.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(FileMesh));
+
+	for (unsigned i = 0; i < buffers.size(); i++) {
+		write(buffers[i].vertices, (uint64_t)buffers[i].vertexCount * sizeof(cmp::PackedVertex), entries[i].vertexOffset);
+		write(buffers[i].indices,  (uint64_t)buffers[i].indexCount  * sizeof(uint16_t),          entries[i].indexOffset);
+		write(buffers[i].batches,  (uint64_t)buffers[i].batchCount  * sizeof(Batch),             entries[i].batchOffset);
+	}
+
+	ofs.close();
+
+	if (::rename(tmppath.str().c_str(), path.c_str()) != 0) {
+		::unlink(tmppath.str().c_str());
+		std::ostringstream msg;
+		msg << "Couldn't write \"" << path << "\": " << ::strerror(errno);
+		throw std::runtime_error(msg.str());
+	}
+}
+
+const MeshBuffers* SceneCache::find(const cmp::MeshData* mesh) const
+{
+	for (unsigned i = 0; i < meshes.size() && i < buffers.size(); i++) {
+		if (meshes[i] == mesh) {
+			return &buffers[i];
+		}
+	}
+
+	return 0;
+}
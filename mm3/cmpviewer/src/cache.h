@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cmp.h"
+
+namespace cache
+{
+	// Indexed draw of one material.
+	struct Batch
+	{
+		uint32_t material;
+		uint32_t type;     // cmp::Primitive::Type, triangle lists when built.
+		uint32_t offset;   // First index.
+		uint32_t count;
+	};
+
+	// GPU ready buffers of one mesh, converted or mapped from a cache file.
+	struct MeshBuffers
+	{
+		const cmp::PackedVertex* vertices;
+		uint32_t                 vertexCount;
+		const uint16_t*          indices;
+		uint32_t                 indexCount;
+		const Batch*             batches;
+		uint32_t                 batchCount;
+	};
+
+	// Draw calls and simulated vertex cache misses before and after merging
+	// primitives per material, from the last build().
+	struct Stats
+	{
+		Stats() : primitives(0), batches(0), triangles(0), missesBefore(0), missesAfter(0) {}
+
+		unsigned primitives;
+		unsigned batches;
+		unsigned triangles;
+		unsigned missesBefore;
+		unsigned missesAfter;
+	};
+
+	// Converted meshes of a model. Stored in the user cache directory under
+	// a hash of the CMP file and memory-mapped when opening it again.
+	class SceneCache
+	{
+		public:
+			SceneCache(const std::string& cmppath, const cmp::MeshList& meshes);
+			~SceneCache();
+
+			// Map an existing cache file, false if missing or stale.
+			bool load();
+			// Convert all meshes in memory, one vertex cache optimised
+			// triangle list per mesh and material.
+			void build();
+			// Write converted meshes to the cache file.
+			void save();
+
+			// Buffers of a mesh with data, null for references.
+			const MeshBuffers* find(const cmp::MeshData* mesh) const;
+
+			uint64_t    hash;
+			std::string path;
+			Stats       stats;
+
+		private:
+			struct Converted
+			{
+				std::vector<cmp::PackedVertex> vertices;
+				std::vector<uint16_t>          indices;
+				std::vector<Batch>             batches;
+			};
+
+			cmp::MeshList            meshes;  // Meshes with data, in file order.
+			std::vector<MeshBuffers> buffers;
+			std::vector<Converted>   converted;
+			void*                    mapping;
+			size_t                   mappingSize;
+	};
+
+	// 64 bit FNV-1a.
+	uint64_t hash(const void* data, size_t length, uint64_t seed = 0xCBF29CE484222325ULL);
+}
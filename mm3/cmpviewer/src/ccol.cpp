@@ -0,0 +1,474 @@
+#include "ccol.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <sstream>
+#include <stdexcept>
+
+using namespace ccol;
+
+const uint32_t ccol::NoHit = 0xFFFFFFFF;
+
+// Leaves are split until they hold this many triangles or splitting costs more.
+static const unsigned MaxLeafSize = 4;
+static const unsigned BinCount    = 16;
+static const unsigned StackSize   = 64; // Also limits the tree depth.
+
+// Relative SAH costs of a node traversal and a triangle test.
+static const float TraversalCost    = 1.0f;
+static const float IntersectionCost = 1.0f;
+
+class Reader
+{
+	public:
+		Reader(const char* data, size_t length) : data(data), length(length), pos(0) {}
+
+		uint32_t readCount()
+		{
+			uint32_t var;
+			::memcpy(&var, take(sizeof(var)), sizeof(var));
+			return var;
+		}
+
+		const char* readArray(uint32_t count, size_t size)
+		{
+			return take((uint64_t)count * size);
+		}
+
+		std::string readString()
+		{
+			const char* start = data + pos;
+			const char* end = static_cast<const char*>(::memchr(start, '\0', length - pos));
+			if (!end) {
+				throw std::runtime_error("Unterminated string at end of file.");
+			}
+
+			pos += end - start + 1;
+			return std::string(start, end);
+		}
+
+	private:
+		const char* take(uint64_t size)
+		{
+			if (size > length - pos) {
+				std::ostringstream msg;
+				msg << "Unexpected end of file. Expected " << size << " bytes at offset " << pos << ", got " << length - pos << ".";
+				throw std::runtime_error(msg.str());
+			}
+
+			const char* p = data + pos;
+			pos += size;
+			return p;
+		}
+
+		const char* data;
+		size_t      length;
+		size_t      pos;
+};
+
+CollisionFile* CollisionFile::readFile(std::ifstream& ifs)
+{
+	CollisionFile* file = new CollisionFile();
+
+	try {
+		ifs.seekg(0, std::ifstream::end);
+		file->buffer.resize(ifs.tellg());
+		ifs.seekg(0, std::ifstream::beg);
+		ifs.read(file->buffer.data(), file->buffer.size());
+
+		file->parseMeshes(file->buffer.data(), file->buffer.size());
+	}
+	catch (...) {
+		delete file;
+		throw;
+	}
+
+	return file;
+}
+
+CollisionFile* CollisionFile::parse(const char* data, size_t length)
+{
+	CollisionFile* file = new CollisionFile();
+
+	try {
+		file->parseMeshes(data, length);
+	}
+	catch (...) {
+		delete file;
+		throw;
+	}
+
+	return file;
+}
+
+void CollisionFile::parseMeshes(const char* data, size_t length)
+{
+	Reader reader(data, length);
+
+	uint32_t count = reader.readCount();
+
+	for (uint32_t i = 0; i < count; i++) {
+		Mesh mesh;
+		mesh.name         = reader.readString();
+		mesh.vertexCount  = reader.readCount();
+		mesh.vertices     = reader.readArray(mesh.vertexCount, sizeof(Vec3f));
+		mesh.normalCount  = reader.readCount();
+		mesh.normals      = reader.readArray(mesh.normalCount, sizeof(Vec3f));
+		mesh.unknownCount = reader.readCount();
+		mesh.unknown      = reader.readArray(mesh.unknownCount, sizeof(float));
+		mesh.indexCount   = reader.readCount();
+		mesh.indices      = reader.readArray(mesh.indexCount, sizeof(uint32_t));
+
+		meshes.push_back(mesh);
+	}
+}
+
+static inline Vec3f operator+(const Vec3f& a, const Vec3f& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+static inline Vec3f operator-(const Vec3f& a, const Vec3f& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+static inline Vec3f operator*(const Vec3f& a, float s)        { return { a.x * s, a.y * s, a.z * s }; }
+
+static inline float dot(const Vec3f& a, const Vec3f& b)  { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline Vec3f cross(const Vec3f& a, const Vec3f& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+static inline float axis(const Vec3f& v, unsigned i) { return (&v.x)[i]; }
+
+struct Bounds
+{
+	Bounds() : min({ FLT_MAX, FLT_MAX, FLT_MAX }), max({ -FLT_MAX, -FLT_MAX, -FLT_MAX }) {}
+
+	void grow(const Vec3f& p)
+	{
+		min = { std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z) };
+		max = { std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z) };
+	}
+
+	void grow(const Bounds& b)
+	{
+		min = { std::min(min.x, b.min.x), std::min(min.y, b.min.y), std::min(min.z, b.min.z) };
+		max = { std::max(max.x, b.max.x), std::max(max.y, b.max.y), std::max(max.z, b.max.z) };
+	}
+
+	float area() const
+	{
+		Vec3f e = max - min;
+		return e.x < 0.0f ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+
+	Vec3f min, max;
+};
+
+Bvh::Bvh(const Mesh& mesh)
+{
+	uint32_t triCount = mesh.indexCount / 3;
+	triangles.resize(triCount);
+
+	std::vector<Vec3f> centroids(triCount);
+
+	for (uint32_t t = 0; t < triCount; t++) {
+		uint32_t i0 = mesh.getIndex(t * 3), i1 = mesh.getIndex(t * 3 + 1), i2 = mesh.getIndex(t * 3 + 2);
+		if (i0 >= mesh.vertexCount || i1 >= mesh.vertexCount || i2 >= mesh.vertexCount) {
+			std::ostringstream msg;
+			msg << "Invalid triangle " << t << " in collision mesh \"" << mesh.name << "\". Indices must be below " << mesh.vertexCount << ", got " << i0 << ", " << i1 << ", " << i2 << ".";
+			throw std::runtime_error(msg.str());
+		}
+
+		Vec3f a = mesh.getVertex(i0), b = mesh.getVertex(i1), c = mesh.getVertex(i2);
+
+		Triangle& tri = triangles[t];
+		tri.v0 = a;
+		tri.e1 = b - a;
+		tri.e2 = c - a;
+		tri.index = t;
+
+		centroids[t] = (a + b + c) * (1.0f / 3.0f);
+	}
+
+	// At most 2n - 1 nodes, children are allocated in pairs.
+	nodes.reserve(triCount ? triCount * 2 - 1 : 1);
+	nodes.push_back(Node());
+	build(0, 0, triCount, 1, centroids);
+}
+
+static Bounds triangleBounds(const Vec3f& v0, const Vec3f& e1, const Vec3f& e2)
+{
+	Bounds b;
+	b.grow(v0);
+	b.grow(v0 + e1);
+	b.grow(v0 + e2);
+	return b;
+}
+
+void Bvh::build(unsigned node, unsigned first, unsigned count, unsigned depth, std::vector<Vec3f>& centroids)
+{
+	Bounds bounds, centroidBounds;
+	for (unsigned i = first; i < first + count; i++) {
+		bounds.grow(triangleBounds(triangles[i].v0, triangles[i].e1, triangles[i].e2));
+		centroidBounds.grow(centroids[i]);
+	}
+
+	nodes[node].min   = bounds.min;
+	nodes[node].max   = bounds.max;
+	nodes[node].first = first;
+	nodes[node].count = count;
+
+	if (count <= MaxLeafSize || depth >= StackSize) {
+		return;
+	}
+
+	// Binned SAH: sweep bin bounds from both sides for every axis.
+	float bestCost = count * IntersectionCost;
+	unsigned bestAxis = 0, bestSplit = 0;
+
+	for (unsigned a = 0; a < 3; a++) {
+		float lo = axis(centroidBounds.min, a);
+		float extent = axis(centroidBounds.max, a) - lo;
+		if (extent <= 0.0f) {
+			continue;
+		}
+
+		Bounds bins[BinCount];
+		unsigned counts[BinCount] = { 0 };
+		float scale = BinCount / extent;
+
+		for (unsigned i = first; i < first + count; i++) {
+			unsigned bin = std::min((unsigned)((axis(centroids[i], a) - lo) * scale), BinCount - 1);
+			bins[bin].grow(triangleBounds(triangles[i].v0, triangles[i].e1, triangles[i].e2));
+			counts[bin]++;
+		}
+
+		float rightArea[BinCount];
+		unsigned rightCount[BinCount];
+		Bounds right;
+		unsigned n = 0;
+		for (unsigned i = BinCount - 1; i > 0; i--) {
+			right.grow(bins[i]);
+			n += counts[i];
+			rightArea[i] = right.area();
+			rightCount[i] = n;
+		}
+
+		Bounds left;
+		n = 0;
+		float invArea = 1.0f / bounds.area();
+		for (unsigned i = 1; i < BinCount; i++) {
+			left.grow(bins[i - 1]);
+			n += counts[i - 1];
+			float cost = TraversalCost + IntersectionCost * (left.area() * n + rightArea[i] * rightCount[i]) * invArea;
+			if (n && rightCount[i] && cost < bestCost) {
+				bestCost = cost;
+				bestAxis = a;
+				bestSplit = i;
+			}
+		}
+	}
+
+	if (!bestSplit) {
+		return;
+	}
+
+	float lo = axis(centroidBounds.min, bestAxis);
+	float scale = BinCount / (axis(centroidBounds.max, bestAxis) - lo);
+
+	unsigned mid = first;
+	for (unsigned i = first; i < first + count; i++) {
+		unsigned bin = std::min((unsigned)((axis(centroids[i], bestAxis) - lo) * scale), BinCount - 1);
+		if (bin < bestSplit) {
+			std::swap(triangles[i], triangles[mid]);
+			std::swap(centroids[i], centroids[mid]);
+			mid++;
+		}
+	}
+
+	unsigned left = nodes.size();
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+
+	nodes[node].first = left;
+	nodes[node].count = 0;
+
+	build(left,     first, mid - first,         depth + 1, centroids);
+	build(left + 1, mid,   first + count - mid, depth + 1, centroids);
+}
+
+// Slab test, returns entry distance or FLT_MAX on a miss.
+static inline float intersectBox(const Vec3f& min, const Vec3f& max, const Vec3f& origin, const Vec3f& invDir, float maxDistance)
+{
+	float tx0 = (min.x - origin.x) * invDir.x, tx1 = (max.x - origin.x) * invDir.x;
+	float ty0 = (min.y - origin.y) * invDir.y, ty1 = (max.y - origin.y) * invDir.y;
+	float tz0 = (min.z - origin.z) * invDir.z, tz1 = (max.z - origin.z) * invDir.z;
+
+	float tmin = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+	float tmax = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), maxDistance));
+
+	return tmin <= tmax ? tmin : FLT_MAX;
+}
+
+void Bvh::raycast(const Ray* rays, unsigned count, RayHit* hits) const
+{
+	unsigned stack[StackSize];
+
+	for (unsigned r = 0; r < count; r++) {
+		const Ray& ray = rays[r];
+		RayHit& hit = hits[r];
+		hit.distance = ray.maxDistance;
+		hit.triangle = NoHit;
+
+		if (triangles.empty()) {
+			continue;
+		}
+
+		Vec3f invDir = { 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+
+		if (intersectBox(nodes[0].min, nodes[0].max, ray.origin, invDir, hit.distance) == FLT_MAX) {
+			continue;
+		}
+
+		unsigned top = 0;
+		stack[top++] = 0;
+
+		while (top) {
+			const Node& node = nodes[stack[--top]];
+
+			if (node.count) {
+				// Möller-Trumbore.
+				for (unsigned i = node.first; i < node.first + node.count; i++) {
+					const Triangle& tri = triangles[i];
+					Vec3f p = cross(ray.direction, tri.e2);
+					float det = dot(tri.e1, p);
+					if (det > -1e-12f && det < 1e-12f) {
+						continue;
+					}
+
+					float inv = 1.0f / det;
+					Vec3f s = ray.origin - tri.v0;
+					float u = dot(s, p) * inv;
+					if (u < 0.0f || u > 1.0f) {
+						continue;
+					}
+
+					Vec3f q = cross(s, tri.e1);
+					float v = dot(ray.direction, q) * inv;
+					if (v < 0.0f || u + v > 1.0f) {
+						continue;
+					}
+
+					float t = dot(tri.e2, q) * inv;
+					if (t >= 0.0f && t < hit.distance) {
+						hit.distance = t;
+						hit.triangle = tri.index;
+					}
+				}
+				continue;
+			}
+
+			// Visit the nearer child first so later boxes can be culled by the hit distance.
+			const Node& a = nodes[node.first];
+			const Node& b = nodes[node.first + 1];
+			float ta = intersectBox(a.min, a.max, ray.origin, invDir, hit.distance);
+			float tb = intersectBox(b.min, b.max, ray.origin, invDir, hit.distance);
+
+			unsigned near = node.first, far = node.first + 1;
+			if (tb < ta) {
+				std::swap(ta, tb);
+				std::swap(near, far);
+			}
+
+			if (tb != FLT_MAX) {
+				stack[top++] = far;
+			}
+			if (ta != FLT_MAX) {
+				stack[top++] = near;
+			}
+		}
+	}
+}
+
+// Closest point on triangle, from "Real-Time Collision Detection", Christer Ericson 2005.
+static Vec3f closestPoint(const Vec3f& p, const Vec3f& a, const Vec3f& ab, const Vec3f& ac)
+{
+	Vec3f ap = p - a;
+	float d1 = dot(ab, ap);
+	float d2 = dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		return a;
+	}
+
+	Vec3f bp = ap - ab;
+	float d3 = dot(ab, bp);
+	float d4 = dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) {
+		return a + ab;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		return a + ab * (d1 / (d1 - d3));
+	}
+
+	Vec3f cp = ap - ac;
+	float d5 = dot(ab, cp);
+	float d6 = dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) {
+		return a + ac;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		return a + ac * (d2 / (d2 - d6));
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		return a + ab + (ac - ab) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+static inline bool overlapBox(const Vec3f& min, const Vec3f& max, const Sphere& sphere)
+{
+	float dx = std::max(std::max(min.x - sphere.center.x, sphere.center.x - max.x), 0.0f);
+	float dy = std::max(std::max(min.y - sphere.center.y, sphere.center.y - max.y), 0.0f);
+	float dz = std::max(std::max(min.z - sphere.center.z, sphere.center.z - max.z), 0.0f);
+
+	return dx * dx + dy * dy + dz * dz <= sphere.radius * sphere.radius;
+}
+
+void Bvh::overlap(const Sphere* spheres, unsigned count, std::vector<SphereContact>* contacts) const
+{
+	unsigned stack[StackSize];
+
+	for (unsigned s = 0; s < count; s++) {
+		const Sphere& sphere = spheres[s];
+		float radius2 = sphere.radius * sphere.radius;
+
+		if (triangles.empty() || !overlapBox(nodes[0].min, nodes[0].max, sphere)) {
+			continue;
+		}
+
+		unsigned top = 0;
+		stack[top++] = 0;
+
+		while (top) {
+			const Node& node = nodes[stack[--top]];
+
+			if (node.count) {
+				for (unsigned i = node.first; i < node.first + node.count; i++) {
+					const Triangle& tri = triangles[i];
+					Vec3f d = closestPoint(sphere.center, tri.v0, tri.e1, tri.e2) - sphere.center;
+					if (dot(d, d) <= radius2) {
+						contacts->push_back({ s, tri.index });
+					}
+				}
+				continue;
+			}
+
+			for (unsigned child = node.first; child < node.first + 2; child++) {
+				if (overlapBox(nodes[child].min, nodes[child].max, sphere)) {
+					stack[top++] = child;
+				}
+			}
+		}
+	}
+}
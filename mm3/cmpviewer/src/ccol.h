@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ccol
+{
+	struct Vec3f
+	{
+		float x, y, z;
+	};
+
+	// Collision mesh viewing the file data. Arrays follow variable length
+	// names and may be unaligned, so elements are copied out on access.
+	class Mesh
+	{
+		public:
+			Vec3f    getVertex(uint32_t i)  const { return get<Vec3f>(vertices, i); }
+			Vec3f    getNormal(uint32_t i)  const { return get<Vec3f>(normals, i); }
+			float    getUnknown(uint32_t i) const { return get<float>(unknown, i); }
+			uint32_t getIndex(uint32_t i)   const { return get<uint32_t>(indices, i); }
+
+			std::string name;
+			uint32_t    vertexCount;
+			uint32_t    normalCount;
+			uint32_t    unknownCount; // Some property for each normal?
+			uint32_t    indexCount;   // Triangle list.
+
+		private:
+			template<class T>
+			static T get(const char* data, uint32_t i) { T var; ::memcpy(&var, data + i * sizeof(T), sizeof(T)); return var; }
+
+			const char* vertices;
+			const char* normals;
+			const char* unknown;
+			const char* indices;
+
+			friend class CollisionFile;
+	};
+
+	class CollisionFile
+	{
+		public:
+			// Read the whole stream once, meshes point into the buffer.
+			static CollisionFile* readFile(std::ifstream& ifs);
+			// Parse data in place, it must outlive the file.
+			static CollisionFile* parse(const char* data, size_t length);
+
+			// Meshes point into the buffer, a copy would point into this one.
+			CollisionFile(const CollisionFile&) = delete;
+			CollisionFile& operator=(const CollisionFile&) = delete;
+
+			std::vector<Mesh> meshes;
+
+		private:
+			CollisionFile() {}
+			void parseMeshes(const char* data, size_t length);
+
+			std::vector<char> buffer;
+	};
+
+	struct Ray
+	{
+		Vec3f origin;
+		Vec3f direction;
+		float maxDistance;
+	};
+
+	struct RayHit
+	{
+		float    distance;  // maxDistance of the ray on a miss.
+		uint32_t triangle;  // NoHit on a miss.
+	};
+
+	struct Sphere
+	{
+		Vec3f center;
+		float radius;
+	};
+
+	struct SphereContact
+	{
+		uint32_t sphere;
+		uint32_t triangle;
+	};
+
+	extern const uint32_t NoHit;
+
+	// Bounding volume hierarchy over the triangles of a mesh, split by the
+	// surface area heuristic.
+	class Bvh
+	{
+		public:
+			Bvh(const Mesh& mesh);
+
+			// Closest hit per ray.
+			void raycast(const Ray* rays, unsigned count, RayHit* hits) const;
+			// All triangles touching each sphere, appended to contacts.
+			void overlap(const Sphere* spheres, unsigned count, std::vector<SphereContact>* contacts) const;
+
+			unsigned getNodeCount() const     { return nodes.size(); }
+			unsigned getTriangleCount() const { return triangles.size(); }
+
+		private:
+			struct Node
+			{
+				Vec3f    min;
+				uint32_t first; // Left child, or first triangle of a leaf.
+				Vec3f    max;
+				uint32_t count; // Triangles in a leaf, 0 for inner nodes.
+			};
+
+			// Precomputed for ray intersection.
+			struct Triangle
+			{
+				Vec3f    v0, e1, e2;
+				uint32_t index; // Triangle number in the mesh.
+			};
+
+			void build(unsigned node, unsigned first, unsigned count, unsigned depth, std::vector<Vec3f>& centroids);
+
+			std::vector<Node>     nodes;
+			std::vector<Triangle> triangles;
+	};
+}
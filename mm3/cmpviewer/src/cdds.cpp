@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <osg/Image>
+#include <osg/Texture>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <osgDB/ReaderWriter>
+#include <osgDB/Registry>
+
+#include "decdds.h"
+
+// Reads the game's .cdds textures directly. The stream is decoded in memory
+// and DXT data is handed to OSG as is, to be uploaded compressed.
+class ReaderWriterCDDS : public osgDB::ReaderWriter
+{
+	public:
+		ReaderWriterCDDS()
+		{
+			supportsExtension("cdds", "Midtown Madness 3 compressed DDS");
+			supportsOption("dds_flip", "Flip the image vertically");
+		}
+
+		virtual const char* className() const
+		{
+			return "Midtown Madness 3 CDDS image reader";
+		}
+
+		virtual ReadResult readImage(const std::string& file, const Options* options) const
+		{
+			if (!acceptsExtension(osgDB::getLowerCaseFileExtension(file))) {
+				return ReadResult::FILE_NOT_HANDLED;
+			}
+
+			std::string path = osgDB::findDataFile(file, options);
+			if (path.empty()) {
+				return ReadResult::FILE_NOT_FOUND;
+			}
+
+			std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary);
+			if (!ifs) {
+				return ReadResult::ERROR_IN_READING_FILE;
+			}
+
+			ReadResult result = readImage(ifs, options);
+			if (result.validImage()) {
+				result.getImage()->setFileName(file);
+			}
+
+			return result;
+		}
+
+		virtual ReadResult readImage(std::istream& fin, const Options* options) const
+		{
+			std::vector<uint8_t> src((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+			// Cube maps and volumes aren't 2D textures, take the first face.
+			decdds_info_t info;
+			if (decdds_peek_part(src.data(), src.size(), 1, 0, &info) != 0 || (info.hdr.caps.caps2 & DECDDS_CAP_VOLUME)) {
+				return ReadResult::FILE_NOT_HANDLED;
+			}
+
+			const decdds_ddshdr_t& hdr = info.hdr;
+			GLint internalFormat;
+			GLenum pixelFormat, dataType = GL_UNSIGNED_BYTE;
+			unsigned blockSize = 0;
+
+			switch (hdr.pxfmt.fourcc) {
+				case DECDDS_FMT_DXT1:
+					internalFormat = pixelFormat = (hdr.pxfmt.flags & DECDDS_FLG_ALPHA) ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+					blockSize = 8;
+					break;
+
+				case DECDDS_FMT_DXT2:
+				case DECDDS_FMT_DXT3:
+					internalFormat = pixelFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+					blockSize = 16;
+					break;
+
+				case DECDDS_FMT_DXT4:
+				case DECDDS_FMT_DXT5:
+					internalFormat = pixelFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+					blockSize = 16;
+					break;
+
+				default:
+					if (!rgbFormat(hdr, internalFormat, pixelFormat, dataType)) {
+						return ReadResult::FILE_NOT_HANDLED;
+					}
+					break;
+			}
+
+			// Decoded in place, then the header is dropped so the image owns the allocation.
+			unsigned char* data = new unsigned char[info.dstlen];
+			decdds_ctx_t ctx;
+
+			if (decdds_decode_part(&ctx, src.data(), src.size(), 1, 0, data, info.dstlen, 0, 0) != 0) {
+				delete[] data;
+				return ReadResult::ERROR_IN_READING_FILE;
+			}
+
+			::memmove(data, data + sizeof(decdds_ddshdr_t), info.imglen);
+
+			// Offsets of the mips after the first.
+			osg::Image::MipmapDataType mipmaps;
+			unsigned offset = 0;
+
+			for (unsigned mip = 0; mip < info.mips; mip++) {
+				unsigned width  = std::max(hdr.width  >> mip, 1u);
+				unsigned height = std::max(hdr.height >> mip, 1u);
+
+				if (mip) {
+					mipmaps.push_back(offset);
+				}
+
+				offset += blockSize ? ((width + 3) / 4) * ((height + 3) / 4) * blockSize : width * height * hdr.pxfmt.rgbbits / 8;
+			}
+
+			osg::ref_ptr<osg::Image> image = new osg::Image();
+			image->setImage(hdr.width, hdr.height, 1, internalFormat, pixelFormat, dataType, data, osg::Image::USE_NEW_DELETE);
+			image->setMipmapLevels(mipmaps);
+
+			if (options && options->getOptionString().find("dds_flip") != std::string::npos) {
+				image->flipVertical();
+			}
+
+			return image.release();
+		}
+
+	private:
+		// Uncompressed layouts OpenGL takes without conversion.
+		static bool rgbFormat(const decdds_ddshdr_t& hdr, GLint& internalFormat, GLenum& pixelFormat, GLenum& dataType)
+		{
+			bool alpha = (hdr.pxfmt.flags & DECDDS_FLG_ALPHA) && hdr.pxfmt.amask;
+
+			switch (hdr.pxfmt.rgbbits) {
+				case 32:
+					internalFormat = alpha ? GL_RGBA : GL_RGB;
+					pixelFormat = hdr.pxfmt.rmask == 0x000000FF ? GL_RGBA : GL_BGRA;
+					return true;
+
+				case 24:
+					internalFormat = GL_RGB;
+					pixelFormat = hdr.pxfmt.rmask == 0x000000FF ? GL_RGB : GL_BGR;
+					return true;
+
+				case 16:
+					if (hdr.pxfmt.rmask == 0xF800 && !alpha) {
+						internalFormat = pixelFormat = GL_RGB;
+						dataType = GL_UNSIGNED_SHORT_5_6_5;
+						return true;
+					}
+					if (hdr.pxfmt.rmask == 0x7C00) {
+						internalFormat = alpha ? GL_RGBA : GL_RGB;
+						pixelFormat = GL_BGRA;
+						dataType = GL_UNSIGNED_SHORT_1_5_5_5_REV;
+						return true;
+					}
+					if (hdr.pxfmt.rmask == 0x0F00) {
+						internalFormat = alpha ? GL_RGBA : GL_RGB;
+						pixelFormat = GL_BGRA;
+						dataType = GL_UNSIGNED_SHORT_4_4_4_4_REV;
+						return true;
+					}
+					return false;
+
+				default:
+					return false;
+			}
+		}
+};
+
+REGISTER_OSGPLUGIN(cdds, ReaderWriterCDDS)
@@ -3,6 +3,10 @@
 #include <sstream>
 #include <stdexcept>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace cmp;
 
 const int cmp::MaxMaterials   = 11;
@@ -450,6 +454,156 @@ void MeshNode::read(std::ifstream& ifs)
 	}
 }
 
+// Vertex words: 0 position, 1 normal, 2 uvs, 3 ids/v1, 4 deformation, 5 intensities.
+static const unsigned VertexWords = sizeof(Vertex) / sizeof(uint32_t);
+
+// Sign-extended 11:11:10 bitfields and unsigned bytes from a vertex word.
+static inline int      lo11(uint32_t w)               { return (int32_t)(w << 21) >> 21; }
+static inline int      mid11(uint32_t w)              { return (int32_t)(w << 10) >> 21; }
+static inline int      hi10(uint32_t w)               { return (int32_t)w >> 22; }
+static inline unsigned byteOf(uint32_t w, unsigned n) { return (w >> (n * 8)) & 0xFF; }
+
+static std::vector<uint8_t> idTable(int divisor)
+{
+	std::vector<uint8_t> table(0x100);
+	for (unsigned i = 0; i < table.size(); i++) {
+		table[i] = i / divisor;
+	}
+
+	return table;
+}
+
+// Id fields are stored premultiplied, divide through lookup tables instead of per vertex.
+static const std::vector<uint8_t> materialIds   = idTable(MaxMaterials);
+static const std::vector<uint8_t> matrixIds     = idTable(MaxMatrices);
+static const std::vector<uint8_t> demolitionIds = idTable(MaxDemolitions);
+
+#ifdef __SSE2__
+// Transpose four 6-word vertices into one register per word.
+static inline void transposeVertices(const uint32_t* w, __m128i* out)
+{
+	const float* f = reinterpret_cast<const float*>(w);
+	__m128 l0 = _mm_loadu_ps(f),      l1 = _mm_loadu_ps(f + 4),  l2 = _mm_loadu_ps(f + 8);
+	__m128 l3 = _mm_loadu_ps(f + 12), l4 = _mm_loadu_ps(f + 16), l5 = _mm_loadu_ps(f + 20);
+
+	__m128 w0 = l0;
+	__m128 w1 = _mm_shuffle_ps(l1, l2, _MM_SHUFFLE(1, 0, 3, 2));
+	__m128 w2 = l3;
+	__m128 w3 = _mm_shuffle_ps(l4, l5, _MM_SHUFFLE(1, 0, 3, 2));
+	_MM_TRANSPOSE4_PS(w0, w1, w2, w3);
+
+	__m128 e = _mm_shuffle_ps(l1, l2, _MM_SHUFFLE(3, 2, 1, 0));
+	__m128 g = _mm_shuffle_ps(l4, l5, _MM_SHUFFLE(3, 2, 1, 0));
+
+	out[0] = _mm_castps_si128(w0);
+	out[1] = _mm_castps_si128(w1);
+	out[2] = _mm_castps_si128(w2);
+	out[3] = _mm_castps_si128(w3);
+	out[4] = _mm_castps_si128(_mm_shuffle_ps(e, g, _MM_SHUFFLE(2, 0, 2, 0)));
+	out[5] = _mm_castps_si128(_mm_shuffle_ps(e, g, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+// Four 32 bit fields of four vertices to 16 bit fields per vertex, vertices
+// 0-1 in lo and 2-3 in hi.
+static inline void interleave4(__m128i a, __m128i b, __m128i c, __m128i d, __m128i* lo, __m128i* hi)
+{
+	__m128i ab = _mm_packs_epi32(a, b);
+	__m128i cd = _mm_packs_epi32(c, d);
+	__m128i ac = _mm_unpacklo_epi16(ab, cd);
+	__m128i bd = _mm_unpackhi_epi16(ab, cd);
+
+	*lo = _mm_unpacklo_epi16(ac, bd);
+	*hi = _mm_unpackhi_epi16(ac, bd);
+}
+#endif
+
+void cmp::packVertices(const Vertex* vertices, unsigned count, PackedVertex* out)
+{
+	const uint32_t* words = reinterpret_cast<const uint32_t*>(vertices);
+
+	unsigned i = 0;
+
+#ifdef __SSE2__
+	const __m128i zero     = _mm_setzero_si128();
+	const __m128i byteMask = _mm_set1_epi32(0xFF);
+
+	for (; i + 4 <= count; i += 4, out += 4) {
+		const uint32_t* w = words + i * VertexWords;
+
+		__m128i v[VertexWords];
+		transposeVertices(w, v);
+
+#define CMP_LO11(v)    _mm_srai_epi32(_mm_slli_epi32(v, 21), 21)
+#define CMP_MID11(v)   _mm_srai_epi32(_mm_slli_epi32(v, 10), 21)
+#define CMP_HI10X2(v)  _mm_slli_epi32(_mm_srai_epi32(v, 22), 1)
+#define CMP_BYTE(v, n) _mm_and_si128(_mm_srli_epi32(v, (n) * 8), byteMask)
+
+		// 10 bit fields are doubled to share the 1/1024 scale of the 11 bit fields.
+		__m128i pos01, pos23, nrm01, nrm23, uvs01, uvs23;
+		interleave4(CMP_LO11(v[0]), CMP_MID11(v[0]), _mm_sub_epi32(zero, CMP_HI10X2(v[0])), zero, &pos01, &pos23);
+		interleave4(CMP_LO11(v[1]), CMP_MID11(v[1]), _mm_sub_epi32(zero, CMP_HI10X2(v[1])), zero, &nrm01, &nrm23);
+		interleave4(CMP_LO11(v[2]), CMP_MID11(v[2]), CMP_HI10X2(v[2]), _mm_slli_epi32(CMP_BYTE(v[3], 2), 2), &uvs01, &uvs23);
+
+#undef CMP_LO11
+#undef CMP_MID11
+#undef CMP_HI10X2
+#undef CMP_BYTE
+
+		// Intensities are bytes 2, 3, 0, 1 of the last word, ids go through the tables.
+		__m128i lum = _mm_or_si128(_mm_srli_epi32(v[5], 16), _mm_slli_epi32(v[5], 16));
+
+		uint32_t idWords[4];
+		for (unsigned j = 0; j < 4; j++) {
+			uint32_t idWord = w[j * VertexWords + 3];
+			idWords[j] = materialIds[byteOf(idWord, 0)] | matrixIds[byteOf(idWord, 1)] << 8 | demolitionIds[byteOf(idWord, 3)] << 16;
+		}
+
+		__m128i ids  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(idWords));
+		__m128i ex01 = _mm_unpacklo_epi32(lum, ids);
+		__m128i ex23 = _mm_unpackhi_epi32(lum, ids);
+
+		__m128i* o = reinterpret_cast<__m128i*>(out);
+		_mm_storeu_si128(o + 0, _mm_unpacklo_epi64(pos01, nrm01));
+		_mm_storeu_si128(o + 1, _mm_unpacklo_epi64(uvs01, ex01));
+		_mm_storeu_si128(o + 2, _mm_unpackhi_epi64(pos01, nrm01));
+		_mm_storeu_si128(o + 3, _mm_unpackhi_epi64(uvs01, ex01));
+		_mm_storeu_si128(o + 4, _mm_unpacklo_epi64(pos23, nrm23));
+		_mm_storeu_si128(o + 5, _mm_unpacklo_epi64(uvs23, ex23));
+		_mm_storeu_si128(o + 6, _mm_unpackhi_epi64(pos23, nrm23));
+		_mm_storeu_si128(o + 7, _mm_unpackhi_epi64(uvs23, ex23));
+	}
+#endif
+
+	// Scalar tail, or everything when SSE2 is unavailable.
+	for (; i < count; i++, out++) {
+		const uint32_t* w = words + i * VertexWords;
+
+		// 10 bit fields are doubled to share the 1/1024 scale of the 11 bit fields.
+		out->position[0] =  lo11(w[0]);
+		out->position[1] =  mid11(w[0]);
+		out->position[2] = -hi10(w[0]) * 2;
+		out->position[3] =  0;
+		out->normal[0]   =  lo11(w[1]);
+		out->normal[1]   =  mid11(w[1]);
+		out->normal[2]   = -hi10(w[1]) * 2;
+		out->normal[3]   =  0;
+		out->uvs[0]      =  lo11(w[2]);
+		out->uvs[1]      =  mid11(w[2]);
+		out->uvs[2]      =  hi10(w[2]) * 2;
+		out->uvs[3]      =  byteOf(w[3], 2) * 4;
+
+		out->intensities[0] = byteOf(w[5], 2);
+		out->intensities[1] = byteOf(w[5], 3);
+		out->intensities[2] = byteOf(w[5], 0);
+		out->intensities[3] = byteOf(w[5], 1);
+
+		out->ids[0] = materialIds[byteOf(w[3], 0)];
+		out->ids[1] = matrixIds[byteOf(w[3], 1)];
+		out->ids[2] = demolitionIds[byteOf(w[3], 3)];
+		out->ids[3] = 0;
+	}
+}
+
 std::ostream& operator<<(std::ostream& lhs, cmp::Node::Type type)
 {
 	switch (type) {
@@ -63,6 +63,8 @@ namespace cmp
 		float    getSpecularPower()     { return (float)specularPower     / 256.0f; }
 	};
 
+	static_assert(sizeof(Vertex) == 24, "Packed vertex must be 24 bytes");
+
 	struct  Vec3f
 	{
 		float x, y, z;
@@ -82,6 +84,23 @@ namespace cmp
 		uint8_t b, g, r, a;
 	};
 
+	// Interleaved vertex for a single GPU buffer. Attributes keep the fixed
+	// point values of Vertex with a common 1/1024 scale, positions in units
+	// of the mesh AABB extent. Z axes are flipped.
+	struct PackedVertex
+	{
+		int16_t position[4];    // x, y, z, 0
+		int16_t normal[4];      // nx, ny, nz, 0
+		int16_t uvs[4];         // u0, v0, u1, v1
+		uint8_t intensities[4]; // Ambient, specular, specular power, env map. 1/256 scale.
+		uint8_t ids[4];         // Material, matrix, demolition, 0
+	};
+
+	static_assert(sizeof(PackedVertex) == 32, "Interleaved vertex must be 32 bytes");
+
+	// Repack vertices for rendering.
+	void packVertices(const Vertex* vertices, unsigned count, PackedVertex* out);
+
 	struct Mat4x3
 	{
 		float a[4][3];
@@ -294,6 +313,7 @@ namespace cmp
 			MeshData(Version version);
 			virtual ~MeshData();
 			virtual void read(std::ifstream& ifs);
+			void packVertices(PackedVertex* out) const { cmp::packVertices(vertices, vertexCount2, out); }
 
 			uint32_t    length;
 			float       unknown0;
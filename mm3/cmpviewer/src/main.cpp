@@ -1,9 +1,17 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cfloat>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <thread>
 #include <osg/BlendFunc>
 #include <osg/CullFace>
+#include <osg/Drawable>
 #include <osg/FrontFace>
+#include <osg/LOD>
 #include <osg/Material>
 #include <osg/MatrixTransform>
 #include <osg/Texture2D>
@@ -14,6 +22,7 @@
 #include <osgGA/TrackballManipulator>
 #include <osgViewer/Viewer>
 
+#include "cache.h"
 #include "cmp.h"
 #include "omb.h"
 
@@ -25,19 +34,32 @@
 #define CULL_INTERIOR   1 <<  5
 #define CULL_LOOSEPARTS 1 <<  6
 #define CULL_OTHER      1 <<  7
-#define CULL_LOD1       1 <<  8
-#define CULL_LOD2       1 <<  9
-#define CULL_LOD3       1 << 10
 
+// LOD switch distances in multiples of the mesh bounding radius.
+#define LOD_RANGE_FACTOR 20.0f
+
+#define ATTRIB_NO_POSITION     0
+#define ATTRIB_NM_POSITION     "position"
+#define ATTRIB_NO_NORMAL       2
+#define ATTRIB_NM_NORMAL       "normal"
+#define ATTRIB_NO_UVS          8
+#define ATTRIB_NM_UVS          "uvs"
 #define ATTRIB_NO_INTENSITIES  10
 #define ATTRIB_NM_INTENSITIES  "intensities"
 #define ATTRIB_NO_IDS          11
 #define ATTRIB_NM_IDS          "ids"
 #define UNIFORM_MATRICES       "matrices"
+#define UNIFORM_MESH_SCALE     "meshScale"
+#define UNIFORM_PALETTE        "palette"
+#define UNIFORM_MULTI_MESH     "isMultiMesh"
 #define UNIFORM_TEX_MODE       "texMode"
 #define UNIFORM_DEMOLITION_MAP "demolitionMap"
 
 typedef std::vector<osg::ref_ptr<osg::StateSet>> StateSetList;
+typedef std::vector<omb::MaterialSet*> MaterialSetList;
+
+// Diffuse colors indexed by vertex material id.
+const int PaletteSize = 0x100 / cmp::MaxMaterials + 1;
 
 const char* vertexShader = R"(
 #version 330
@@ -48,12 +70,14 @@ uniform mat4 osg_ViewMatrix;
 uniform mat4 osg_ViewMatrixInverse;
 uniform mat3 osg_NormalMatrix;
 uniform mat4 matrices[37];
-
-in vec4 osg_Vertex;
-in vec3 osg_Normal;
-in vec4 osg_Color;
-in vec2 osg_MultiTexCoord0;
-in vec2 osg_MultiTexCoord1;
+uniform vec3 meshScale;
+uniform vec4 palette[24];
+uniform bool isMultiMesh;
+
+// Fixed point attributes from cmp::PackedVertex.
+in vec3 position;
+in vec3 normal;
+in vec4 uvs;
 in vec4 intensities;
 in vec4 ids;
 
@@ -71,28 +95,24 @@ out float envMapIntensity;
 
 void main()
 {
-	vec4 vert;
-	vec3 norm;
-	if (bool(ids.w)) {
-		vert = matrices[int(ids.y)] * osg_Vertex;
-		norm = transpose(inverse(mat3(matrices[int(ids.y)]))) * osg_Normal;
-	}
-	else {
-		vert = osg_Vertex;
-		norm = osg_Normal;
+	vec4 vert = vec4(position * meshScale, 1);
+	vec3 norm = normal / 1024.0;
+	if (isMultiMesh) {
+		vert = matrices[int(ids.y)] * vert;
+		norm = transpose(inverse(mat3(matrices[int(ids.y)]))) * norm;
 	}
 
 	N = osg_NormalMatrix * norm;
 	E = -(osg_ModelViewMatrix * vert).xyz;
 	L = (osg_ViewMatrix * vec4(osg_ViewMatrixInverse[3].xyz, 1)).xyz + E;
 
-	vcolor = osg_Color;
-	uv0 = osg_MultiTexCoord0;
-	uv1 = osg_MultiTexCoord1;
-	ambientIntensity  = intensities.x;
-	specularIntensity = intensities.y;
-	specularPower     = intensities.z;
-	envMapIntensity   = intensities.w;
+	vcolor = palette[int(ids.x)];
+	uv0 = uvs.xy / 1024.0;
+	uv1 = uvs.zw / 1024.0;
+	ambientIntensity  = intensities.x / 256.0;
+	specularIntensity = intensities.y / 256.0;
+	specularPower     = intensities.z / 256.0;
+	envMapIntensity   = intensities.w / 256.0;
 
 	gl_Position = osg_ModelViewProjectionMatrix * vert;
 }
@@ -269,7 +289,89 @@ void printNode(cmp::Node* node, omb::MaterialSet* materials)
 	}
 }
 
-StateSetList generateOSGMaterials(omb::MaterialSet* materials, std::string basepath, osg::ref_ptr<osg::Uniform> matricesUniform)
+// Textures by resolved path, shared between materials and material sets.
+class TextureCache
+{
+	public:
+		TextureCache(const std::string& basepath) : basepath(basepath) {}
+
+		// Resolve and decode all textures not already cached, in parallel.
+		void load(const std::vector<std::string>& names)
+		{
+			std::vector<std::string> pending;
+
+			for (const std::string& name : names) {
+				if (paths.count(name)) {
+					continue;
+				}
+
+				std::string path = osgDB::findFileInDirectory(name, basepath, osgDB::CaseSensitivity::CASE_INSENSITIVE);
+
+				// Fall back to the game's compressed texture, read by the cdds plugin.
+				if (path == "" && osgDB::getLowerCaseFileExtension(name) == "dds") {
+					path = osgDB::findFileInDirectory(osgDB::getNameLessExtension(name) + ".cdds", basepath, osgDB::CaseSensitivity::CASE_INSENSITIVE);
+				}
+
+				paths[name] = path;
+
+				if (path != "" && !textures.count(path)) {
+					textures[path] = 0;
+					pending.push_back(path);
+				}
+			}
+
+			if (pending.empty()) {
+				return;
+			}
+
+			std::vector<osg::ref_ptr<osg::Image>> images(pending.size());
+			std::atomic<unsigned> next(0);
+
+			auto worker = [&]() {
+				for (unsigned i = next++; i < pending.size(); i = next++) {
+					images[i] = osgDB::readImageFile(pending[i]);
+				}
+			};
+
+			unsigned threadCount = std::min<unsigned>(std::max(1u, std::thread::hardware_concurrency()), pending.size());
+			std::vector<std::thread> threads;
+			for (unsigned i = 1; i < threadCount; i++) {
+				threads.push_back(std::thread(worker));
+			}
+			worker();
+			for (std::thread& thread : threads) {
+				thread.join();
+			}
+
+			for (unsigned i = 0; i < pending.size(); i++) {
+				if (images[i]) {
+					osg::ref_ptr<osg::Texture2D> tex = new osg::Texture2D();
+					tex->setImage(images[i].get());
+					textures[pending[i]] = tex;
+				}
+			}
+		}
+
+		// Texture by name as passed to load(), null if missing or unreadable.
+		osg::Texture2D* get(const std::string& name)
+		{
+			std::map<std::string, std::string>::iterator path = paths.find(name);
+			if (path == paths.end() || path->second == "") {
+				return 0;
+			}
+
+			return textures[path->second].get();
+		}
+
+	private:
+		std::string basepath;
+		std::map<std::string, std::string> paths;
+		std::map<std::string, osg::ref_ptr<osg::Texture2D>> textures;
+};
+
+// State sets for as many materials as the largest material set has. The
+// material specific parts are filled in by MaterialSets::select().
+StateSetList generateOSGMaterials(const MaterialSetList& sets, std::string basepath, TextureCache* textures, osg::ref_ptr<osg::Uniform> matricesUniform, osg::ref_ptr<osg::Uniform> paletteUniform)
 {
 	StateSetList states;
 
@@ -283,64 +385,54 @@ StateSetList generateOSGMaterials(omb::MaterialSet* materials, std::string basep
 	program->setName("program");
 	program->addShader(vert.get());
 	program->addShader(frag.get());
+	program->addBindAttribLocation(ATTRIB_NM_POSITION, ATTRIB_NO_POSITION);
+	program->addBindAttribLocation(ATTRIB_NM_NORMAL, ATTRIB_NO_NORMAL);
+	program->addBindAttribLocation(ATTRIB_NM_UVS, ATTRIB_NO_UVS);
 	program->addBindAttribLocation(ATTRIB_NM_INTENSITIES, ATTRIB_NO_INTENSITIES);
 	program->addBindAttribLocation(ATTRIB_NM_IDS, ATTRIB_NO_IDS);
 
-	// Load demolition texture.
-	osg::ref_ptr<osg::Uniform> demolitionUniform = 0;
-	osg::ref_ptr<osg::Texture2D> demolitionTex = 0;
+	// Decode the textures of all sets up front.
+	const std::string demolitionName = "../demolition_texture.dds";
+	unsigned materialCount = 0;
 	{
-		std::string texpath = osgDB::findFileInDirectory("../demolition_texture.dds", basepath, osgDB::CaseSensitivity::CASE_INSENSITIVE);
-
-		osg::ref_ptr<osg::Image> img = 0;
+		std::vector<std::string> names(1, demolitionName);
+		for (omb::MaterialSet* materials : sets) {
+			for (omb::Material mat : materials->materials) {
+				if (mat.texture != "No") {
+					names.push_back(osgDB::getSimpleFileName(mat.texture));
+				}
+			}
 
-		if (texpath != "") {
-			img = osgDB::readImageFile(texpath);
+			materialCount = std::max<unsigned>(materialCount, materials->materials.size());
 		}
 
-		if (!img) {
-			std::cerr << "Error: Couldn't load demolition texture \"" << basepath << osgDB::getNativePathSeparator() << ".." << osgDB::getNativePathSeparator() << "demolition_texture.dds\"" << std::endl;
-		}
-		else {
-			demolitionTex = new osg::Texture2D();
-			demolitionTex->setImage(img.get());
-			demolitionUniform = new osg::Uniform(osg::Uniform::SAMPLER_2D, UNIFORM_DEMOLITION_MAP); 
-			demolitionUniform->set(1);
-		}
+		textures->load(names);
+	}
+
+	// Demolition texture.
+	osg::ref_ptr<osg::Uniform> demolitionUniform = 0;
+	osg::ref_ptr<osg::Texture2D> demolitionTex = textures->get(demolitionName);
+	if (!demolitionTex) {
+		std::cerr << "Error: Couldn't load demolition texture \"" << basepath << osgDB::getNativePathSeparator() << ".." << osgDB::getNativePathSeparator() << "demolition_texture.dds\"" << std::endl;
+	}
+	else {
+		demolitionUniform = new osg::Uniform(osg::Uniform::SAMPLER_2D, UNIFORM_DEMOLITION_MAP); 
+		demolitionUniform->set(1);
 	}
 
-	for (omb::Material mat : materials->materials) {
+	for (unsigned i = 0; i < materialCount; i++) {
 		osg::ref_ptr<osg::StateSet> state = new osg::StateSet();
 		osg::ref_ptr<osg::Material> material = new osg::Material();
 
-		material->setName(mat.name);
+		// Modified when switching material sets.
+		state->setDataVariance(osg::Object::DYNAMIC);
+		material->setDataVariance(osg::Object::DYNAMIC);
 
-		material->setDiffuse(osg::Material::FRONT, osg::Vec4(mat.color.r / 255.0f, mat.color.g / 255.0f, mat.color.b / 255.0f, mat.color.a / 255.0f));
 		state->setAttributeAndModes(program.get(), osg::StateAttribute::ON);
 
-		if (mat.texture == "No") {
-			state->addUniform(new osg::Uniform(UNIFORM_TEX_MODE, -1));
-		}
-		else {
-			std::string texpath = osgDB::findFileInDirectory(osgDB::getSimpleFileName(mat.texture), basepath, osgDB::CaseSensitivity::CASE_INSENSITIVE);
-
-			osg::ref_ptr<osg::Image> img = 0;
-
-			if (texpath != "") {
-				img = osgDB::readImageFile(texpath);
-			}
-
-			if (!img) {
-				std::cerr << "Error: Couldn't load texture \"" << basepath << osgDB::getNativePathSeparator() << osgDB::getSimpleFileName(mat.texture) << "\"" << std::endl;
-				state->addUniform(new osg::Uniform(UNIFORM_TEX_MODE, -1));
-			}
-			else {
-				osg::ref_ptr<osg::Texture2D> tex = new osg::Texture2D();
-				tex->setImage(img.get());
-				state->setTextureAttributeAndModes(0, tex.get(), osg::StateAttribute::ON);
-				state->addUniform(new osg::Uniform(UNIFORM_TEX_MODE, (int)mat.mode));
-			}
-		}
+		osg::ref_ptr<osg::Uniform> texMode = new osg::Uniform(UNIFORM_TEX_MODE, -1);
+		texMode->setDataVariance(osg::Object::DYNAMIC);
+		state->addUniform(texMode.get());
 
 		if (demolitionTex) {
 			state->setTextureAttributeAndModes(1, demolitionTex.get(), osg::StateAttribute::ON);
@@ -350,16 +442,8 @@ StateSetList generateOSGMaterials(omb::MaterialSet* materials, std::string basep
 			std::cerr << "Demolition texture loading failed" << std::endl;
 		}
 
-		if (mat.mode == omb::TexMode::Transparency || mat.color.a != 0xFF) {
-			osg::ref_ptr<osg::BlendFunc> blend = new osg::BlendFunc(osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE_MINUS_SRC_ALPHA);
-			state->setAttributeAndModes(blend.get(), osg::StateAttribute::ON);
-			state->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
-		}
-		else {
-			state->setMode(GL_BLEND, osg::StateAttribute::OFF);
-		}
-
 		state->addUniform(matricesUniform.get());
+		state->addUniform(paletteUniform.get());
 
 		state->setAttributeAndModes(material.get(), osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE);
 
@@ -369,6 +453,101 @@ StateSetList generateOSGMaterials(omb::MaterialSet* materials, std::string basep
 	return states;
 }
 
+// All material sets of a model, resolved into one table so a set can be
+// switched at runtime by updating state sets and the palette only.
+class MaterialSets
+{
+	public:
+		MaterialSets(const MaterialSetList& sets, const std::vector<std::string>& names, std::string basepath, TextureCache* textures, StateSetList* states, osg::Uniform* paletteUniform)
+			: names(names), states(states), paletteUniform(paletteUniform), blend(new osg::BlendFunc(osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE_MINUS_SRC_ALPHA)), current(0)
+		{
+			entries.resize(sets.size() * states->size());
+
+			for (unsigned set = 0; set < sets.size(); set++) {
+				for (unsigned i = 0; i < sets[set]->materials.size(); i++) {
+					const omb::Material& mat = sets[set]->materials[i];
+					Entry& entry = entries[set * states->size() + i];
+
+					entry.name = mat.name;
+					entry.color = osg::Vec4(mat.color.r / 255.0f, mat.color.g / 255.0f, mat.color.b / 255.0f, mat.color.a / 255.0f);
+					entry.isTransparent = mat.mode == omb::TexMode::Transparency || mat.color.a != 0xFF;
+
+					if (mat.texture != "No") {
+						entry.texture = textures->get(osgDB::getSimpleFileName(mat.texture));
+
+						if (!entry.texture) {
+							std::cerr << "Error: Couldn't load texture \"" << basepath << osgDB::getNativePathSeparator() << osgDB::getSimpleFileName(mat.texture) << "\"" << std::endl;
+						}
+						else {
+							entry.texMode = mat.mode;
+						}
+					}
+				}
+			}
+		}
+
+		unsigned size() const { return names.size(); }
+		unsigned getCurrent() const { return current; }
+
+		void select(unsigned set)
+		{
+			current = set;
+
+			for (unsigned i = 0; i < states->size(); i++) {
+				const Entry& entry = entries[set * states->size() + i];
+				osg::StateSet* state = states->at(i).get();
+
+				osg::Material* material = static_cast<osg::Material*>(state->getAttribute(osg::StateAttribute::MATERIAL));
+				material->setName(entry.name);
+				material->setDiffuse(osg::Material::FRONT, entry.color);
+
+				if ((int)i < PaletteSize) {
+					paletteUniform->setElement(i, entry.color);
+				}
+
+				if (entry.texture) {
+					state->setTextureAttributeAndModes(0, entry.texture.get(), osg::StateAttribute::ON);
+				}
+				else {
+					state->removeTextureAttribute(0, osg::StateAttribute::TEXTURE);
+				}
+				state->getUniform(UNIFORM_TEX_MODE)->set(entry.texMode);
+
+				if (entry.isTransparent) {
+					state->setAttributeAndModes(blend.get(), osg::StateAttribute::ON);
+					state->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+				}
+				else {
+					state->removeAttribute(osg::StateAttribute::BLENDFUNC);
+					state->setMode(GL_BLEND, osg::StateAttribute::OFF);
+					state->setRenderingHint(osg::StateSet::DEFAULT_BIN);
+				}
+			}
+		}
+
+		const std::string& getName(unsigned set) const { return names.at(set); }
+
+	private:
+		// Material of a set, missing materials are solid black.
+		struct Entry
+		{
+			Entry() : texMode(-1), isTransparent(false) {}
+
+			std::string                  name;
+			osg::Vec4                    color;
+			osg::ref_ptr<osg::Texture2D> texture;
+			int                          texMode;
+			bool                         isTransparent;
+		};
+
+		std::vector<std::string>     names;
+		std::vector<Entry>           entries; // Set major.
+		StateSetList*                states;
+		osg::ref_ptr<osg::Uniform>   paletteUniform;
+		osg::ref_ptr<osg::BlendFunc> blend;
+		unsigned                     current;
+};
+
 osg::ref_ptr<osg::Geode> drawBoundBox(cmp::BoundBox* aabb, osg::Node::NodeMask mask)
 {
 	osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array();
@@ -424,137 +603,196 @@ osg::ref_ptr<osg::Geode> drawBoundBox(cmp::BoundBox* aabb, osg::Node::NodeMask m
 	return geode;
 }
 
-osg::ref_ptr<osg::Geode> drawMesh(cmp::MeshData* mesh, StateSetList* states, bool isMultiMesh, osg::Node::NodeMask mask)
+// Vertex or index data owned elsewhere, such as a mapped cache file.
+class BufferView : public osg::BufferData
+{
+	public:
+		BufferView() : data(0), size(0) {}
+		BufferView(const void* data, unsigned size) : data(data), size(size) {}
+
+		BufferView(const BufferView& rhs, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY)
+			: osg::BufferData(rhs, copyop), data(rhs.data), size(rhs.size) {}
+
+		META_Object(cmpviewer, BufferView)
+
+		virtual const GLvoid* getDataPointer() const { return data; }
+		virtual unsigned int getTotalDataSize() const { return size; }
+
+	protected:
+		virtual ~BufferView() {}
+
+		const void* data;
+		unsigned    size;
+};
+
+// Draws the batches of one material from a mesh's interleaved vertex buffer.
+class MeshDrawable : public osg::Drawable
+{
+	public:
+		MeshDrawable() {}
+
+		MeshDrawable(osg::BufferData* vertices, osg::BufferData* indices, const osg::BoundingBox& bound) : vertices(vertices), indices(indices), bound(bound)
+		{
+			// Attribute pointers are set up per draw, which can't go in a display list.
+			setUseDisplayList(false);
+			setUseVertexBufferObjects(true);
+		}
+
+		MeshDrawable(const MeshDrawable& rhs, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY)
+			: osg::Drawable(rhs, copyop), vertices(rhs.vertices), indices(rhs.indices), batches(rhs.batches), bound(rhs.bound) {}
+
+		META_Object(cmpviewer, MeshDrawable)
+
+		void addBatch(const cache::Batch& batch) { batches.push_back(batch); }
+
+		virtual osg::BoundingBox computeBoundingBox() const { return bound; }
+
+		virtual void drawImplementation(osg::RenderInfo& renderInfo) const
+		{
+			osg::State& state = *renderInfo.getState();
+
+			osg::GLBufferObject* vbo = vertices->getOrCreateGLBufferObject(state.getContextID());
+			state.bindVertexBufferObject(vbo);
+
+			const GLubyte* base = reinterpret_cast<const GLubyte*>(vbo->getOffset(vertices->getBufferIndex()));
+			const GLsizei stride = sizeof(cmp::PackedVertex);
+
+			state.lazyDisablingOfVertexAttributes();
+			state.setVertexAttribPointer(ATTRIB_NO_POSITION,    3, GL_SHORT,         GL_FALSE, stride, base + offsetof(cmp::PackedVertex, position));
+			state.setVertexAttribPointer(ATTRIB_NO_NORMAL,      3, GL_SHORT,         GL_FALSE, stride, base + offsetof(cmp::PackedVertex, normal));
+			state.setVertexAttribPointer(ATTRIB_NO_UVS,         4, GL_SHORT,         GL_FALSE, stride, base + offsetof(cmp::PackedVertex, uvs));
+			state.setVertexAttribPointer(ATTRIB_NO_INTENSITIES, 4, GL_UNSIGNED_BYTE, GL_FALSE, stride, base + offsetof(cmp::PackedVertex, intensities));
+			state.setVertexAttribPointer(ATTRIB_NO_IDS,         4, GL_UNSIGNED_BYTE, GL_FALSE, stride, base + offsetof(cmp::PackedVertex, ids));
+			state.applyDisablingOfVertexAttributes();
+
+			osg::GLBufferObject* ebo = indices->getOrCreateGLBufferObject(state.getContextID());
+			state.bindElementBufferObject(ebo);
+
+			const GLubyte* first = reinterpret_cast<const GLubyte*>(ebo->getOffset(indices->getBufferIndex()));
+
+			for (const cache::Batch& batch : batches) {
+				GLenum mode = batch.type == cmp::Primitive::Type::TriangleStrip ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+				glDrawElements(mode, batch.count, GL_UNSIGNED_SHORT, first + batch.offset * sizeof(uint16_t));
+			}
+
+			state.unbindVertexBufferObject();
+			state.unbindElementBufferObject();
+		}
+
+	protected:
+		virtual ~MeshDrawable() {}
+
+		osg::ref_ptr<osg::BufferData> vertices;
+		osg::ref_ptr<osg::BufferData> indices;
+		std::vector<cache::Batch>     batches;
+		osg::BoundingBox              bound;
+};
+
+// Meshes already built, shared by all nodes referencing the same data.
+struct MeshCache
+{
+	struct Entry
+	{
+		osg::ref_ptr<osg::Geode> geode;
+		size_t                   size;
+	};
+
+	typedef std::pair<const cmp::MeshData*, bool> Key; // Mesh and multi mesh flag.
+
+	MeshCache() : instances(0), savedBytes(0) {}
+
+	std::map<Key, Entry> entries;
+	unsigned             instances;
+	size_t               savedBytes;
+};
+
+osg::ref_ptr<osg::Geode> drawMesh(cmp::MeshData* mesh, StateSetList* states, MeshCache* meshCache, cache::SceneCache* sceneCache, bool isMultiMesh, osg::Node::NodeMask mask)
 {
 	if (!mesh->length) {
 		if (mesh->reference) {
-			// TODO: Re-use geode.
-			return drawMesh(mesh->reference, states, isMultiMesh, mask);
+			return drawMesh(mesh->reference, states, meshCache, sceneCache, isMultiMesh, mask);
 		}
 
 		osg::ref_ptr<osg::Geode> geode = new osg::Geode();
 		return geode.get();
 	}
 
-	osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+	MeshCache::Key key(mesh, isMultiMesh);
+	std::map<MeshCache::Key, MeshCache::Entry>::iterator cached = meshCache->entries.find(key);
+	if (cached != meshCache->entries.end()) {
+		// New geode for the node mask, drawables and buffers are shared.
+		osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+		osg::Geode* source = cached->second.geode.get();
 
-	cmp::BoundBox* b = &mesh->aabb;
-	float maxX = (b->min.x - b->max.x) * -1;
-	float maxY = (b->min.y - b->max.y) * -1;
-	float maxZ = (b->min.z - b->max.z) * -1;
-
-	osg::ref_ptr<osg::Vec3Array> vertices    = new osg::Vec3Array(mesh->vertexCount2);
-	osg::ref_ptr<osg::Vec3Array> normals     = new osg::Vec3Array(osg::Array::BIND_PER_VERTEX, mesh->vertexCount2);
-	osg::ref_ptr<osg::Vec2Array> uvs0        = new osg::Vec2Array(osg::Array::BIND_PER_VERTEX, mesh->vertexCount2);
-	osg::ref_ptr<osg::Vec2Array> uvs1        = new osg::Vec2Array(osg::Array::BIND_PER_VERTEX, mesh->vertexCount2);
-	osg::ref_ptr<osg::Vec4Array> colors      = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX, mesh->vertexCount2);
-	osg::ref_ptr<osg::Vec4Array> intensities = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX, mesh->vertexCount2);
-	osg::ref_ptr<osg::Vec4bArray> ids        = new osg::Vec4bArray(osg::Array::BIND_PER_VERTEX, mesh->vertexCount2);
+		for (unsigned i = 0; i < source->getNumDrawables(); i++) {
+			geode->addDrawable(source->getDrawable(i));
+		}
+		geode->setStateSet(source->getStateSet());
+		geode->setNodeMask(mask);
 
-	// TODO: Apply deformations in vertex shader.
-	float damage = 0.0f;
+		meshCache->instances++;
+		meshCache->savedBytes += cached->second.size;
 
-	if (mesh->hasNumberPlate) {
-		damage = 0.0f;
+		return geode;
 	}
 
-	for (unsigned i = 0; i < mesh->vertexCount2; i++) {
-		cmp::Vertex* v = &mesh->vertices[i];
-		vertices->at(i) = osg::Vec3(v->getX(maxX) + (v->getDX() * damage), v->getY(maxY) + (v->getDY() * damage), -v->getZ(maxZ) + (-v->getDZ() * damage));
-		normals->at(i) = osg::Vec3(v->getNX(), v->getNY(), -v->getNZ());
-		uvs0->at(i) = osg::Vec2(v->getU0(), v->getV0());
-		uvs1->at(i) = osg::Vec2(v->getU1(), v->getV1());
-
-		if (v->getMaterialId() < states->size()) {
-			osg::ref_ptr<osg::Material> material = (osg::Material*)states->at(v->getMaterialId())->getAttribute(osg::StateAttribute::MATERIAL);
-
-			if (material) {
-				colors->at(i) = material->getDiffuse(osg::Material::FRONT);
-			}
-		}
+	osg::ref_ptr<osg::Geode> geode = new osg::Geode();
 
-		intensities->at(i) = osg::Vec4(v->getAmbientIntensity(), v->getSpecularIntensity(), v->getSpecularPower(), v->getEnvMapIntensity());
-		ids->at(i) = osg::Vec4b(v->getMaterialId(), v->getMatrixId(), v->getDemolitionId(), isMultiMesh);
+	const cache::MeshBuffers* buffers = sceneCache->find(mesh);
+	if (!buffers) {
+		return geode;
 	}
 
-	osg::ref_ptr<osg::VertexBufferObject> vbo = new osg::VertexBufferObject();
-	vbo->addArray(vertices.get());
-	vbo->addArray(normals.get());
-	vbo->addArray(uvs0.get());
-	vbo->addArray(uvs1.get());
-	vbo->addArray(colors.get());
-	vbo->addArray(intensities.get());
-	vbo->addArray(ids.get());
-
-	// One geometry per material.
-	osg::ref_ptr<osg::Geometry>* matgeo = new osg::ref_ptr<osg::Geometry>[states->size()];
-	::memset(matgeo, 0, sizeof(osg::ref_ptr<osg::Geometry>) * states->size());
+	// TODO: Apply deformations in vertex shader.
 
-	unsigned int i = 0;
-	for (cmp::Primitive* primitive : mesh->primitives) {
-		unsigned materialId = mesh->materials.at(i)->material;
+	// Converted or mapped buffers are uploaded as they are.
+	osg::ref_ptr<BufferView> vertices = new BufferView(buffers->vertices, buffers->vertexCount * sizeof(cmp::PackedVertex));
+	vertices->setBufferObject(new osg::VertexBufferObject());
 
-		// Create new geometry node once per material.
-		if (!matgeo[materialId]) {
-			matgeo[materialId] = new osg::Geometry();
+	osg::ref_ptr<BufferView> indices = new BufferView(buffers->indices, buffers->indexCount * sizeof(uint16_t));
+	indices->setBufferObject(new osg::ElementBufferObject());
 
-			matgeo[materialId]->setUseVertexBufferObjects(true);
-			matgeo[materialId]->setVertexArray(vertices.get());
-			matgeo[materialId]->setNormalArray(normals.get());
-			matgeo[materialId]->setTexCoordArray(0, uvs0.get());
-			matgeo[materialId]->setTexCoordArray(1, uvs1.get());
-			matgeo[materialId]->setColorArray(colors.get());
+	size_t size = vertices->getTotalDataSize() + indices->getTotalDataSize();
 
-			matgeo[materialId]->setVertexAttribArray(ATTRIB_NO_INTENSITIES, intensities.get());
-			matgeo[materialId]->setVertexAttribBinding(ATTRIB_NO_INTENSITIES, osg::Geometry::BIND_PER_VERTEX);
+	// Fixed point positions are scaled by the AABB extent in the vertex shader.
+	cmp::BoundBox* b = &mesh->aabb;
+	osg::Vec3 scale((b->max.x - b->min.x) / 1024.0f, (b->max.y - b->min.y) / 1024.0f, (b->max.z - b->min.z) / 1024.0f);
+	geode->getOrCreateStateSet()->addUniform(new osg::Uniform(UNIFORM_MESH_SCALE, scale));
+	geode->getOrCreateStateSet()->addUniform(new osg::Uniform(UNIFORM_MULTI_MESH, isMultiMesh));
+
+	osg::BoundingBox bound;
+	for (unsigned i = 0; i < buffers->vertexCount; i++) {
+		const cmp::PackedVertex& v = buffers->vertices[i];
+		bound.expandBy(osg::Vec3(v.position[0] * scale.x(), v.position[1] * scale.y(), v.position[2] * scale.z()));
+	}
 
-			matgeo[materialId]->setVertexAttribArray(ATTRIB_NO_IDS, ids.get());
-			matgeo[materialId]->setVertexAttribBinding(ATTRIB_NO_IDS, osg::Geometry::BIND_PER_VERTEX);
+	// One drawable per material.
+	std::vector<osg::ref_ptr<MeshDrawable>> matgeo(states->size());
 
-			matgeo[materialId]->setStateSet(states->at(materialId).get());
+	for (unsigned i = 0; i < buffers->batchCount; i++) {
+		const cache::Batch& batch = buffers->batches[i];
+		unsigned materialId = batch.material;
 
-			geode->addDrawable(matgeo[materialId].get());
+		if (materialId >= matgeo.size()) {
+			std::cerr << "Error: Mesh \"" << mesh->name << "\" uses material " << materialId << ", material set has " << matgeo.size() << std::endl;
+			continue;
 		}
 
-		switch (primitive->type) {
-			case cmp::Primitive::Type::TriangleList:
-			{
-				cmp::TriangleList* list = dynamic_cast<cmp::TriangleList*>(primitive);
-				if (list) {
-					unsigned length = (list->count + 1) * 3;
-					osg::ref_ptr<osg::DrawElementsUInt> triangles = new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLES, length);
-					for (unsigned i = 0; i < length; i++) {
-						triangles->at(i) = mesh->indices[list->offset + i];
-					}
-
-					matgeo[materialId]->addPrimitiveSet(triangles.get());
-				}
-				break;
-			}
-			case cmp::Primitive::Type::TriangleStrip:
-			{
-				cmp::TriangleStrip* strip = dynamic_cast<cmp::TriangleStrip*>(primitive);
-				if (strip) {
-					unsigned length = strip->count + 3;
-					osg::ref_ptr<osg::DrawElementsUInt> tristrip = new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLE_STRIP, length);
-
-					for (unsigned i = 0; i < length; i++) {
-						tristrip->at(i) = strip->offset + i;
-					}
+		// Create new drawable once per material.
+		if (!matgeo[materialId]) {
+			matgeo[materialId] = new MeshDrawable(vertices.get(), indices.get(), bound);
+			matgeo[materialId]->setStateSet(states->at(materialId).get());
 
-					matgeo[materialId]->addPrimitiveSet(tristrip.get());
-				}
-				break;
-			}
+			geode->addDrawable(matgeo[materialId].get());
 		}
 
-		i++;
+		matgeo[materialId]->addBatch(batch);
 	}
 
-	delete[] matgeo;
-
 	geode->setNodeMask(mask);
 
+	meshCache->entries[key] = { geode, size };
+
 	return geode;
 }
 
@@ -567,7 +805,7 @@ osg::Matrix cmpMatrix2osgMatrix(cmp::Mat4x3* m)
 			m->a[3][0], m->a[3][1], -m->a[3][2], 1.0f);
 }
 
-osg::ref_ptr<osg::Node> drawNode(cmp::Node* node, osg::Group* parent, StateSetList* states, osg::Uniform* matricesUniform, osg::Node::NodeMask mask = 0)
+osg::ref_ptr<osg::Node> drawNode(cmp::Node* node, osg::Group* parent, StateSetList* states, MeshCache* meshCache, cache::SceneCache* sceneCache, osg::Uniform* matricesUniform, osg::Node::NodeMask mask = 0)
 {
 	switch (node->type) {
 		case cmp::Node::Root:
@@ -608,7 +846,7 @@ osg::ref_ptr<osg::Node> drawNode(cmp::Node* node, osg::Group* parent, StateSetLi
 			}
 
 			for (cmp::Node* node : groupNode->children) {
-				osg::ref_ptr<osg::Node> child = drawNode(node, group, states, matricesUniform, mask);
+				osg::ref_ptr<osg::Node> child = drawNode(node, group, states, meshCache, sceneCache, matricesUniform, mask);
 				if (child) {
 					group->addChild(child.get());
 				}
@@ -631,25 +869,46 @@ osg::ref_ptr<osg::Node> drawNode(cmp::Node* node, osg::Group* parent, StateSetLi
 				mask = CULL_OTHER;
 			}
 
+			if (meshNode->meshes.size() < 2) {
+				for (cmp::MeshData* mesh : meshNode->meshes) {
+					group->addChild(drawBoundBox(&mesh->aabb, CULL_MESH_AABB));
+					group->addChild(drawMesh(mesh, states, meshCache, sceneCache, node->type == cmp::Node::MultiMesh, mask));
+				}
+
+				return group;
+			}
+
+			// Detail levels switch at multiples of the most detailed mesh's bounding radius.
+			cmp::MeshData* detail = meshNode->meshes.front();
+			if (!detail->length && detail->reference) {
+				detail = detail->reference;
+			}
+			osg::BoundingBox bound(
+					detail->aabb.min.x, detail->aabb.min.y, -detail->aabb.max.z,
+					detail->aabb.max.x, detail->aabb.max.y, -detail->aabb.min.z);
+			float range = bound.radius() * LOD_RANGE_FACTOR;
+
+			osg::ref_ptr<osg::LOD> lodNode = new osg::LOD();
+			lodNode->setCenterMode(osg::LOD::USER_DEFINED_CENTER);
+			lodNode->setCenter(bound.center());
+			lodNode->setRadius(bound.radius());
+
 			int lod = 0;
 			for (cmp::MeshData* mesh : meshNode->meshes) {
-				switch (lod) {
-					case 0:
-						//mask |= CULL_LOD1;
-						break;
-					case 1:
-						mask = CULL_LOD2;
-						break;
-					default:
-						mask = CULL_LOD3;
-				}
+				osg::ref_ptr<osg::Group> level = new osg::Group();
+				level->addChild(drawBoundBox(&mesh->aabb, CULL_MESH_AABB));
+				level->addChild(drawMesh(mesh, states, meshCache, sceneCache, node->type == cmp::Node::MultiMesh && lod == 0, mask));
 
-				group->addChild(drawBoundBox(&mesh->aabb, CULL_MESH_AABB));
+				// Ranges double per level, the last level covers everything beyond.
+				float min = lod ? range * (1 << (lod - 1)) : 0.0f;
+				float max = lod + 1 < (int)meshNode->meshes.size() ? range * (1 << lod) : FLT_MAX;
+				lodNode->addChild(level.get(), min, max);
 
-				group->addChild(drawMesh(mesh, states, node->type == cmp::Node::MultiMesh && lod == 0, mask));
 				lod++;
 			}
 
+			group->addChild(lodNode.get());
+
 			return group;
 		}
 		case cmp::Node::Axis:
@@ -663,20 +922,21 @@ osg::ref_ptr<osg::Node> drawNode(cmp::Node* node, osg::Group* parent, StateSetLi
 class KeyHandler : public osgGA::GUIEventHandler
 {
 	public:
-		KeyHandler(osg::Camera* camera) : camera(camera) {}
+		KeyHandler(osg::Camera* camera, MaterialSets* materialSets) : camera(camera), materialSets(materialSets) {}
 
 		virtual bool handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter&)
 		{
 			if (ea.getEventType() == osgGA::GUIEventAdapter::KEYDOWN) {
 					switch (ea.getKey()) {
-						//case '1':
-						//	camera->setCullMask(camera->getCullMask() ^ CULL_LOD1);
-						//	return true;
-						case '2':
-							camera->setCullMask(camera->getCullMask() ^ CULL_LOD2);
+						case '+':
+						case osgGA::GUIEventAdapter::KeySymbol::KEY_KP_Add:
+							camera->setLODScale(camera->getLODScale() * 0.5f);
+							std::cout << "LOD scale " << camera->getLODScale() << std::endl;
 							return true;
-						case '3':
-							camera->setCullMask(camera->getCullMask() ^ CULL_LOD3);
+						case '-':
+						case osgGA::GUIEventAdapter::KeySymbol::KEY_KP_Subtract:
+							camera->setLODScale(camera->getLODScale() * 2.0f);
+							std::cout << "LOD scale " << camera->getLODScale() << std::endl;
 							return true;
 						case osgGA::GUIEventAdapter::KeySymbol::KEY_F1:
 							camera->setCullMask(camera->getCullMask() ^ CULL_GROUP_AABB);
@@ -702,6 +962,15 @@ class KeyHandler : public osgGA::GUIEventHandler
 						case osgGA::GUIEventAdapter::KeySymbol::KEY_F8:
 							camera->setCullMask(camera->getCullMask() ^ CULL_OTHER);
 							return true;
+						case osgGA::GUIEventAdapter::KeySymbol::KEY_Page_Up:
+						case osgGA::GUIEventAdapter::KeySymbol::KEY_Page_Down:
+						{
+							unsigned count = materialSets->size();
+							int step = ea.getKey() == osgGA::GUIEventAdapter::KeySymbol::KEY_Page_Up ? count - 1 : 1;
+							materialSets->select((materialSets->getCurrent() + step) % count);
+							std::cout << "Material set \"" << materialSets->getName(materialSets->getCurrent()) << "\"" << std::endl;
+							return true;
+						}
 					}
 			}
 
@@ -709,7 +978,8 @@ class KeyHandler : public osgGA::GUIEventHandler
 		}
 
 	private:
-		osg::Camera* camera;
+		osg::Camera*  camera;
+		MaterialSets* materialSets;
 };
 
 int main(int argc, char** argv)
@@ -732,7 +1002,25 @@ int main(int argc, char** argv)
 
 	std::string cmppath = argv[1];
 	std::string basepath = osgDB::getFilePath(cmppath);
-	std::string ombpath = basepath + osgDB::getNativePathSeparator() + "materialSet" + materialSetNo + ".omb";
+	std::string ombname = "materialSet" + materialSetNo + ".omb";
+
+	// All material sets next to the model, the requested one is shown first.
+	std::vector<std::string> ombnames;
+	for (const std::string& file : osgDB::getDirectoryContents(basepath.empty() ? "." : basepath)) {
+		if (osgDB::convertToLowerCase(file).compare(0, 11, "materialset") == 0 && osgDB::getLowerCaseFileExtension(file) == "omb") {
+			ombnames.push_back(file);
+		}
+	}
+	std::sort(ombnames.begin(), ombnames.end());
+
+	unsigned selected = 0;
+	while (selected < ombnames.size() && osgDB::convertToLowerCase(ombnames[selected]) != osgDB::convertToLowerCase(ombname)) {
+		selected++;
+	}
+	if (selected == ombnames.size()) {
+		// Not found, fail on reading it below.
+		ombnames.push_back(ombname);
+	}
 
 	std::ifstream ifs;
 	ifs.exceptions(std::ifstream::failbit | std::ifstream::badbit | std::ifstream::eofbit);
@@ -740,7 +1028,7 @@ int main(int argc, char** argv)
 	std::cout << "Reading \"" << cmppath << "\"" << std::endl;
 
 	cmp::RootNode* root;
-	omb::MaterialSet* materials;
+	MaterialSetList materialSets;
 
 	try {
 		// CMP
@@ -757,14 +1045,15 @@ int main(int argc, char** argv)
 			ifs.close();
 		}
 		// OMB
-		{
+		for (const std::string& name : ombnames) {
+			std::string ombpath = basepath + osgDB::getNativePathSeparator() + name;
 			std::cout << "Reading \"" << ombpath << "\"" << std::endl;
 			ifs.open(ombpath, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
 
 			std::streampos length = ifs.tellg();
 			ifs.seekg(0);
 
-			materials = omb::MaterialSet::readFile(ifs);
+			materialSets.push_back(omb::MaterialSet::readFile(ifs));
 
 			std::cout << "Finished reading OMB with " << length - ifs.tellg() << " bytes left in file" << std::endl << std::endl;;
 
@@ -780,15 +1069,55 @@ int main(int argc, char** argv)
 		return 3;
 	}
 
-	printNode(root, materials);
+	printNode(root, materialSets[selected]);
 	std::cout << std::endl;
 
+	// Converted meshes, mapped from the cache when the model is unchanged.
+	cmp::MeshList meshes;
+	root->findMeshes(&meshes);
+	cache::SceneCache sceneCache(cmppath, meshes);
+
+	if (sceneCache.load()) {
+		std::cout << "Mapped converted meshes from \"" << sceneCache.path << "\"" << std::endl << std::endl;
+	}
+	else {
+		sceneCache.build();
+
+		const cache::Stats& stats = sceneCache.stats;
+		std::cout << "Merged " << stats.primitives << " primitives into " << stats.batches << " draw calls" << std::endl;
+		if (stats.triangles) {
+			std::cout << "ACMR " << std::fixed << std::setprecision(3) << (float)stats.missesBefore / stats.triangles << " before, "
+				<< (float)stats.missesAfter / stats.triangles << " after vertex cache optimisation" << std::defaultfloat << std::endl;
+		}
+		std::cout << std::endl;
+
+		if (!sceneCache.path.empty()) {
+			try {
+				sceneCache.save();
+				std::cout << "Wrote converted meshes to \"" << sceneCache.path << "\"" << std::endl << std::endl;
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Error: Couldn't write mesh cache: " << e.what() << std::endl;
+			}
+		}
+	}
+
 	osg::ref_ptr<osg::Uniform> matricesUniform = new osg::Uniform(osg::Uniform::FLOAT_MAT4, UNIFORM_MATRICES, cmp::MaxMatrices);
 
-	StateSetList states = generateOSGMaterials(materials, basepath, matricesUniform);
+	osg::ref_ptr<osg::Uniform> paletteUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC4, UNIFORM_PALETTE, PaletteSize);
+	paletteUniform->setDataVariance(osg::Object::DYNAMIC);
+
+	TextureCache textures(basepath);
+	StateSetList states = generateOSGMaterials(materialSets, basepath, &textures, matricesUniform, paletteUniform);
+
+	MaterialSets materials(materialSets, ombnames, basepath, &textures, &states, paletteUniform);
+	materials.select(selected);
 
 	osg::ref_ptr<osg::Group> world = new osg::Group();
-	osg::ref_ptr<osg::Node> model = drawNode(root, world, &states, matricesUniform);
+	MeshCache meshCache;
+	osg::ref_ptr<osg::Node> model = drawNode(root, world, &states, &meshCache, &sceneCache, matricesUniform);
+
+	std::cout << "Shared " << meshCache.instances << " mesh instances, saved " << meshCache.savedBytes / 1024 << " KiB of vertex and index data" << std::endl << std::endl;
 	world->addChild(model.get());
 
 	// Flip and cull back faces.
@@ -796,14 +1125,16 @@ int main(int argc, char** argv)
 	world->getOrCreateStateSet()->setAttributeAndModes(new osg::CullFace(osg::CullFace::Mode::BACK));
 
 	delete root;
-	delete materials;
+	for (omb::MaterialSet* materialSet : materialSets) {
+		delete materialSet;
+	}
 
 	osgViewer::Viewer viewer;
 	viewer.setUpViewInWindow(100, 50, 800, 600);
 	viewer.getCamera()->setClearColor(osg::Vec4(1.0f, 1.0f, 1.0f, 1.0f));
-	viewer.getCamera()->setCullMask(CULL_BODY | CULL_TIRES | CULL_WINDOWS | CULL_INTERIOR | CULL_LOOSEPARTS | CULL_OTHER |  CULL_LOD1);
+	viewer.getCamera()->setCullMask(CULL_BODY | CULL_TIRES | CULL_WINDOWS | CULL_INTERIOR | CULL_LOOSEPARTS | CULL_OTHER);
 
-	viewer.addEventHandler(new KeyHandler(viewer.getCamera()));
+	viewer.addEventHandler(new KeyHandler(viewer.getCamera(), &materials));
 
 	// Wireframe/light toggling.
 	viewer.addEventHandler(new osgGA::StateSetManipulator(viewer.getCamera()->getOrCreateStateSet()));
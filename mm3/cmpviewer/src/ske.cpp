@@ -0,0 +1,116 @@
+#include "ske.h"
+
+using namespace ske;
+
+struct Pending
+{
+	uint32_t bone;
+	uint32_t children; // Not yet read.
+};
+
+Skeleton* Skeleton::readFile(std::ifstream& ifs)
+{
+	Skeleton* skeleton = new Skeleton();
+
+	// Bones are nested in the file, keep the open ones on a stack instead of recursing.
+	std::vector<Pending> stack;
+
+	try {
+		do {
+			uint32_t bone = skeleton->ids.size();
+
+			uint32_t id;
+			std::string name;
+			parse(ifs, id);
+			parse(ifs, name);
+
+			skeleton->ids.push_back(id);
+			skeleton->names.push_back(name);
+			skeleton->parents.push_back(stack.empty() ? -1 : (int32_t)stack.back().bone);
+
+			for (unsigned i = 0; i < 4; i++) {
+				Vec3f v;
+				parse(ifs, v);
+				skeleton->vertices[i].push_back(v);
+			}
+
+			uint32_t childCount;
+			parse(ifs, childCount);
+			skeleton->childCounts.push_back(childCount);
+
+			if (!stack.empty()) {
+				stack.back().children--;
+			}
+
+			if (childCount) {
+				stack.push_back({ bone, childCount });
+			}
+
+			while (!stack.empty() && !stack.back().children) {
+				stack.pop_back();
+			}
+		} while (!stack.empty());
+	}
+	catch (...) {
+		delete skeleton;
+		throw;
+	}
+
+	return skeleton;
+}
+
+int Skeleton::findBone(const std::string& name) const
+{
+	for (unsigned i = 0; i < names.size(); i++) {
+		if (names[i] == name) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void Skeleton::getBindPose(Transform* local) const
+{
+	for (unsigned i = 0; i < ids.size(); i++) {
+		local[i].axes[0] = vertices[0][i];
+		local[i].axes[1] = vertices[1][i];
+		local[i].axes[2] = vertices[2][i];
+		local[i].origin  = vertices[3][i];
+	}
+}
+
+// Point or direction in the space of t.
+static inline Vec3f transform(const Vec3f& v, const Transform& t, float w)
+{
+	return {
+		v.x * t.axes[0].x + v.y * t.axes[1].x + v.z * t.axes[2].x + w * t.origin.x,
+		v.x * t.axes[0].y + v.y * t.axes[1].y + v.z * t.axes[2].y + w * t.origin.y,
+		v.x * t.axes[0].z + v.y * t.axes[1].z + v.z * t.axes[2].z + w * t.origin.z,
+	};
+}
+
+void Skeleton::computeWorldTransforms(const Transform* local, Transform* world, unsigned instances) const
+{
+	unsigned count = ids.size();
+	const int32_t* parent = parents.data();
+
+	for (unsigned n = 0; n < instances; n++) {
+		const Transform* in = local + n * count;
+		Transform* out = world + n * count;
+
+		// Parents precede children, so their world transforms are ready.
+		for (unsigned i = 0; i < count; i++) {
+			if (parent[i] < 0) {
+				out[i] = in[i];
+				continue;
+			}
+
+			const Transform& p = out[parent[i]];
+			out[i].axes[0] = transform(in[i].axes[0], p, 0.0f);
+			out[i].axes[1] = transform(in[i].axes[1], p, 0.0f);
+			out[i].axes[2] = transform(in[i].axes[2], p, 0.0f);
+			out[i].origin  = transform(in[i].origin,  p, 1.0f);
+		}
+	}
+}
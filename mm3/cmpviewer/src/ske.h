@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ske
+{
+	struct Vec3f
+	{
+		float x, y, z;
+	};
+
+	// Affine bone transform, assumed to be stored as three axes followed by
+	// the origin in the four bone vertices.
+	struct Transform
+	{
+		Vec3f axes[3];
+		Vec3f origin;
+	};
+
+	// Bone hierarchy flattened in depth-first order, so every parent comes
+	// before its children. Bone data is kept in one array per field.
+	class Skeleton
+	{
+		public:
+			static Skeleton* readFile(std::ifstream& ifs);
+
+			unsigned getBoneCount() const { return ids.size(); }
+			int      findBone(const std::string& name) const;
+
+			// Transforms as stored in the file.
+			void getBindPose(Transform* local) const;
+
+			// Concatenate local transforms with their parents in one pass.
+			// Arrays hold getBoneCount() transforms per instance.
+			void computeWorldTransforms(const Transform* local, Transform* world, unsigned instances = 1) const;
+
+			std::vector<uint32_t>    ids;
+			std::vector<std::string> names;
+			std::vector<int32_t>     parents;     // -1 for the root.
+			std::vector<uint32_t>    childCounts;
+			std::vector<Vec3f>       vertices[4];
+
+		private:
+			template<class T>
+			static void parse(std::istream& in, T& var) { in.read(reinterpret_cast<char*>(&var), sizeof(var)); }
+			static void parse(std::istream& in, std::string& var) { std::getline(in, var, '\0'); }
+	};
+}
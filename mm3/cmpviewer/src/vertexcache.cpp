@@ -0,0 +1,221 @@
+#include "vertexcache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+const unsigned vertexcache::CacheSize = 32;
+
+// Scoring as in "Linear-Speed Vertex Cache Optimisation", Tom Forsyth 2006.
+static const float CacheDecayPower   = 1.5f;
+static const float LastTriScore      = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+
+struct VertexState
+{
+	VertexState() : cachePos(-1), score(0.0f), remaining(0), first(0) {}
+
+	int      cachePos;
+	float    score;
+	unsigned remaining; // Triangles not yet emitted.
+	unsigned first;     // Into the triangle adjacency list.
+};
+
+// Precomputed score terms, valences above the table are rare.
+static const unsigned MaxValence = 32;
+
+struct ScoreTables
+{
+	ScoreTables() : cache(vertexcache::CacheSize), valence(MaxValence)
+	{
+		for (unsigned i = 0; i < vertexcache::CacheSize; i++) {
+			if (i < 3) {
+				// Triangle just emitted, don't favour it over the rest of the cache.
+				cache[i] = LastTriScore;
+			}
+			else {
+				float scale = 1.0f / (vertexcache::CacheSize - 3);
+				cache[i] = std::pow(1.0f - (i - 3) * scale, CacheDecayPower);
+			}
+		}
+
+		for (unsigned i = 1; i < MaxValence; i++) {
+			valence[i] = ValenceBoostScale * std::pow((float)i, -ValenceBoostPower);
+		}
+	}
+
+	std::vector<float> cache;
+	std::vector<float> valence;
+};
+
+static float vertexScore(const VertexState& v)
+{
+	static const ScoreTables tables;
+
+	if (!v.remaining) {
+		return -1.0f;
+	}
+
+	float score = v.cachePos >= 0 ? tables.cache[v.cachePos] : 0.0f;
+
+	// Finish off vertices with few triangles left.
+	if (v.remaining < MaxValence) {
+		score += tables.valence[v.remaining];
+	}
+	else {
+		score += ValenceBoostScale * std::pow((float)v.remaining, -ValenceBoostPower);
+	}
+
+	return score;
+}
+
+void vertexcache::optimize(uint16_t* indices, unsigned indexCount, unsigned vertexCount)
+{
+	unsigned triCount = indexCount / 3;
+	if (triCount < 2) {
+		return;
+	}
+
+	std::vector<VertexState> vertices(vertexCount);
+
+	for (unsigned i = 0; i < triCount * 3; i++) {
+		if (indices[i] >= vertexCount) {
+			// Broken mesh, leave as is.
+			return;
+		}
+
+		vertices[indices[i]].remaining++;
+	}
+
+	// Triangles per vertex.
+	std::vector<unsigned> adjacency(triCount * 3);
+	{
+		unsigned offset = 0;
+		for (VertexState& v : vertices) {
+			v.first = offset;
+			offset += v.remaining;
+			v.remaining = 0;
+		}
+
+		for (unsigned i = 0; i < triCount * 3; i++) {
+			VertexState& v = vertices[indices[i]];
+			adjacency[v.first + v.remaining++] = i / 3;
+		}
+	}
+
+	for (VertexState& v : vertices) {
+		v.score = vertexScore(v);
+	}
+
+	std::vector<float> triScores(triCount);
+	std::vector<bool> emitted(triCount, false);
+	for (unsigned t = 0; t < triCount; t++) {
+		triScores[t] = vertices[indices[t * 3]].score + vertices[indices[t * 3 + 1]].score + vertices[indices[t * 3 + 2]].score;
+	}
+
+	std::vector<uint16_t> output;
+	output.reserve(triCount * 3);
+
+	// Three extra slots hold vertices pushed out by the latest triangle.
+	std::vector<int> cache, next;
+	cache.reserve(CacheSize + 3);
+	next.reserve(CacheSize + 3);
+
+	int best = -1;
+	unsigned scan = 0;
+
+	while (output.size() < triCount * 3) {
+		if (best < 0) {
+			// Nothing in the cache, pick the best remaining triangle.
+			float bestScore = -1.0f;
+			for (unsigned t = scan; t < triCount; t++) {
+				if (!emitted[t] && triScores[t] > bestScore) {
+					bestScore = triScores[t];
+					best = t;
+				}
+			}
+
+			while (scan < triCount && emitted[scan]) {
+				scan++;
+			}
+		}
+
+		const uint16_t* tri = indices + best * 3;
+		emitted[best] = true;
+		output.insert(output.end(), tri, tri + 3);
+
+		// Remove the triangle from its vertices' adjacency.
+		for (unsigned i = 0; i < 3; i++) {
+			VertexState& v = vertices[tri[i]];
+			unsigned* list = &adjacency[v.first];
+			for (unsigned j = 0; j < v.remaining; j++) {
+				if ((int)list[j] == best) {
+					list[j] = list[--v.remaining];
+					break;
+				}
+			}
+		}
+
+		// Emitted vertices move to the front of the cache.
+		next.assign(tri, tri + 3);
+		for (int vertex : cache) {
+			if (vertex != tri[0] && vertex != tri[1] && vertex != tri[2]) {
+				next.push_back(vertex);
+			}
+		}
+		std::swap(cache, next);
+
+		for (unsigned i = 0; i < cache.size(); i++) {
+			VertexState& v = vertices[cache[i]];
+			v.cachePos = i < CacheSize ? i : -1;
+			v.score = vertexScore(v);
+		}
+
+		// Rescore triangles touching the cache and pick the best of them.
+		best = -1;
+		float bestScore = -1.0f;
+		for (int vertex : cache) {
+			const VertexState& v = vertices[vertex];
+			for (unsigned j = 0; j < v.remaining; j++) {
+				unsigned t = adjacency[v.first + j];
+				float score = vertices[indices[t * 3]].score + vertices[indices[t * 3 + 1]].score + vertices[indices[t * 3 + 2]].score;
+				triScores[t] = score;
+
+				if (score > bestScore) {
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+
+		if (cache.size() > CacheSize) {
+			cache.resize(CacheSize);
+		}
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+unsigned vertexcache::countMisses(const uint16_t* indices, unsigned indexCount, unsigned vertexCount)
+{
+	// Time stamps of when vertices entered the FIFO.
+	std::vector<unsigned> entered(vertexCount, 0);
+	unsigned time = CacheSize + 1;
+	unsigned misses = 0;
+
+	for (unsigned i = 0; i < indexCount; i++) {
+		if (indices[i] >= vertexCount) {
+			misses++;
+			continue;
+		}
+
+		unsigned& stamp = entered[indices[i]];
+		if (time - stamp > CacheSize) {
+			stamp = time++;
+			misses++;
+		}
+	}
+
+	return misses;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+namespace vertexcache
+{
+	// Post-transform cache size assumed by the optimiser and statistics.
+	extern const unsigned CacheSize;
+
+	// Reorder the triangles of an indexed triangle list for post-transform
+	// vertex cache hits, using Tom Forsyth's linear-speed algorithm.
+	void optimize(uint16_t* indices, unsigned indexCount, unsigned vertexCount);
+
+	// Simulated FIFO cache misses when drawing a triangle list. Average
+	// cache miss ratio (ACMR) is misses per triangle.
+	unsigned countMisses(const uint16_t* indices, unsigned indexCount, unsigned vertexCount);
+}
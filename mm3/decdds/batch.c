@@ -0,0 +1,429 @@
+/*
+ * decdds - Midtown Madness 3 CDDS extractor
+ *
+ * License: As is
+ * Author:  Daniel Stien <daniel@stien.org>
+ * URL:     https://github.com/dstien/gameformats
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "decdds.h"
+#include "file.h"
+
+// Input file names, owned.
+typedef struct batch_list_t {
+    char  **names;
+    int     count;
+    int     size;
+} batch_list_t;
+
+// Work queue and totals shared by the workers.
+typedef struct batch_t {
+    batch_list_t    list;
+    int             next;
+    decdds_opts_t   opts;
+    int             verbosity;
+    pthread_mutex_t lock;
+
+    int             done;
+    int             failed;
+    int             retval;
+    uint64_t        srcBytes;
+    uint64_t        dstBytes;
+} batch_t;
+
+// Decoding context reused for every file a worker takes.
+typedef struct batch_worker_t {
+    batch_t        *batch;
+    pthread_t       thread;
+    decdds_ctx_t    ctx;
+} batch_worker_t;
+
+char *decdds_dstname(const char *srcFileName)
+{
+    const char *srcExt = ".cdds";
+    const char *dstExt = ".dds";
+    size_t lenSrcName = strlen(srcFileName);
+    size_t lenSrcExt = strlen(srcExt);
+    size_t lenDstExt = strlen(dstExt);
+
+    char *dstFileName = (char*)malloc(lenSrcName + lenDstExt + 1);
+    if (dstFileName == NULL) {
+        return NULL;
+    }
+
+    strncpy(dstFileName, srcFileName, lenSrcName + 1);
+
+    // Replace ".cdds" extension with ".dds".
+    if ((lenSrcName > lenSrcExt) && !strcasecmp(srcFileName + lenSrcName - lenSrcExt, srcExt)) {
+        strncpy(dstFileName + lenSrcName - lenSrcExt, dstExt, lenDstExt + 1);
+    }
+    // Append ".dds" extension if input file don't ends with ".cdds".
+    else {
+        strncpy(dstFileName + lenSrcName, dstExt, lenDstExt + 1);
+    }
+
+    return dstFileName;
+}
+
+const char *decdds_strerror(int retval)
+{
+    switch (retval) {
+        case DECDDS_ERR_OPEN:
+            return "Can't open file";
+
+        case DECDDS_ERR_READ:
+            return "Can't read input file";
+
+        case DECDDS_ERR_WRITE:
+            return "Can't write output file";
+
+        case DECDDS_ERR_WRONGTYPE:
+            return "Not a valid CDDS file";
+
+        case DECDDS_ERR_MEM:
+            return "Couldn't allocate memory";
+
+        case DECDDS_ERR_DSTSIZE:
+            return "Output buffer too small";
+
+        case DECDDS_ERR_NOTPREFIX:
+            return "Mip limit only applies to a single face";
+
+        case DECDDS_ERR_NOTAIL:
+            return "Last byte of the image won't decode";
+
+        default:
+            return "Decoding failed";
+    }
+}
+
+void decdds_printinfo(const char *srcFileName, const decdds_info_t *info)
+{
+    const decdds_ddshdr_t *hdr = &info->hdr;
+    char format[16];
+
+    if (hdr->pxfmt.flags & DECDDS_FLG_FOURCC) {
+        snprintf(format, sizeof(format), "%.4s", (const char*)&hdr->pxfmt.fourcc);
+    }
+    else {
+        snprintf(format, sizeof(format), "RGB%u", hdr->pxfmt.rgbbits);
+    }
+
+    printf("%s: %ux%u", srcFileName, hdr->width, hdr->height);
+
+    if (hdr->caps.caps2 & DECDDS_CAP_VOLUME) {
+        printf("x%u", hdr->depth);
+    }
+
+    printf(" %s, %u mips, %u faces, %u bytes\n", format, info->mips, info->images, info->dstlen);
+}
+
+int decdds_isdir(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static int list_add(batch_list_t *list, const char *name)
+{
+    if (list->count == list->size) {
+        int size = list->size ? list->size * 2 : 64;
+        char **names = (char**)realloc(list->names, size * sizeof(char*));
+
+        if (names == NULL) {
+            return DECDDS_ERR_MEM;
+        }
+
+        list->names = names;
+        list->size = size;
+    }
+
+    if ((list->names[list->count] = strdup(name)) == NULL) {
+        return DECDDS_ERR_MEM;
+    }
+
+    ++list->count;
+    return 0;
+}
+
+static void list_free(batch_list_t *list)
+{
+    for (int i = 0; i < list->count; ++i) {
+        free(list->names[i]);
+    }
+
+    free(list->names);
+}
+
+// Count a path that couldn't be listed as a failed file, listing goes on.
+static void list_fail(batch_t *batch, int retval)
+{
+    ++batch->failed;
+
+    if (!batch->retval) {
+        batch->retval = retval;
+    }
+}
+
+// Add *.cdds files below path. Symlinked directories aren't followed, a link
+// back up the tree would recurse forever. Only running out of memory stops
+// the listing, unreadable directories are reported and counted as failed.
+static int list_dir(batch_t *batch, const char *path)
+{
+    DIR *dir;
+    struct dirent *entry;
+    struct stat st;
+    int retval = 0;
+
+    if ((dir = opendir(path)) == NULL) {
+        fprintf(stderr, "Error: Can't open directory \"%s\".\n", path);
+        list_fail(batch, DECDDS_ERR_OPEN);
+        return 0;
+    }
+
+    while (!retval && (entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        size_t len = strlen(name);
+
+        if (!strcmp(name, ".") || !strcmp(name, "..")) {
+            continue;
+        }
+
+        char *child = (char*)malloc(strlen(path) + len + 2);
+        if (child == NULL) {
+            retval = DECDDS_ERR_MEM;
+            break;
+        }
+
+        sprintf(child, "%s/%s", path, name);
+
+        if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+            retval = list_dir(batch, child);
+        }
+        else if (len > 5 && !strcasecmp(name + len - 5, ".cdds") && !decdds_isdir(child)) {
+            retval = list_add(&batch->list, child);
+        }
+
+        free(child);
+    }
+
+    closedir(dir);
+    return retval;
+}
+
+static int list_path(batch_t *batch, const char *path)
+{
+    return decdds_isdir(path) ? list_dir(batch, path) : list_add(&batch->list, path);
+}
+
+// Add paths listed one per line, "-" reads the list from stdin. An unreadable
+// list file is counted as failed like a directory.
+static int list_file(batch_t *batch, const char *listFileName)
+{
+    FILE *listFile = strcmp(listFileName, "-") ? fopen(listFileName, "r") : stdin;
+    char line[4096];
+    int retval = 0;
+
+    if (listFile == NULL) {
+        fprintf(stderr, "Error: Can't open list file \"%s\".\n", listFileName);
+        list_fail(batch, DECDDS_ERR_OPEN);
+        return 0;
+    }
+
+    while (!retval && fgets(line, sizeof(line), listFile) != NULL) {
+        line[strcspn(line, "\r\n")] = 0;
+
+        if (line[0]) {
+            retval = list_path(batch, line);
+        }
+    }
+
+    if (listFile != stdin) {
+        fclose(listFile);
+    }
+
+    return retval;
+}
+
+static int extract(batch_worker_t *worker, const char *srcFileName, uint32_t *srcLen, uint32_t *dstLen, decdds_info_t *info)
+{
+    const decdds_opts_t *opts = &worker->batch->opts;
+    decdds_file_t srcFile;
+    char *dstFileName;
+    int retval;
+
+    *srcLen = *dstLen = 0;
+
+    if ((retval = decdds_file_open(&srcFile, srcFileName)) != 0) {
+        return retval;
+    }
+
+    *srcLen = srcFile.len;
+
+    if (opts->info) {
+        if ((retval = decdds_peek_part(srcFile.data, srcFile.len, opts->faces, opts->mips, info)) == 0) {
+            *dstLen = info->dstlen;
+        }
+    }
+    else if ((dstFileName = decdds_dstname(srcFileName)) == NULL) {
+        retval = DECDDS_ERR_MEM;
+    }
+    else {
+        retval = decdds_file_extract(&worker->ctx, &srcFile, dstFileName, opts->faces, opts->mips, dstLen, NULL, NULL);
+        free(dstFileName);
+    }
+
+    decdds_file_close(&srcFile);
+
+    return retval;
+}
+
+static void *work(void *arg)
+{
+    batch_worker_t *worker = (batch_worker_t*)arg;
+    batch_t *batch = worker->batch;
+
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        int i = batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+
+        if (i >= batch->list.count) {
+            break;
+        }
+
+        const char *srcFileName = batch->list.names[i];
+        uint32_t srcLen, dstLen;
+        decdds_info_t info;
+        int retval = extract(worker, srcFileName, &srcLen, &dstLen, &info);
+
+        pthread_mutex_lock(&batch->lock);
+
+        if (retval) {
+            fprintf(stderr, "Error: %s: %s.\n", srcFileName, decdds_strerror(retval));
+            ++batch->failed;
+
+            if (!batch->retval) {
+                batch->retval = retval;
+            }
+        }
+        else {
+            if (batch->opts.info) {
+                decdds_printinfo(srcFileName, &info);
+            }
+            else if (batch->verbosity > 1) {
+                printf("  %s (%u -> %u bytes)\n", srcFileName, srcLen, dstLen);
+            }
+
+            ++batch->done;
+            batch->srcBytes += srcLen;
+            batch->dstBytes += dstLen;
+        }
+
+        pthread_mutex_unlock(&batch->lock);
+    }
+
+    return NULL;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int decdds_batch(char **names, int count, const char *listFileName, int threads, const decdds_opts_t *opts, int verbosity)
+{
+    batch_t batch;
+    batch_worker_t *workers;
+    int retval = 0;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.opts = *opts;
+    batch.verbosity = verbosity;
+
+    for (int i = 0; !retval && i < count; ++i) {
+        retval = list_path(&batch, names[i]);
+    }
+
+    if (!retval && listFileName != NULL) {
+        retval = list_file(&batch, listFileName);
+    }
+
+    if (retval) {
+        if (retval == DECDDS_ERR_MEM) {
+            fprintf(stderr, "Error: Couldn't allocate memory.\n");
+        }
+
+        list_free(&batch.list);
+        return retval;
+    }
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    if (threads > batch.list.count) {
+        threads = batch.list.count ? batch.list.count : 1;
+    }
+
+    if ((workers = (batch_worker_t*)calloc(threads, sizeof(batch_worker_t))) == NULL) {
+        fprintf(stderr, "Error: Couldn't allocate memory.\n");
+        list_free(&batch.list);
+        return DECDDS_ERR_MEM;
+    }
+
+    if (verbosity) {
+        printf("%s %d files on %d threads\n", opts->info ? "Reading" : "Extracting", batch.list.count, threads);
+    }
+
+    pthread_mutex_init(&batch.lock, NULL);
+    double start = now();
+
+    // The calling thread is the first worker.
+    for (int i = 0; i < threads; ++i) {
+        workers[i].batch = &batch;
+    }
+
+    int started;
+    for (started = 1; started < threads; ++started) {
+        if (pthread_create(&workers[started].thread, NULL, work, &workers[started]) != 0) {
+            break;
+        }
+    }
+
+    work(&workers[0]);
+
+    for (int i = 1; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    double elapsed = now() - start;
+    pthread_mutex_destroy(&batch.lock);
+
+    if (verbosity) {
+        printf("%s %d files, %d failed, %llu -> %llu bytes in %.2f s (%.1f MB/s)\n",
+            opts->info ? "Read" : "Extracted", batch.done, batch.failed, (unsigned long long)batch.srcBytes, (unsigned long long)batch.dstBytes,
+            elapsed, elapsed > 0.0 ? batch.dstBytes / elapsed / 1e6 : 0.0);
+    }
+
+    free(workers);
+    list_free(&batch.list);
+
+    return batch.retval;
+}
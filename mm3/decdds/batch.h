@@ -0,0 +1,39 @@
+/*
+ * decdds - Midtown Madness 3 CDDS extractor
+ *
+ * License: As is
+ * Author:  Daniel Stien <daniel@stien.org>
+ * URL:     https://github.com/dstien/gameformats
+ */
+
+#ifndef DECDDS_BATCH_H
+#define DECDDS_BATCH_H
+
+#include "decdds.h"
+
+// What to take from each file.
+typedef struct decdds_opts_t {
+    uint32_t faces;     // First cube map faces, 0 for all.
+    uint32_t mips;      // First mip levels, 0 for all.
+    int      info;      // Print the header instead of extracting.
+} decdds_opts_t;
+
+// Output file name, ".cdds" replaced by or appended with ".dds". Caller frees.
+char *decdds_dstname(const char *srcFileName);
+
+// Error message for a decdds_extract() return value.
+const char *decdds_strerror(int retval);
+
+// One line summary of a decoded header.
+void decdds_printinfo(const char *srcFileName, const decdds_info_t *info);
+
+// Whether path names a directory.
+int decdds_isdir(const char *path);
+
+// Extract files, *.cdds files in directories and files named one per line in
+// listFileName on threads workers. Failures are reported per file, directory
+// or list file that can't be read, the first one is returned after all files
+// are done.
+int decdds_batch(char **names, int count, const char *listFileName, int threads, const decdds_opts_t *opts, int verbosity);
+
+#endif
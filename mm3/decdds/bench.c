@@ -0,0 +1,294 @@
+/*
+ * decdds - Midtown Madness 3 CDDS extractor
+ *
+ * License: As is
+ * Author:  Daniel Stien <daniel@stien.org>
+ * URL:     https://github.com/dstien/gameformats
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "decdds.h"
+
+#define BENCH_OUTLEN   (8 << 20)
+#define BENCH_SRCLEN   (BENCH_OUTLEN * 4)
+#define BENCH_CHUNKS   20000
+#define BENCH_TEXSIZE  1024
+
+typedef int (*decode_fn)(decdds_ctx_t *ctx, int numbytes, uint8_t *dst);
+
+static const char *g_names[DECDDS_TAB_COUNT] = { "hdr", "rgb", "dxt1", "dxt23", "dxt45" };
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Random input decodes to a symbol mix matching the code lengths.
+static void fill(uint8_t *data, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        data[i] = seed >> 24;
+    }
+}
+
+// Stream position in bits, including unconsumed lookup bits.
+static size_t position(const decdds_ctx_t *ctx, const uint8_t *src)
+{
+    return (size_t)(ctx->srcptr - 4 - src) * 8 + 32 - ctx->srcbits - ctx->idxbits;
+}
+
+static void start(decdds_ctx_t *ctx, const uint8_t *src, int tab)
+{
+    const uint32_t *tab1;
+    const uint16_t *tab2;
+
+    memset(ctx, 0, sizeof(*ctx));
+    decdds_tables(tab, &tab1, &tab2);
+    decdds_ctx_init(ctx, 0, src);
+    decdds_ctx_reset(ctx, 10, tab1, tab2);
+}
+
+// Decode in chunks of varying size, resetting the tables between some of them.
+static int chunked(decode_fn decode, const uint8_t *src, int tab, uint8_t *dst, size_t *pos)
+{
+    decdds_ctx_t ctx;
+    uint32_t seed = tab;
+    int sum = 0;
+
+    start(&ctx, src, tab);
+
+    for (int i = 0; i < BENCH_CHUNKS; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        int len = (seed >> 16) % 200;
+
+        if (seed & 0x100) {
+            decdds_ctx_reset(&ctx, 10, ctx.tab1, ctx.tab2);
+        }
+
+        sum = sum * 31 + decode(&ctx, len, dst);
+        dst += len;
+    }
+
+    *pos = position(&ctx, src);
+    return sum;
+}
+
+// Time both decoders on one table, fast decoding must match the reference.
+static int bench(int tab, const uint8_t *src, uint8_t *ref, uint8_t *out)
+{
+    decdds_ctx_t refctx, outctx;
+    int retval = 0;
+
+    // Identical output, return values and stream positions.
+    memset(ref, 0xAA, BENCH_OUTLEN + 1);
+    memset(out, 0xAA, BENCH_OUTLEN + 1);
+
+    size_t refpos, outpos;
+    int refsum = chunked(decdds_decode, src, tab, ref, &refpos);
+    int outsum = chunked(decdds_decode_fast, src, tab, out, &outpos);
+
+    if (refsum != outsum || refpos != outpos || memcmp(ref, out, BENCH_OUTLEN + 1)) {
+        fprintf(stderr, "  %s: chunked fast decoding differs from reference\n", g_names[tab]);
+        retval = DECDDS_ERR_INVALIDIMG;
+    }
+
+    start(&refctx, src, tab);
+    double t = now();
+    int refret = decdds_decode(&refctx, BENCH_OUTLEN, ref);
+    double reftime = now() - t;
+
+    start(&outctx, src, tab);
+    t = now();
+    int outret = decdds_decode_fast(&outctx, BENCH_OUTLEN, out);
+    double outtime = now() - t;
+
+    if (refret != outret || position(&refctx, src) != position(&outctx, src) || memcmp(ref, out, BENCH_OUTLEN + 1)) {
+        fprintf(stderr, "  %s: fast decoding differs from reference\n", g_names[tab]);
+        retval = DECDDS_ERR_INVALIDIMG;
+    }
+
+    printf("  %-6s reference: %7.1f MB/s  fast: %7.1f MB/s  (%.2f bits/byte)\n", g_names[tab],
+        BENCH_OUTLEN / reftime / 1e6, BENCH_OUTLEN / outtime / 1e6, (double)position(&refctx, src) / BENCH_OUTLEN);
+
+    return retval;
+}
+
+// DXT5 texture of runs of blocks picked from a small set with some bytes
+// changed, ending on a repeated block so the last byte decodes.
+static uint8_t *texture(uint32_t *len)
+{
+    uint32_t imglen = BENCH_TEXSIZE * BENCH_TEXSIZE;
+    uint8_t *data = (uint8_t*)calloc(sizeof(decdds_ddshdr_t) + 4 + imglen, 1);
+    decdds_ddshdr_t hdr;
+    uint8_t blocks[64][16];
+    uint32_t seed = 1;
+
+    if (data == NULL) {
+        return NULL;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = DECDDS_DDS_MAGIC;
+    hdr.size = sizeof(hdr) - 4;
+    hdr.flags = 0x00081007;
+    hdr.height = hdr.width = BENCH_TEXSIZE;
+    hdr.plsize = imglen;
+    hdr.mips = 1;
+    hdr.pxfmt.size = sizeof(hdr.pxfmt);
+    hdr.pxfmt.flags = DECDDS_FLG_FOURCC;
+    hdr.pxfmt.fourcc = DECDDS_FMT_DXT5;
+    hdr.caps.caps1 = 0x00001000;
+    memcpy(data, &hdr, sizeof(hdr));
+
+    fill(&blocks[0][0], sizeof(blocks), 2);
+
+    uint8_t *img = data + sizeof(hdr);
+    for (uint32_t i = 0; i < imglen; i += 16) {
+        seed = seed * 1664525 + 1013904223;
+        memcpy(img + i, i && (seed & 0xC00) ? img + i - 16 : blocks[seed >> 26], 16);
+
+        if (seed & 0x3000) {
+            img[i + ((seed >> 8) & 15)] ^= (uint8_t)(seed >> 16);
+        }
+    }
+
+    memcpy(img + imglen - 16, img + imglen - 32, 16);
+
+    *len = sizeof(hdr) + imglen;
+    return data;
+}
+
+// Encode and decode a texture, the output must match the input.
+static int roundtrip()
+{
+    uint32_t srcLen, cddsLen, dstLen;
+    uint8_t *srcData = texture(&srcLen);
+    int retval = 0;
+
+    if (srcData == NULL) {
+        fprintf(stderr, "Error: Couldn't allocate memory.\n");
+        return DECDDS_ERR_MEM;
+    }
+
+    printf("Encoding %u bytes of DXT5 texture\n", srcLen);
+
+    for (int level = DECDDS_ENC_GREEDY; !retval && level <= DECDDS_ENC_OPTIMAL; ++level) {
+        uint8_t *cddsData = NULL, *dstData = NULL;
+
+        double t = now();
+        retval = decdds_encode(srcData, srcLen, &cddsData, &cddsLen, level, 0);
+        t = now() - t;
+
+        if (!retval && (retval = decdds_extract(cddsData, cddsLen, &dstData, &dstLen, NULL, NULL)) == 0 && (dstLen != srcLen || memcmp(dstData, srcData, srcLen))) {
+            retval = DECDDS_ERR_INVALIDIMG;
+        }
+
+        if (retval) {
+            fprintf(stderr, "  %s: round trip failed (%d)\n", level == DECDDS_ENC_OPTIMAL ? "optimal" : "greedy", retval);
+        }
+        else {
+            printf("  %-8s %7.1f MB/s  %u bytes (%.2f bits/byte)\n", level == DECDDS_ENC_OPTIMAL ? "optimal" : "greedy",
+                srcLen / t / 1e6, cddsLen, cddsLen * 8.0 / srcLen);
+        }
+
+        free(cddsData);
+        free(dstData);
+    }
+
+    free(srcData);
+    return retval;
+}
+
+// Time extraction of real textures.
+static int files(int count, char *names[])
+{
+    double total = 0.0, totaltime = 0.0;
+    int retval = 0;
+
+    for (int i = 0; i < count; ++i) {
+        FILE *file = fopen(names[i], "rb");
+        uint8_t *srcData = NULL, *dstData = NULL;
+        uint32_t dstLen = 0;
+        long srcLen = -1;
+
+        if (file && fseek(file, 0, SEEK_END) == 0 && (srcLen = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+            srcData = (uint8_t*)malloc(srcLen);
+        }
+
+        if (!srcData || fread(srcData, 1, srcLen, file) != (size_t)srcLen) {
+            fprintf(stderr, "Error: Can't read input file \"%s\".\n", names[i]);
+            retval = DECDDS_ERR_READ;
+        }
+        else {
+            double t = now();
+            int ret = decdds_extract(srcData, (uint32_t)srcLen, &dstData, &dstLen, NULL, NULL);
+            t = now() - t;
+
+            if (ret) {
+                fprintf(stderr, "Error: Decoding \"%s\" failed (%d).\n", names[i], ret);
+                retval = ret;
+            }
+            else {
+                printf("  %s: %u bytes, %.1f MB/s\n", names[i], dstLen, dstLen / t / 1e6);
+                total += dstLen;
+                totaltime += t;
+            }
+        }
+
+        if (file) {
+            fclose(file);
+        }
+        free(srcData);
+        free(dstData);
+    }
+
+    if (totaltime > 0.0) {
+        printf("Total %.0f bytes, %.1f MB/s\n", total, total / totaltime / 1e6);
+    }
+
+    return retval;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1) {
+        return files(argc - 1, argv + 1);
+    }
+
+    uint8_t *src = (uint8_t*)malloc(BENCH_SRCLEN);
+    uint8_t *ref = (uint8_t*)malloc(BENCH_OUTLEN + 1);
+    uint8_t *out = (uint8_t*)malloc(BENCH_OUTLEN + 1);
+    int retval = 0;
+
+    if (!src || !ref || !out) {
+        fprintf(stderr, "Error: Couldn't allocate memory.\n");
+        return DECDDS_ERR_MEM;
+    }
+
+    fill(src, BENCH_SRCLEN, 1);
+
+    printf("Decoding %d bytes of random code streams\n", BENCH_OUTLEN);
+
+    for (int tab = 0; tab < DECDDS_TAB_COUNT; ++tab) {
+        int ret = bench(tab, src, ref, out);
+
+        if (ret && !retval) {
+            retval = ret;
+        }
+    }
+
+    free(src);
+    free(ref);
+    free(out);
+
+    // Divergent decoders fail the run after the round trip has been timed too.
+    int ret = roundtrip();
+    return retval ? retval : ret;
+}
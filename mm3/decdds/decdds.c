@@ -6,6 +6,10 @@
  * URL:     https://github.com/dstien/gameformats
  */
 
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -683,6 +687,15 @@ static const uint16_t g_tab2_dxt45[] = {
     0x7003, 0x7003, 0x7003, 0x7003, 0x7003, 0x7003, 0x7003, 0x7003, 0x90D3, 0x90D3, 0x903E, 0x903E, 0x906F, 0x906F, 0x90CD, 0x90CD
 };
 
+static const uint32_t *g_tab1[DECDDS_TAB_COUNT] = { g_tab1_hdr, g_tab1_rgb, g_tab1_dxt1, g_tab1_dxt23, g_tab1_dxt45 };
+static const uint16_t *g_tab2[DECDDS_TAB_COUNT] = { g_tab2_hdr, g_tab2_rgb, g_tab2_dxt1, g_tab2_dxt23, g_tab2_dxt45 };
+
+void decdds_tables(int tab, const uint32_t **tab1, const uint16_t **tab2)
+{
+    *tab1 = g_tab1[tab];
+    *tab2 = g_tab2[tab];
+}
+
 void decdds_ctx_init(decdds_ctx_t *ctx, uint32_t offset, const uint8_t *srcptr)
 {
     uint8_t shift = offset & (32 - 1);
@@ -691,6 +704,7 @@ void decdds_ctx_init(decdds_ctx_t *ctx, uint32_t offset, const uint8_t *srcptr)
     ctx->srcdword = *((uint32_t*)ctx->srcptr) << shift;
     ctx->srcptr += 4;
     ctx->srcbits = 32 - shift;
+    ctx->srcend = NULL;
 
     ctx->idxcode = 0;
     ctx->idxbits = 0;
@@ -795,25 +809,341 @@ int decdds_decode(decdds_ctx_t *ctx, int numbytes, uint8_t *dst)
     return numbytes;
 }
 
-int decdds_extract(const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, uint32_t *dstLen, int verbosity)
+// Fast decoder tables for the built-in code tables, built once.
+static uint32_t g_fast[DECDDS_TAB_COUNT][1 << DECDDS_FAST_BITS];
+static pthread_once_t g_fast_once = PTHREAD_ONCE_INIT;
+
+// Decode one code from the low avail bits of bits, MSB first, as decdds_decode() would.
+// Returns the code length, or 0 if it depends on bits beyond avail.
+static uint32_t fast_resolve(const uint32_t *tab1, const uint16_t *tab2, uint32_t bits, uint32_t avail, uint32_t *code)
 {
-    decdds_ctx_t ctx;
-    decdds_ddshdr_t hdr;
-    int retval = 0;
+    uint16_t entry;
 
-    if (!srcLen) {
+    if (avail < 10) {
+        // Window incomplete, every completion must agree on a short enough code.
+        uint32_t fill = 10 - avail;
+        entry = tab2[bits << fill];
+
+        for (uint32_t i = 1; i < (1u << fill); ++i) {
+            if (tab2[(bits << fill) | i] != entry) {
+                return 0;
+            }
+        }
+
+        if (DECDDS_TAB2_BITS(entry) > avail) {
+            return 0;
+        }
+    }
+    else {
+        entry = tab2[(bits >> (avail - 10)) & 0x3FF];
+    }
+
+    uint32_t len = DECDDS_TAB2_BITS(entry);
+    uint32_t cur = DECDDS_TAB2_CODE(entry);
+
+    if (len > 10) {
+        len = 10;
+        while (cur < DECDDS_TAB1_MAX) {
+            if (len >= avail) {
+                return 0;
+            }
+
+            if ((bits >> (avail - len - 1)) & 1) {
+                cur += (uint16_t)(tab1[cur] >> 16) + 1;
+            }
+            else {
+                cur += (uint16_t)tab1[cur] + 1;
+            }
+            ++len;
+        }
+
+        cur -= 0x1FF;
+    }
+
+    if (!len || cur > 0x0FFF) {
         return 0;
     }
 
-    decdds_ctx_init(&ctx, 0, srcData);
-    decdds_ctx_reset(&ctx, 10, g_tab1_hdr, g_tab2_hdr);
+    *code = cur;
+    return len;
+}
+
+static void fast_build(void)
+{
+    for (int t = 0; t < DECDDS_TAB_COUNT; ++t) {
+        for (uint32_t v = 0; v < (1 << DECDDS_FAST_BITS); ++v) {
+            uint32_t code, code2;
+            uint32_t len = fast_resolve(g_tab1[t], g_tab2[t], v, DECDDS_FAST_BITS, &code);
+            uint32_t len2 = 0;
+
+            if (!len) {
+                g_fast[t][v] = DECDDS_FAST_ENTRY(0, 0, DECDDS_FAST_SLOW, 0, 0);
+                continue;
+            }
+
+            // Two literals in one lookup when both fit.
+            if (code < 0x100 && len < DECDDS_FAST_BITS) {
+                uint32_t rest = DECDDS_FAST_BITS - len;
+                len2 = fast_resolve(g_tab1[t], g_tab2[t], v & ((1u << rest) - 1), rest, &code2);
+            }
+
+            if (len2 && code2 < 0x100) {
+                g_fast[t][v] = DECDDS_FAST_ENTRY(code, len + len2, DECDDS_FAST_PAIR, code2, len);
+            }
+            else {
+                g_fast[t][v] = DECDDS_FAST_ENTRY(code, len, DECDDS_FAST_SINGLE, 0, len);
+            }
+        }
+    }
+}
+
+static const uint32_t *fast_table(const decdds_ctx_t *ctx)
+{
+    for (int t = 0; t < DECDDS_TAB_COUNT; ++t) {
+        if (ctx->tab1 == g_tab1[t] && ctx->tab2 == g_tab2[t]) {
+            pthread_once(&g_fast_once, fast_build);
+            return g_fast[t];
+        }
+    }
+
+    return NULL;
+}
+
+static inline uint32_t load32(const uint8_t *ptr)
+{
+    uint32_t dword;
+    memcpy(&dword, ptr, sizeof(dword));
+    return dword;
+}
+
+// At least 32 valid bits from bitpos, MSB first, without branching.
+static inline uint64_t peekbits(const uint8_t *base, size_t bitpos)
+{
+    const uint8_t *ptr = base + 4 * (bitpos >> 5);
+    return (((uint64_t)load32(ptr) << 32) | load32(ptr + 4)) << (bitpos & 31);
+}
+
+// Same near the end of the input, reading zeros past it.
+static uint64_t peekbits_tail(const uint8_t *base, size_t bitpos, const uint8_t *end)
+{
+    const uint8_t *ptr = base + 4 * (bitpos >> 5);
+    uint8_t tail[8] = { 0 };
+
+    for (int i = 0; i < 8 && ptr + i < end; ++i) {
+        tail[i] = ptr[i];
+    }
+
+    return (((uint64_t)load32(tail) << 32) | load32(tail + 4)) << (bitpos & 31);
+}
+
+int decdds_decode_fast(decdds_ctx_t *ctx, int numbytes, uint8_t *dst)
+{
+    const uint32_t *fast = fast_table(ctx);
+
+    // Custom tables and pending sequences take the reference path.
+    if (!fast || ctx->numbits != 10 || ctx->bufend != ctx->bufpos) {
+        return decdds_decode(ctx, numbytes, dst);
+    }
+
+    if (!numbytes) {
+        return 0;
+    }
+
+    // Bits in the lookup window are unconsumed, continue from the first of them.
+    const uint8_t *base = ctx->srcptr - 4;
+    int32_t first = 32 - ctx->srcbits - (int32_t)ctx->idxbits;
+    if (first < 0) {
+        base -= 4;
+        first += 32;
+    }
+    size_t bitpos = first;
+
+    // Last bit position where a full peek stays inside the input.
+    size_t safebits = SIZE_MAX;
+    if (ctx->srcend) {
+        safebits = ctx->srcend - base >= 8 ? (size_t)(ctx->srcend - base - 8) * 8 : 0;
+    }
+
+    const uint32_t *tab1 = ctx->tab1;
+    const uint16_t *tab2 = ctx->tab2;
+    uint8_t *out = dst + 1;
+    uint8_t *curdst = dst;
+
+    // Sequences copy straight from earlier output. Output of previous calls
+    // is only in the ring buffer, oldest byte first here.
+    uint8_t hist[DECDDS_BUFLEN];
+    for (int i = 0; i < DECDDS_BUFLEN; ++i) {
+        hist[i] = ctx->buf[(ctx->buflen + i) & DECDDS_BUFMASK];
+    }
+
+    uint32_t seqdist = 0, seqleft = 0;
+
+    while (--numbytes > 0) {
+        uint64_t window = bitpos < safebits ? peekbits(base, bitpos) : peekbits_tail(base, bitpos, ctx->srcend);
+        uint32_t entry = fast[window >> (64 - DECDDS_FAST_BITS)];
+        uint32_t curcode;
+
+        switch (DECDDS_FAST_KIND(entry)) {
+            case DECDDS_FAST_PAIR:
+                // Second literal only if the reference loop would get to it.
+                if (numbytes >= 2) {
+                    *(++curdst) = (uint8_t)DECDDS_FAST_CODE(entry);
+                    *(++curdst) = DECDDS_FAST_LIT(entry);
+                    bitpos += DECDDS_FAST_LEN(entry);
+                    --numbytes;
+                    continue;
+                }
+
+                curcode = DECDDS_FAST_CODE(entry);
+                bitpos += DECDDS_FAST_LEN1(entry);
+                break;
+
+            case DECDDS_FAST_SINGLE:
+                curcode = DECDDS_FAST_CODE(entry);
+                bitpos += DECDDS_FAST_LEN(entry);
+                break;
+
+            default: {
+                // Long code, walk tab1 with the bits following the window.
+                uint16_t code = tab2[window >> 54];
+                curcode = DECDDS_TAB2_CODE(code);
+
+                if (DECDDS_TAB2_BITS(code) > 10) {
+                    window <<= 10;
+                    bitpos += 10;
+
+                    while (curcode < DECDDS_TAB1_MAX) {
+                        if (window >> 63) {
+                            curcode += (uint16_t)(tab1[curcode] >> 16) + 1;
+                        }
+                        else {
+                            curcode += (uint16_t)tab1[curcode] + 1;
+                        }
+
+                        window <<= 1;
+                        ++bitpos;
+                    }
+
+                    curcode -= 0x1FF;
+                }
+                else {
+                    bitpos += DECDDS_TAB2_BITS(code);
+                }
+                break;
+            }
+        }
+
+        // Write single byte.
+        if (curcode < 0x100) {
+            *(++curdst) = (uint8_t)curcode;
+        }
+        // Copy from output, the ring buffer masks the distance to 1-64 bytes.
+        else {
+            uint32_t dist = (DECDDS_SEQ_LOOKBACK(curcode) & DECDDS_BUFMASK) + 1;
+            uint32_t len  = DECDDS_SEQ_LENGTH(curcode) + 2;
+            ptrdiff_t from = (curdst + 1 - out) - (ptrdiff_t)dist;
+
+            ++numbytes;
+            uint32_t count = (uint32_t)numbytes < len ? (uint32_t)numbytes : len;
+            numbytes -= count;
+
+            if (from < 0) {
+                for (uint32_t i = 0; i < count; ++i, ++from) {
+                    *(++curdst) = from < 0 ? hist[DECDDS_BUFLEN + from] : out[from];
+                }
+            }
+            // Two overlapping 8-byte moves cover the longest sequence. The
+            // bytes past it are overwritten by the output that follows.
+            else if (dist >= 8 && numbytes > 16) {
+                uint64_t chunk;
+                memcpy(&chunk, out + from, 8);
+                memcpy(curdst + 1, &chunk, 8);
+                memcpy(&chunk, out + from + 8, 8);
+                memcpy(curdst + 9, &chunk, 8);
+                curdst += count;
+            }
+            else if (dist == 1) {
+                memset(curdst + 1, out[from], count);
+                curdst += count;
+            }
+            else {
+                for (uint32_t i = 0; i < count; ++i) {
+                    *(++curdst) = out[from + i];
+                }
+            }
+
+            if (count < len) {
+                seqdist = dist;
+                seqleft = len - count;
+                break;
+            }
+        }
+    }
+
+    // Leave the context as if read with readbits() and an empty window.
+    const uint8_t *ptr = base + 4 * (bitpos >> 5);
+    uint32_t shift = bitpos & 31;
+
+    ctx->srcdword = (uint32_t)(bitpos < safebits ? peekbits(base, bitpos) >> 32 : peekbits_tail(base, bitpos, ctx->srcend) >> 32);
+    ctx->srcptr = ptr + 4;
+    ctx->srcbits = 32 - shift;
+    ctx->idxcode = 0;
+    ctx->idxbits = 0;
+
+    // Last 64 bytes back into the ring buffer, where the reference path and
+    // sequences crossing the next call expect them.
+    size_t written = curdst - dst;
+    uint32_t buflen = (ctx->buflen + written) & DECDDS_BUFMASK;
+
+    for (uint32_t k = 1; k <= DECDDS_BUFLEN; ++k) {
+        ctx->buf[(buflen - k) & DECDDS_BUFMASK] = k <= written ? curdst[1 - (ptrdiff_t)k] : hist[DECDDS_BUFLEN - (k - written)];
+    }
+
+    ctx->buflen = buflen;
+
+    if (seqleft) {
+        ctx->bufpos = (buflen - seqdist) & DECDDS_BUFMASK;
+        ctx->bufend = (ctx->bufpos + seqleft) & DECDDS_BUFMASK;
+    }
+
+    return numbytes;
+}
+
+// Format a diagnostics line for the caller's callback.
+static void diag(decdds_diag_fn fn, void *user, const char *fmt, ...)
+{
+    char msg[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+
+    fn(user, msg);
+}
+
+// Decode the header and describe the given faces and mips.
+static int readheader(decdds_ctx_t *ctx, const uint8_t *srcData, uint32_t srcLen, uint32_t faces, uint32_t mips, decdds_info_t *info)
+{
+    decdds_ddshdr_t *hdr = &info->hdr;
+    int retval = 0;
+
+    if (srcLen < 4) {
+        return DECDDS_ERR_WRONGTYPE;
+    }
+
+    decdds_ctx_init(ctx, 0, srcData);
+    decdds_ctx_reset(ctx, 10, g_tab1_hdr, g_tab2_hdr);
+    ctx->srcend = srcData + srcLen;
 
-    if (ctx.srcdword != DECDDS_MAGIC) {
+    if (ctx->srcdword != DECDDS_MAGIC) {
         return DECDDS_ERR_WRONGTYPE;
     }
 
-    // Decode header.
-    retval = decdds_decode(&ctx, sizeof(hdr), (uint8_t*)&hdr - 1);
+    // Decode header. The decoder writes from one byte past dst.
+    uint8_t hdrbuf[1 + sizeof(*hdr)];
+    retval = decdds_decode_fast(ctx, sizeof(*hdr), hdrbuf);
+    memcpy(hdr, hdrbuf + 1, sizeof(*hdr));
 
     if (retval < -1) {
         return DECDDS_ERR_EOFHDR;
@@ -822,73 +1152,48 @@ int decdds_extract(const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, u
         return DECDDS_ERR_INVALIDHDR;
     }
 
-    if (hdr.magic != DECDDS_DDS_MAGIC) {
+    return decdds_describe(info, faces, mips);
+}
+
+int decdds_describe(decdds_info_t *info, uint32_t faces, uint32_t mips)
+{
+    decdds_ddshdr_t *hdr = &info->hdr;
+
+    if (hdr->magic != DECDDS_DDS_MAGIC) {
         return DECDDS_ERR_INVALIDHDR;
     }
 
-    if (verbosity > 1) {
-        printf("  header (%lu bytes)\n",    sizeof(hdr));
-        printf("    magic:     \"%.4s\"\n", (char*)&hdr.magic);
-        printf("    size:      %d\n",       hdr.size);
-        printf("    flags:     %#.8x\n",    hdr.flags);
-        printf("    height:    %d\n",       hdr.height);
-        printf("    width:     %d\n",       hdr.width);
-        printf("    plsize:    %d\n",       hdr.plsize);
-        printf("    depth:     %d\n",       hdr.depth);
-        printf("    mips:      %d\n\n",     hdr.mips);
-
-        printf("    pixel format\n");
-        printf("      size:    %d\n",       hdr.pxfmt.size);
-        printf("      flags:   %#.8x\n",    hdr.pxfmt.flags);
-        printf("      fourcc:  \"%.4s\" (%#.8x)\n", (char*)&hdr.pxfmt.fourcc, hdr.pxfmt.fourcc);
-        printf("      rgbbits: %d\n",       hdr.pxfmt.rgbbits);
-        printf("      rmask:   %#.8x\n",    hdr.pxfmt.rmask);
-        printf("      gmask:   %#.8x\n",    hdr.pxfmt.gmask);
-        printf("      bmask:   %#.8x\n",    hdr.pxfmt.bmask);
-        printf("      amask:   %#.8x\n\n",  hdr.pxfmt.amask);
-
-        printf("    caps\n");
-        printf("      caps1:   %#.8x\n",    hdr.caps.caps1);
-        printf("      caps2:   %#.8x\n\n",  hdr.caps.caps2);
-    }
-
-    const uint32_t *tab1;
-    const uint16_t *tab2;
     int bpp;
     int texel;
 
-    switch (hdr.pxfmt.fourcc) {
+    switch (hdr->pxfmt.fourcc) {
         case DECDDS_FMT_DXT1:
-            tab1 = g_tab1_dxt1;
-            tab2 = g_tab2_dxt1;
+            info->tab = DECDDS_TAB_DXT1;
             bpp = 4;
             texel = 1;
             break;
 
         case DECDDS_FMT_DXT2:
         case DECDDS_FMT_DXT3:
-            tab1 = g_tab1_dxt23;
-            tab2 = g_tab2_dxt23;
+            info->tab = DECDDS_TAB_DXT23;
             bpp = 8;
             texel = 1;
             break;
 
         case DECDDS_FMT_DXT4:
         case DECDDS_FMT_DXT5:
-            tab1 = g_tab1_dxt45;
-            tab2 = g_tab2_dxt45;
+            info->tab = DECDDS_TAB_DXT45;
             bpp = 8;
             texel = 1;
             break;
 
         default:
-            if (hdr.pxfmt.flags & DECDDS_FLG_FOURCC) {
+            if (hdr->pxfmt.flags & DECDDS_FLG_FOURCC) {
                 return DECDDS_ERR_UNSUPPFMT;
             }
 
-            tab1 = g_tab1_rgb;
-            tab2 = g_tab2_rgb;
-            bpp = hdr.pxfmt.rgbbits;
+            info->tab = DECDDS_TAB_RGB;
+            bpp = hdr->pxfmt.rgbbits;
             texel = 0;
             break;
     }
@@ -896,46 +1201,141 @@ int decdds_extract(const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, u
     // Find data length for texture/cube/volume with mips at given dimentions/bpp.
     uint32_t images = 1;
 
-    if (hdr.caps.caps2 & DECDDS_CAP_CUBE) {
+    if (hdr->caps.caps2 & DECDDS_CAP_CUBE) {
         images = 0;
-        if (hdr.caps.caps2 & DECDDS_CAP_CUBE_POSX) ++images;
-        if (hdr.caps.caps2 & DECDDS_CAP_CUBE_NEGX) ++images;
-        if (hdr.caps.caps2 & DECDDS_CAP_CUBE_POSY) ++images;
-        if (hdr.caps.caps2 & DECDDS_CAP_CUBE_NEGY) ++images;
-        if (hdr.caps.caps2 & DECDDS_CAP_CUBE_POSZ) ++images;
-        if (hdr.caps.caps2 & DECDDS_CAP_CUBE_NEGZ) ++images;
+        if (hdr->caps.caps2 & DECDDS_CAP_CUBE_POSX) ++images;
+        if (hdr->caps.caps2 & DECDDS_CAP_CUBE_NEGX) ++images;
+        if (hdr->caps.caps2 & DECDDS_CAP_CUBE_POSY) ++images;
+        if (hdr->caps.caps2 & DECDDS_CAP_CUBE_NEGY) ++images;
+        if (hdr->caps.caps2 & DECDDS_CAP_CUBE_POSZ) ++images;
+        if (hdr->caps.caps2 & DECDDS_CAP_CUBE_NEGZ) ++images;
     }
 
-    uint32_t imglen = 0;
-    uint32_t mips = hdr.mips ? hdr.mips : 1;
+    // Faces are stored one after another, each with all its mips.
+    uint32_t facelen = 0, prefixlen = 0;
+    uint32_t allmips = hdr->mips ? hdr->mips : 1;
+
+    faces = faces && faces < images ? faces : images;
+    mips = mips && mips < allmips ? mips : allmips;
 
-    for (uint32_t mip = 0; mip < mips; ++mip) {
-        uint32_t width  = DECDDS_MAX(hdr.width  >> mip, 1);
-        uint32_t height = DECDDS_MAX(hdr.height >> mip, 1);
-        uint32_t slices = (hdr.caps.caps2 & DECDDS_CAP_VOLUME) && (hdr.depth >> mip) ? (hdr.depth >> mip) : 1;
+    for (uint32_t mip = 0; mip < allmips; ++mip) {
+        uint32_t width  = DECDDS_MAX(hdr->width  >> mip, 1);
+        uint32_t height = DECDDS_MAX(hdr->height >> mip, 1);
+        uint32_t slices = (hdr->caps.caps2 & DECDDS_CAP_VOLUME) && (hdr->depth >> mip) ? (hdr->depth >> mip) : 1;
 
         if (texel) {
-            imglen += ((width + 3) / 4) * ((height + 3) / 4) * bpp * 2 * slices * images;
+            facelen += ((width + 3) / 4) * ((height + 3) / 4) * bpp * 2 * slices;
         }
         else {
-            imglen += (width * height * bpp) / 8 * slices * images;
+            facelen += (width * height * bpp) / 8 * slices;
         }
+
+        if (mip + 1 == mips) {
+            prefixlen = facelen;
+        }
+    }
+
+    // Only a prefix of the stream can be decoded.
+    if (faces > 1 && mips < allmips) {
+        return DECDDS_ERR_NOTPREFIX;
     }
 
-    if (verbosity > 1) {
-        printf("  image data (%u bytes)\n\n", imglen);
+    if (mips < allmips) {
+        hdr->mips = mips;
     }
 
-    *dstLen = sizeof(hdr) + imglen;
+    // Drop the faces that aren't kept from the header.
+    if (faces < images) {
+        uint32_t kept = 0;
 
-    if ((*dstData = (uint8_t*)malloc(*dstLen)) == NULL) {
-        return DECDDS_ERR_MEM;
+        for (uint32_t cap = DECDDS_CAP_CUBE_POSX; cap <= DECDDS_CAP_CUBE_NEGZ; cap <<= 1) {
+            if (hdr->caps.caps2 & cap && kept++ >= faces) {
+                hdr->caps.caps2 &= ~cap;
+            }
+        }
     }
 
-    memcpy(*dstData, &hdr, sizeof(hdr));
+    info->images = faces;
+    info->mips = mips;
+    info->streamlen = facelen * images;
+    info->imglen = (faces - 1) * facelen + prefixlen;
+    info->dstlen = sizeof(*hdr) + info->imglen;
 
-    decdds_ctx_reset(&ctx, 10, tab1, tab2);
-    retval = decdds_decode(&ctx, imglen, *dstData + sizeof(hdr) - 1);
+    return 0;
+}
+
+int decdds_peek(const uint8_t *srcData, uint32_t srcLen, decdds_info_t *info)
+{
+    return decdds_peek_part(srcData, srcLen, 0, 0, info);
+}
+
+int decdds_peek_part(const uint8_t *srcData, uint32_t srcLen, uint32_t faces, uint32_t mips, decdds_info_t *info)
+{
+    decdds_ctx_t ctx;
+
+    return readheader(&ctx, srcData, srcLen, faces, mips, info);
+}
+
+int decdds_decode_into(decdds_ctx_t *ctx, const uint8_t *srcData, uint32_t srcLen, uint8_t *dstData, uint32_t dstSize, decdds_diag_fn diagfn, void *user)
+{
+    return decdds_decode_part(ctx, srcData, srcLen, 0, 0, dstData, dstSize, diagfn, user);
+}
+
+int decdds_decode_part(decdds_ctx_t *ctx, const uint8_t *srcData, uint32_t srcLen, uint32_t faces, uint32_t mips, uint8_t *dstData, uint32_t dstSize, decdds_diag_fn diagfn, void *user)
+{
+    decdds_info_t info;
+    int retval;
+
+    if ((retval = readheader(ctx, srcData, srcLen, faces, mips, &info)) != 0) {
+        return retval;
+    }
+
+    const decdds_ddshdr_t *hdr = &info.hdr;
+
+    if (diagfn) {
+        diag(diagfn, user, "  header (%lu bytes)\n",    sizeof(*hdr));
+        diag(diagfn, user, "    magic:     \"%.4s\"\n", (char*)&hdr->magic);
+        diag(diagfn, user, "    size:      %d\n",       hdr->size);
+        diag(diagfn, user, "    flags:     %#.8x\n",    hdr->flags);
+        diag(diagfn, user, "    height:    %d\n",       hdr->height);
+        diag(diagfn, user, "    width:     %d\n",       hdr->width);
+        diag(diagfn, user, "    plsize:    %d\n",       hdr->plsize);
+        diag(diagfn, user, "    depth:     %d\n",       hdr->depth);
+        diag(diagfn, user, "    mips:      %d\n\n",     hdr->mips);
+
+        diag(diagfn, user, "    pixel format\n");
+        diag(diagfn, user, "      size:    %d\n",       hdr->pxfmt.size);
+        diag(diagfn, user, "      flags:   %#.8x\n",    hdr->pxfmt.flags);
+        diag(diagfn, user, "      fourcc:  \"%.4s\" (%#.8x)\n", (char*)&hdr->pxfmt.fourcc, hdr->pxfmt.fourcc);
+        diag(diagfn, user, "      rgbbits: %d\n",       hdr->pxfmt.rgbbits);
+        diag(diagfn, user, "      rmask:   %#.8x\n",    hdr->pxfmt.rmask);
+        diag(diagfn, user, "      gmask:   %#.8x\n",    hdr->pxfmt.gmask);
+        diag(diagfn, user, "      bmask:   %#.8x\n",    hdr->pxfmt.bmask);
+        diag(diagfn, user, "      amask:   %#.8x\n\n",  hdr->pxfmt.amask);
+
+        diag(diagfn, user, "    caps\n");
+        diag(diagfn, user, "      caps1:   %#.8x\n",    hdr->caps.caps1);
+        diag(diagfn, user, "      caps2:   %#.8x\n\n",  hdr->caps.caps2);
+
+        diag(diagfn, user, "  image data (%u bytes)\n\n", info.imglen);
+    }
+
+    if (dstSize < info.dstlen) {
+        return DECDDS_ERR_DSTSIZE;
+    }
+
+    memcpy(dstData, hdr, sizeof(*hdr));
+
+    decdds_ctx_reset(ctx, 10, g_tab1[info.tab], g_tab2[info.tab]);
+    retval = decdds_decode_fast(ctx, info.imglen, dstData + sizeof(*hdr) - 1);
+
+    // A decode call ending on a literal stops one byte short. The full image
+    // is left that way, a prefix gets its last byte from the next code.
+    if (info.imglen < info.streamlen && !retval && ctx->bufpos == ctx->bufend) {
+        uint8_t tail[3];
+        retval = decdds_decode_fast(ctx, 2, tail);
+        dstData[sizeof(*hdr) + info.imglen - 1] = tail[1];
+    }
 
     if (retval < -1) {
         return DECDDS_ERR_EOFIMG;
@@ -946,3 +1346,45 @@ int decdds_extract(const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, u
 
     return 0;
 }
+
+int decdds_extract(const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, uint32_t *dstLen, decdds_diag_fn diagfn, void *user)
+{
+    decdds_ctx_t ctx;
+    uint32_t dstSize = 0;
+
+    *dstData = NULL;
+
+    return decdds_extract_ctx(&ctx, srcData, srcLen, dstData, &dstSize, dstLen, diagfn, user);
+}
+
+int decdds_extract_ctx(decdds_ctx_t *ctx, const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, uint32_t *dstSize, uint32_t *dstLen, decdds_diag_fn diagfn, void *user)
+{
+    decdds_info_t info;
+    int retval;
+
+    *dstLen = 0;
+
+    if (!srcLen) {
+        return 0;
+    }
+
+    if ((retval = readheader(ctx, srcData, srcLen, 0, 0, &info)) != 0) {
+        return retval;
+    }
+
+    // Grow the caller's buffer if needed.
+    if (*dstSize < info.dstlen) {
+        free(*dstData);
+        *dstSize = 0;
+
+        if ((*dstData = (uint8_t*)malloc(info.dstlen)) == NULL) {
+            return DECDDS_ERR_MEM;
+        }
+
+        *dstSize = info.dstlen;
+    }
+
+    *dstLen = info.dstlen;
+
+    return decdds_decode_into(ctx, srcData, srcLen, *dstData, *dstSize, diagfn, user);
+}
@@ -11,8 +11,13 @@
 
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define DECDDS_BANNER          "decdds - Midtown Madness 3 CDDS extractor (2013-09-17)\n\n"
-#define DECDDS_USAGE           "Usage: decdds [-v] [-q] infile.cdds [outfile.dds]\n"
+#define DECDDS_USAGE           "Usage: decdds [-v] [-q] [-i] [-f faces] [-m mips] infile.cdds [outfile.dds]\n" \
+                               "       decdds [-v] [-q] [-i] [-f faces] [-m mips] [-j threads] [-l listfile] -b infile.cdds|dir ...\n"
 
 #define DECDDS_MAGIC           0x990F44C8
 #define DECDDS_DDS_MAGIC       0x20534444
@@ -42,6 +47,30 @@
 #define DECDDS_SEQ_LENGTH(x)   (((x) - 0x100) & 7)
 #define DECDDS_MAX(x, y)       ((x) > (y) ? (x) : (y))
 
+// Built-in code tables.
+#define DECDDS_TAB_HDR         0
+#define DECDDS_TAB_RGB         1
+#define DECDDS_TAB_DXT1        2
+#define DECDDS_TAB_DXT23       3
+#define DECDDS_TAB_DXT45       4
+#define DECDDS_TAB_COUNT       5
+
+// Fast decoder lookup: code, total length, kind, second literal and first length.
+#define DECDDS_FAST_BITS       12
+#define DECDDS_FAST_SLOW       0
+#define DECDDS_FAST_SINGLE     1
+#define DECDDS_FAST_PAIR       2
+#define DECDDS_FAST_ENTRY(code, len, kind, lit, len1) ((code) | ((len) << 12) | ((kind) << 17) | ((uint32_t)(lit) << 19) | ((uint32_t)(len1) << 27))
+#define DECDDS_FAST_CODE(x)    ((x) & 0x0FFF)
+#define DECDDS_FAST_LEN(x)     (((x) >> 12) & 0x1F)
+#define DECDDS_FAST_KIND(x)    (((x) >> 17) & 3)
+#define DECDDS_FAST_LIT(x)     ((uint8_t)((x) >> 19))
+#define DECDDS_FAST_LEN1(x)    ((x) >> 27)
+
+// Match search for decdds_encode().
+#define DECDDS_ENC_GREEDY      0
+#define DECDDS_ENC_OPTIMAL     1
+
 #define DECDDS_ERR_USAGE        -1
 #define DECDDS_ERR_MEM          -2
 #define DECDDS_ERR_OPEN         -3
@@ -53,10 +82,14 @@
 #define DECDDS_ERR_EOFIMG       -9
 #define DECDDS_ERR_INVALIDHDR  -10
 #define DECDDS_ERR_INVALIDIMG  -11
+#define DECDDS_ERR_DSTSIZE     -12
+#define DECDDS_ERR_NOTPREFIX   -13
+#define DECDDS_ERR_NOTAIL      -14
 
 // Context variables for decompression routine.
 typedef struct decdds_ctx_t {
     const uint8_t  *srcptr;
+    const uint8_t  *srcend;     // Optional, bounds reads of the fast decoder.
     uint32_t        srcdword;
     int32_t         srcbits;
 
@@ -106,12 +139,70 @@ typedef struct decdds_ddshdr_t {
     uint32_t reserved2;
 } decdds_ddshdr_t;
 
+// Decoded header and the sizes it implies. With a face or mip limit, the
+// header, counts and lengths describe the partial DDS file.
+typedef struct decdds_info_t {
+    decdds_ddshdr_t hdr;
+    int             tab;        // Image code table, DECDDS_TAB_*.
+    uint32_t        images;     // Cube map faces, 1 otherwise.
+    uint32_t        mips;
+    uint32_t        streamlen;  // Image data in the stream.
+    uint32_t        imglen;     // Image data following the header.
+    uint32_t        dstlen;     // DDS file size, header included.
+} decdds_info_t;
+
+// Diagnostics output, one line per call.
+typedef void (*decdds_diag_fn)(void *user, const char *msg);
+
+void decdds_tables(int tab, const uint32_t **tab1, const uint16_t **tab2);
+
 void decdds_ctx_init(decdds_ctx_t *ctx, uint32_t offset, const uint8_t *srcptr);
 
 void decdds_ctx_reset(decdds_ctx_t *ctx, int32_t numbits, const uint32_t *tab1, const uint16_t *tab2);
 
 int decdds_decode(decdds_ctx_t *ctx, int numbytes, uint8_t *dst);
 
-int decdds_extract(const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, uint32_t *dstLen, int verbosity);
+// Same output and return value as decdds_decode(), decoding from a 64-bit
+// bit buffer with wide lookup tables for the built-in code tables. Sequences
+// are copied within dst, the ring buffer is only updated on return.
+int decdds_decode_fast(decdds_ctx_t *ctx, int numbytes, uint8_t *dst);
+
+// Fill in info from a DDS header in info->hdr, limited to the first faces
+// and mips like decdds_decode_part().
+int decdds_describe(decdds_info_t *info, uint32_t faces, uint32_t mips);
+
+// Decode the header only, info->dstlen is the buffer size decdds_decode_into() needs.
+int decdds_peek(const uint8_t *srcData, uint32_t srcLen, decdds_info_t *info);
+
+// Same for decdds_decode_part() with the same limits.
+int decdds_peek_part(const uint8_t *srcData, uint32_t srcLen, uint32_t faces, uint32_t mips, decdds_info_t *info);
+
+// Decode a DDS file into dstData, which holds dstSize bytes. Header details go
+// to diagfn if given. Allocates nothing and doesn't print.
+int decdds_decode_into(decdds_ctx_t *ctx, const uint8_t *srcData, uint32_t srcLen, uint8_t *dstData, uint32_t dstSize, decdds_diag_fn diagfn, void *user);
+
+// Decode only the first faces cube map faces or the first mips mip levels, 0
+// for all, and stop. Both limits together only work on the first face, other
+// combinations aren't a prefix of the stream and give DECDDS_ERR_NOTPREFIX.
+int decdds_decode_part(decdds_ctx_t *ctx, const uint8_t *srcData, uint32_t srcLen, uint32_t faces, uint32_t mips, uint8_t *dstData, uint32_t dstSize, decdds_diag_fn diagfn, void *user);
+
+// Decode into a new buffer, freed by the caller.
+int decdds_extract(const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, uint32_t *dstLen, decdds_diag_fn diagfn, void *user);
+
+// Same as decdds_extract() with a caller-provided context. dstData holds
+// dstSize bytes and is only reallocated when the image doesn't fit, so a
+// context and buffer can be reused over many files.
+int decdds_extract_ctx(decdds_ctx_t *ctx, const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, uint32_t *dstSize, uint32_t *dstLen, decdds_diag_fn diagfn, void *user);
+
+// Compress a DDS file into a new buffer with the built-in code tables, freed
+// by the caller. Image data is parsed in chunks on threads workers, 0 for one
+// per CPU, with the same output for any count. The decoder only reaches the
+// last byte through a sequence, if the last bytes don't repeat data within 32
+// bytes the stream is still complete but DECDDS_ERR_NOTAIL is returned.
+int decdds_encode(const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, uint32_t *dstLen, int level, int threads);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
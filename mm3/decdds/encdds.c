@@ -0,0 +1,503 @@
+/*
+ * decdds - Midtown Madness 3 CDDS extractor
+ *
+ * License: As is
+ * Author:  Daniel Stien <daniel@stien.org>
+ * URL:     https://github.com/dstien/gameformats
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "decdds.h"
+
+#define ENC_HDRLEN      128
+#define ENC_MAXDIST     DECDDS_BUFLEN
+#define ENC_MINLEN      2
+#define ENC_MAXLEN      9
+#define ENC_CHUNK       0x40000
+
+// Bits of a code, MSB first, and its length. Zero length if the table has none.
+typedef struct enc_code_t {
+    uint32_t bits;
+    uint32_t len;
+} enc_code_t;
+
+// Shortest code for every literal and every sequence distance/length.
+typedef struct enc_table_t {
+    enc_code_t lit[0x100];
+    enc_code_t seq[ENC_MAXDIST][ENC_MAXLEN - ENC_MINLEN + 1];
+} enc_table_t;
+
+static enc_table_t g_enc[DECDDS_TAB_COUNT];
+static pthread_once_t g_enc_once = PTHREAD_ONCE_INIT;
+
+// Image symbols: literals below 0x100, then distance and length as decoded.
+#define ENC_SEQ(dist, len)       (0x100 + (((dist) - 1) << 3) + (len) - ENC_MINLEN)
+#define ENC_SEQ_DIST(sym)        ((DECDDS_SEQ_LOOKBACK(sym) & DECDDS_BUFMASK) + 1)
+#define ENC_SEQ_LEN(sym)         (DECDDS_SEQ_LENGTH(sym) + ENC_MINLEN)
+
+static void enc_add(enc_code_t *codes, uint32_t sym, uint32_t bits, uint32_t len)
+{
+    if (sym < 0x1000 && (!codes[sym].len || len < codes[sym].len)) {
+        codes[sym].bits = bits;
+        codes[sym].len = len;
+    }
+}
+
+// Invert the decoder tables. Short codes are prefixes of the lookup index,
+// escapes continue with the tab1 walk from the full index.
+static void enc_build(void)
+{
+    static enc_code_t codes[0x1000];
+
+    for (int t = 0; t < DECDDS_TAB_COUNT; ++t) {
+        const uint32_t *tab1;
+        const uint16_t *tab2;
+
+        decdds_tables(t, &tab1, &tab2);
+        memset(codes, 0, sizeof(codes));
+
+        for (uint32_t idx = 0; idx < 0x400; ++idx) {
+            uint32_t len = DECDDS_TAB2_BITS(tab2[idx]);
+            uint32_t code = DECDDS_TAB2_CODE(tab2[idx]);
+
+            if (!len) {
+                continue;
+            }
+
+            if (len <= 10) {
+                enc_add(codes, code, idx >> (10 - len), len);
+                continue;
+            }
+
+            // Depth-first over the escape tree, 15 levels at most.
+            struct { uint32_t code, bits, depth; } stack[32];
+            int top = 0;
+
+            stack[top].code = code;
+            stack[top].bits = idx;
+            stack[top++].depth = 0;
+
+            while (top) {
+                --top;
+                uint32_t cur = stack[top].code, bits = stack[top].bits, depth = stack[top].depth;
+
+                if (cur >= DECDDS_TAB1_MAX) {
+                    enc_add(codes, cur - 0x1FF, bits, 10 + depth);
+                    continue;
+                }
+
+                if (depth == 15) {
+                    continue;
+                }
+
+                stack[top].code = cur + (uint16_t)tab1[cur] + 1;
+                stack[top].bits = bits << 1;
+                stack[top++].depth = depth + 1;
+
+                stack[top].code = cur + (uint16_t)(tab1[cur] >> 16) + 1;
+                stack[top].bits = bits << 1 | 1;
+                stack[top++].depth = depth + 1;
+            }
+        }
+
+        enc_table_t *enc = &g_enc[t];
+        memcpy(enc->lit, codes, sizeof(enc->lit));
+
+        // Lookback is masked by the ring size, take the shortest alias.
+        for (uint32_t sym = 0x100; sym < 0x1000; ++sym) {
+            enc_code_t *seq = &enc->seq[ENC_SEQ_DIST(sym) - 1][ENC_SEQ_LEN(sym) - ENC_MINLEN];
+
+            if (codes[sym].len && (!seq->len || codes[sym].len < seq->len)) {
+                *seq = codes[sym];
+            }
+        }
+    }
+}
+
+// Best sequence at pos, referring no further back than lo and ending by end.
+// Returns the symbol and its saving over literals in bits, or 0.
+static uint32_t enc_match(const enc_table_t *enc, const uint8_t *data, uint32_t lo, uint32_t pos, uint32_t end, int32_t *saving)
+{
+    uint32_t maxdist = pos - lo < ENC_MAXDIST ? pos - lo : ENC_MAXDIST;
+    uint32_t maxlen = end - pos < ENC_MAXLEN ? end - pos : ENC_MAXLEN;
+    uint32_t best = 0;
+
+    *saving = 0;
+
+    if (maxlen < ENC_MINLEN) {
+        return 0;
+    }
+
+    // Literal cost of the next bytes.
+    int32_t litcost[ENC_MAXLEN + 1];
+    litcost[0] = 0;
+    for (uint32_t i = 0; i < maxlen; ++i) {
+        litcost[i + 1] = litcost[i] + (int32_t)enc->lit[data[pos + i]].len;
+    }
+
+    for (uint32_t dist = 1; dist <= maxdist; ++dist) {
+        const uint8_t *src = data + pos - dist;
+
+        if (src[0] != data[pos] || src[1] != data[pos + 1]) {
+            continue;
+        }
+
+        uint32_t len = ENC_MINLEN;
+        while (len < maxlen && src[len] == data[pos + len]) {
+            ++len;
+        }
+
+        for (; len >= ENC_MINLEN; --len) {
+            const enc_code_t *code = &enc->seq[dist - 1][len - ENC_MINLEN];
+
+            if (code->len && litcost[len] - (int32_t)code->len > *saving) {
+                *saving = litcost[len] - (int32_t)code->len;
+                best = ENC_SEQ(dist, len);
+            }
+        }
+    }
+
+    return best;
+}
+
+// Shortest code sequence for data[begin, end), found backwards from the end.
+// Returns the symbol count or 0 if out of memory.
+static uint32_t enc_optimal(const enc_table_t *enc, const uint8_t *data, uint32_t lo, uint32_t begin, uint32_t end, uint16_t *syms)
+{
+    uint32_t len = end - begin;
+    uint32_t *cost = (uint32_t*)malloc((len + 1) * sizeof(uint32_t));
+    uint16_t *choice = (uint16_t*)malloc(len * sizeof(uint16_t));
+    uint32_t count = 0;
+
+    if (cost == NULL || choice == NULL) {
+        free(cost);
+        free(choice);
+        return 0;
+    }
+
+    cost[len] = 0;
+
+    for (uint32_t i = len; i-- > 0;) {
+        uint32_t pos = begin + i;
+        uint32_t maxdist = pos - lo < ENC_MAXDIST ? pos - lo : ENC_MAXDIST;
+        uint32_t maxlen = len - i < ENC_MAXLEN ? len - i : ENC_MAXLEN;
+
+        cost[i] = cost[i + 1] + enc->lit[data[pos]].len;
+        choice[i] = data[pos];
+
+        for (uint32_t dist = 1; dist <= maxdist && maxlen >= ENC_MINLEN; ++dist) {
+            const uint8_t *src = data + pos - dist;
+
+            for (uint32_t l = 0; l < maxlen && src[l] == data[pos + l]; ++l) {
+                const enc_code_t *code = &enc->seq[dist - 1][l + 1 - ENC_MINLEN];
+
+                if (l + 1 >= ENC_MINLEN && code->len && cost[i + l + 1] + code->len < cost[i]) {
+                    cost[i] = cost[i + l + 1] + code->len;
+                    choice[i] = (uint16_t)ENC_SEQ(dist, l + 1);
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < len; i += choice[i] < 0x100 ? 1 : ENC_SEQ_LEN(choice[i])) {
+        syms[count++] = choice[i];
+    }
+
+    free(cost);
+    free(choice);
+
+    return count;
+}
+
+// Parse data[begin, end) into symbols, taking the sequence saving the most
+// bits over literals at each position, or the shortest parse overall.
+static uint32_t enc_parse(const enc_table_t *enc, const uint8_t *data, uint32_t lo, uint32_t begin, uint32_t end, int level, uint16_t *syms)
+{
+    uint32_t count = 0;
+    uint32_t pos = begin;
+    int32_t saving;
+
+    if (level == DECDDS_ENC_OPTIMAL) {
+        return enc_optimal(enc, data, lo, begin, end, syms);
+    }
+
+    while (pos < end) {
+        uint32_t sym = enc_match(enc, data, lo, pos, end, &saving);
+
+        if (sym) {
+            syms[count++] = (uint16_t)sym;
+            pos += ENC_SEQ_LEN(sym);
+        }
+        else {
+            syms[count++] = data[pos++];
+        }
+    }
+
+    return count;
+}
+
+// Find the shortest closing sequence ending exactly at end. The decoder only
+// gets to the last byte through a sequence.
+static uint32_t enc_tail(const enc_table_t *enc, const uint8_t *data, uint32_t lo, uint32_t begin, uint32_t end, uint32_t *pos)
+{
+    for (uint32_t len = ENC_MINLEN; len <= ENC_MAXLEN && end - begin >= len; ++len) {
+        uint32_t at = end - len;
+
+        for (uint32_t dist = 1; dist <= ENC_MAXDIST && dist <= at - lo; ++dist) {
+            if (enc->seq[dist - 1][len - ENC_MINLEN].len && !memcmp(data + at - dist, data + at, len)) {
+                *pos = at;
+                return ENC_SEQ(dist, len);
+            }
+        }
+    }
+
+    return 0;
+}
+
+typedef struct enc_job_t {
+    const enc_table_t *enc;
+    const uint8_t     *data;
+    uint32_t           lo;
+    uint32_t           begin;
+    uint32_t           end;
+    uint32_t           chunks;
+    int                level;
+    uint16_t          *syms;
+    uint32_t          *counts;
+
+    uint32_t           next;
+    pthread_mutex_t    lock;
+} enc_job_t;
+
+// Chunks are parsed independently, the window is plain input data.
+static void *enc_work(void *arg)
+{
+    enc_job_t *job = (enc_job_t*)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        uint32_t chunk = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        if (chunk >= job->chunks) {
+            break;
+        }
+
+        uint32_t begin = job->begin + chunk * ENC_CHUNK;
+        uint32_t end = job->end - begin > ENC_CHUNK ? begin + ENC_CHUNK : job->end;
+
+        job->counts[chunk] = enc_parse(job->enc, job->data, job->lo, begin, end, job->level, job->syms + (begin - job->begin));
+    }
+
+    return NULL;
+}
+
+// Bit writer, MSB first into little-endian dwords like readbits() expects.
+typedef struct enc_bits_t {
+    uint8_t  *ptr;
+    uint64_t  acc;
+    uint32_t  accbits;
+} enc_bits_t;
+
+static inline void enc_put(enc_bits_t *out, const enc_code_t *code)
+{
+    out->acc = out->acc << code->len | code->bits;
+    out->accbits += code->len;
+
+    if (out->accbits >= 32) {
+        out->accbits -= 32;
+        uint32_t dword = (uint32_t)(out->acc >> out->accbits);
+        memcpy(out->ptr, &dword, 4);
+        out->ptr += 4;
+    }
+}
+
+static inline const enc_code_t *enc_code(const enc_table_t *enc, uint32_t sym)
+{
+    return sym < 0x100 ? &enc->lit[sym] : &enc->seq[ENC_SEQ_DIST(sym) - 1][ENC_SEQ_LEN(sym) - ENC_MINLEN];
+}
+
+int decdds_encode(const uint8_t *srcData, uint32_t srcLen, uint8_t **dstData, uint32_t *dstLen, int level, int threads)
+{
+    decdds_info_t info;
+    int retval;
+
+    *dstData = NULL;
+    *dstLen = 0;
+
+    if (srcLen < ENC_HDRLEN) {
+        return DECDDS_ERR_EOFHDR;
+    }
+
+    memcpy(&info.hdr, srcData, sizeof(info.hdr));
+
+    if ((retval = decdds_describe(&info, 0, 0)) != 0) {
+        return retval;
+    }
+
+    if (srcLen < info.dstlen || info.imglen < ENC_MINLEN) {
+        return DECDDS_ERR_EOFIMG;
+    }
+
+    pthread_once(&g_enc_once, enc_build);
+
+    const enc_table_t *hdrenc = &g_enc[DECDDS_TAB_HDR];
+    const enc_table_t *imgenc = &g_enc[info.tab];
+    uint32_t hdrpos, imgpos;
+    uint32_t hdrtail = enc_tail(hdrenc, srcData, 0, 0, ENC_HDRLEN, &hdrpos);
+    // Images may refer to the end of the header left in the ring buffer.
+    uint32_t imglo = ENC_HDRLEN - ENC_MAXDIST;
+    uint32_t imgtail = enc_tail(imgenc, srcData, imglo, ENC_HDRLEN, info.dstlen, &imgpos);
+
+    if (!hdrtail) {
+        return DECDDS_ERR_INVALIDHDR;
+    }
+
+    // Otherwise the last byte ends up a literal the decoder stops short of,
+    // like in the game's files.
+    if (!imgtail) {
+        imgpos = info.dstlen;
+    }
+
+    uint16_t *syms = (uint16_t*)malloc((info.dstlen + 2) * sizeof(uint16_t));
+    enc_job_t job;
+
+    job.enc = imgenc;
+    job.data = srcData;
+    job.lo = imglo;
+    job.begin = ENC_HDRLEN;
+    job.end = imgpos;
+    job.chunks = (imgpos - ENC_HDRLEN + ENC_CHUNK - 1) / ENC_CHUNK;
+    job.level = level;
+    job.syms = syms ? syms + ENC_HDRLEN + 1 : NULL;
+    job.counts = (uint32_t*)calloc(job.chunks + 1, sizeof(uint32_t));
+    job.next = 0;
+
+    if (syms == NULL || job.counts == NULL) {
+        free(syms);
+        free(job.counts);
+        return DECDDS_ERR_MEM;
+    }
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    if ((uint32_t)threads > job.chunks) {
+        threads = job.chunks ? job.chunks : 1;
+    }
+
+    pthread_t *workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    int started = 1;
+
+    pthread_mutex_init(&job.lock, NULL);
+
+    // The calling thread is the first worker, and parses the header meanwhile.
+    if (workers) {
+        for (; started < threads; ++started) {
+            if (pthread_create(&workers[started], NULL, enc_work, &job) != 0) {
+                break;
+            }
+        }
+    }
+
+    uint32_t hdrcount = enc_parse(hdrenc, srcData, 0, 0, hdrpos, level, syms);
+    int failed = hdrpos && !hdrcount;
+    syms[hdrcount++] = (uint16_t)hdrtail;
+
+    enc_work(&job);
+
+    for (int i = 1; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&job.lock);
+    free(workers);
+
+    // Only empty chunks have no symbols, unless out of memory.
+    for (uint32_t chunk = 0; chunk < job.chunks; ++chunk) {
+        failed |= !job.counts[chunk];
+    }
+
+    if (failed) {
+        free(syms);
+        free(job.counts);
+        return DECDDS_ERR_MEM;
+    }
+
+    // Exact output size, then emit the symbols in stream order.
+    uint64_t bits = 0;
+
+    for (uint32_t i = 0; i < hdrcount; ++i) {
+        bits += enc_code(hdrenc, syms[i])->len;
+    }
+
+    for (uint32_t chunk = 0; chunk < job.chunks; ++chunk) {
+        const uint16_t *cur = job.syms + chunk * ENC_CHUNK;
+
+        for (uint32_t i = 0; i < job.counts[chunk]; ++i) {
+            bits += enc_code(imgenc, cur[i])->len;
+        }
+    }
+
+    if (imgtail) {
+        bits += enc_code(imgenc, imgtail)->len;
+    }
+
+    // Whole dwords and one more, the decoders read ahead.
+    *dstLen = (uint32_t)((bits + 31) / 32 + 1) * 4;
+
+    if (bits > (uint64_t)UINT32_MAX * 4 || (*dstData = (uint8_t*)calloc(*dstLen, 1)) == NULL) {
+        free(syms);
+        free(job.counts);
+        *dstLen = 0;
+        return DECDDS_ERR_MEM;
+    }
+
+    enc_bits_t out = { *dstData, 0, 0 };
+
+    for (uint32_t i = 0; i < hdrcount; ++i) {
+        enc_put(&out, enc_code(hdrenc, syms[i]));
+    }
+
+    for (uint32_t chunk = 0; chunk < job.chunks; ++chunk) {
+        const uint16_t *cur = job.syms + chunk * ENC_CHUNK;
+
+        for (uint32_t i = 0; i < job.counts[chunk]; ++i) {
+            enc_put(&out, enc_code(imgenc, cur[i]));
+        }
+    }
+
+    if (imgtail) {
+        enc_put(&out, enc_code(imgenc, imgtail));
+    }
+
+    if (out.accbits) {
+        uint32_t dword = (uint32_t)(out.acc << (32 - out.accbits));
+        memcpy(out.ptr, &dword, 4);
+    }
+
+    free(syms);
+    free(job.counts);
+
+    // The magic is the start of the header code stream, as the game's files have it.
+    uint32_t magic;
+    memcpy(&magic, *dstData, 4);
+
+    if (magic != DECDDS_MAGIC) {
+        free(*dstData);
+        *dstData = NULL;
+        *dstLen = 0;
+        return DECDDS_ERR_INVALIDHDR;
+    }
+
+    return imgtail ? 0 : DECDDS_ERR_NOTAIL;
+}
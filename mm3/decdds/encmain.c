@@ -0,0 +1,211 @@
+/*
+ * decdds - Midtown Madness 3 CDDS extractor
+ *
+ * License: As is
+ * Author:  Daniel Stien <daniel@stien.org>
+ * URL:     https://github.com/dstien/gameformats
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "batch.h"
+#include "decdds.h"
+#include "file.h"
+
+#define ENCDDS_USAGE "Usage: encdds [-v] [-q] [-g] [-j threads] infile.dds [outfile.cdds]\n"
+
+void panic(const char *fmt)
+{
+    fprintf(stderr, "%s", fmt);
+    abort();
+}
+
+void usage()
+{
+    fprintf(stderr, ENCDDS_USAGE);
+    exit(DECDDS_ERR_USAGE);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Output file name, ".dds" replaced by or appended with ".cdds". Caller frees.
+static char *dstname(const char *srcFileName)
+{
+    size_t len = strlen(srcFileName);
+    char *dstFileName = (char*)malloc(len + 6);
+
+    if (dstFileName == NULL) {
+        return NULL;
+    }
+
+    if (len > 4 && !strcasecmp(srcFileName + len - 4, ".dds")) {
+        len -= 4;
+    }
+
+    memcpy(dstFileName, srcFileName, len);
+    strcpy(dstFileName + len, ".cdds");
+
+    return dstFileName;
+}
+
+int main(int argc, const char* argv[])
+{
+    char *srcFileName = NULL, *dstFileName = NULL;
+    char *threadsArg = NULL, **switchArg = NULL;
+    int level = DECDDS_ENC_OPTIMAL;
+    int threads = 0;
+    int verbosity = 1;
+    int tail = 0;
+    decdds_file_t srcFile;
+    uint8_t *dstData = NULL, *chkData = NULL;
+    uint32_t dstLen = 0, chkLen = 0;
+    FILE *dstFile;
+    int retval;
+
+    // Parse options.
+    for (int i = 1; i < argc; ++i) {
+        // Switch argument
+        if (switchArg != NULL) {
+            *switchArg = (char*)argv[i];
+            switchArg = NULL;
+        }
+        // Switches
+        else if (argv[i][0] == '-') {
+            for (int j = 1; argv[i][j] != 0; ++j) {
+                switch (argv[i][j]) {
+                    case 'h':
+                    case '?':
+                        printf(DECDDS_BANNER);
+                        printf(ENCDDS_USAGE"\n");
+                        printf("Options:\n");
+                        printf("  -v    increase verbosity\n");
+                        printf("  -q    quiet\n");
+                        printf("  -g    greedy match search, faster and larger\n");
+                        printf("  -j N  use N threads, defaults to CPU count\n");
+                        printf("  -?    this helpful output\n\n");
+                        return 0;
+
+                    case 'v':
+                        ++verbosity;
+                        break;
+
+                    case 'q':
+                        verbosity = 0;
+                        break;
+
+                    case 'g':
+                        level = DECDDS_ENC_GREEDY;
+                        break;
+
+                    case 'j':
+                        switchArg = &threadsArg;
+                        break;
+
+                    default:
+                        usage();
+                }
+            }
+        }
+        // Input file name
+        else if (srcFileName == NULL) {
+            srcFileName = (char*)argv[i];
+        }
+        // Output file name
+        else if (dstFileName == NULL) {
+            dstFileName = (char*)argv[i];
+        }
+        else {
+            usage();
+        }
+    }
+
+    // No input file name given or switch argument missing.
+    if (srcFileName == NULL || switchArg != NULL) {
+        usage();
+    }
+
+    if (threadsArg != NULL && (threads = atoi(threadsArg)) <= 0) {
+        usage();
+    }
+
+    // Generate output file name if not specified.
+    if (dstFileName == NULL && (dstFileName = dstname(srcFileName)) == NULL) {
+        panic("malloc() failed.\n");
+    }
+
+    if (verbosity) {
+        printf(DECDDS_BANNER);
+    }
+
+    if ((retval = decdds_file_open(&srcFile, srcFileName)) != 0) {
+        fprintf(stderr, "Error: Can't %s input file \"%s\".\n", retval == DECDDS_ERR_OPEN ? "open" : "read", srcFileName);
+        return retval;
+    }
+
+    if (verbosity) {
+        printf("Reading \"%s\" (%u bytes)\n", srcFileName, srcFile.len);
+    }
+
+    double t = now();
+    retval = decdds_encode(srcFile.data, srcFile.len, &dstData, &dstLen, level, threads);
+    t = now() - t;
+
+    // Still written, but the decoder leaves the last byte out.
+    if (retval == DECDDS_ERR_NOTAIL) {
+        if (verbosity) {
+            printf("Warning: %s.\n", decdds_strerror(retval));
+        }
+
+        tail = 1;
+        retval = 0;
+    }
+
+    // Round trip, the decoder must give back the input.
+    if (!retval && (retval = decdds_extract(dstData, dstLen, &chkData, &chkLen, NULL, NULL)) == 0 && (chkLen > srcFile.len || memcmp(chkData, srcFile.data, chkLen - tail))) {
+        retval = DECDDS_ERR_INVALIDIMG;
+    }
+
+    if (retval) {
+        fprintf(stderr, "Error: %s.\n", decdds_strerror(retval));
+    }
+    else {
+        if (verbosity > 1) {
+            printf("Encoded %u bytes in %.2f s (%.1f MB/s), %.1f%%\n", chkLen, t, t > 0.0 ? chkLen / t / 1e6 : 0.0, 100.0 * dstLen / chkLen);
+        }
+
+        if (chkLen < srcFile.len && verbosity) {
+            printf("Ignoring %u bytes past the image data\n", srcFile.len - chkLen);
+        }
+
+        if ((dstFile = fopen(dstFileName, "wb")) == NULL) {
+            fprintf(stderr, "Error: Can't create output file \"%s\".\n", dstFileName);
+            retval = DECDDS_ERR_OPEN;
+        }
+        else {
+            if (fwrite(dstData, 1, dstLen, dstFile) != dstLen) {
+                fprintf(stderr, "Error: Can't write output file \"%s\".\n", dstFileName);
+                retval = DECDDS_ERR_WRITE;
+            }
+            else if (verbosity) {
+                printf("Writing \"%s\" (%u bytes)\n", dstFileName, dstLen);
+            }
+
+            fclose(dstFile);
+        }
+    }
+
+    decdds_file_close(&srcFile);
+    free(dstData);
+    free(chkData);
+
+    return retval;
+}
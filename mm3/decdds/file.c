@@ -0,0 +1,234 @@
+/*
+ * decdds - Midtown Madness 3 CDDS extractor
+ *
+ * License: As is
+ * Author:  Daniel Stien <daniel@stien.org>
+ * URL:     https://github.com/dstien/gameformats
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.h"
+
+// Read into memory, growing the buffer as needed.
+static int readall(int fd, decdds_file_t *file)
+{
+    uint8_t *data = NULL;
+    size_t size = 0, len = 0;
+
+    for (;;) {
+        if (len == size) {
+            size = size ? size * 2 : 0x10000;
+
+            uint8_t *grown = (uint8_t*)realloc(data, size);
+            if (grown == NULL || size > UINT32_MAX) {
+                free(grown ? grown : data);
+                return DECDDS_ERR_MEM;
+            }
+
+            data = grown;
+        }
+
+        ssize_t count = read(fd, data + len, size - len);
+
+        if (count < 0) {
+            free(data);
+            return DECDDS_ERR_READ;
+        }
+        else if (!count) {
+            break;
+        }
+
+        len += count;
+    }
+
+    file->data = data;
+    file->len = (uint32_t)len;
+
+    return 0;
+}
+
+int decdds_file_open(decdds_file_t *file, const char *fileName)
+{
+    struct stat st;
+    int fd, retval = 0;
+
+    memset(file, 0, sizeof(*file));
+
+    if ((fd = open(fileName, O_RDONLY)) == -1) {
+        return DECDDS_ERR_OPEN;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size > UINT32_MAX) {
+        close(fd);
+        return DECDDS_ERR_READ;
+    }
+
+    // Pipes and devices have no size, read until end of file.
+    if (!S_ISREG(st.st_mode)) {
+        retval = readall(fd, file);
+        close(fd);
+        return retval;
+    }
+
+    file->len = (uint32_t)st.st_size;
+
+    if (!file->len) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, file->len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data != MAP_FAILED) {
+        madvise(data, file->len, MADV_SEQUENTIAL);
+        file->data = (const uint8_t*)data;
+        file->mapped = 1;
+    }
+    else {
+        retval = readall(fd, file);
+    }
+
+    close(fd);
+    return retval;
+}
+
+void decdds_file_close(decdds_file_t *file)
+{
+    if (file->mapped) {
+        munmap((void*)file->data, file->len);
+    }
+    else {
+        free((void*)file->data);
+    }
+
+    memset(file, 0, sizeof(*file));
+}
+
+static int writeall(int fd, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t pos = 0; pos < len; ) {
+        ssize_t written = write(fd, data + pos, len - pos);
+
+        if (written <= 0) {
+            return DECDDS_ERR_WRITE;
+        }
+
+        pos += written;
+    }
+
+    return 0;
+}
+
+int decdds_file_extract(decdds_ctx_t *ctx, const decdds_file_t *src, const char *dstFileName, uint32_t faces, uint32_t mips, uint32_t *dstLen, decdds_diag_fn diagfn, void *user)
+{
+    decdds_info_t info;
+    struct stat st;
+    char *tmpFileName = NULL;
+    int fd, retval = 0;
+
+    *dstLen = 0;
+
+    // Empty input, empty output.
+    if (!src->len) {
+        info.dstlen = 0;
+    }
+    else if ((retval = decdds_peek_part(src->data, src->len, faces, mips, &info)) != 0) {
+        return retval;
+    }
+
+    // Regular files are decoded next to the destination and renamed over it
+    // once complete, a failed decode leaves any existing output untouched.
+    // Devices and pipes are written directly.
+    if (stat(dstFileName, &st) == 0 && !S_ISREG(st.st_mode)) {
+        if ((fd = open(dstFileName, O_WRONLY)) == -1) {
+            return DECDDS_ERR_OPEN;
+        }
+    }
+    else {
+        mode_t mask = umask(0);
+        umask(mask);
+
+        if ((tmpFileName = (char*)malloc(strlen(dstFileName) + 8)) == NULL) {
+            return DECDDS_ERR_MEM;
+        }
+
+        strcpy(tmpFileName, dstFileName);
+        strcat(tmpFileName, ".XXXXXX");
+
+        if ((fd = mkstemp(tmpFileName)) == -1) {
+            free(tmpFileName);
+            return DECDDS_ERR_OPEN;
+        }
+
+        // mkstemp() creates the file private, give it the usual permissions.
+        fchmod(fd, 0644 & ~mask);
+    }
+
+    if (info.dstlen) {
+        void *dstData = MAP_FAILED;
+
+        // Blocks are reserved up front, running out of space while writing
+        // through the mapping would raise SIGBUS.
+        if (ftruncate(fd, info.dstlen) == 0 && posix_fallocate(fd, 0, info.dstlen) == 0) {
+            dstData = mmap(NULL, info.dstlen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+
+        if (dstData != MAP_FAILED) {
+            retval = decdds_decode_part(ctx, src->data, src->len, faces, mips, (uint8_t*)dstData, info.dstlen, diagfn, user);
+
+            // Writeback errors are only reported here.
+            if (!retval && msync(dstData, info.dstlen, MS_SYNC) != 0) {
+                retval = DECDDS_ERR_WRITE;
+            }
+
+            if (munmap(dstData, info.dstlen) != 0 && !retval) {
+                retval = DECDDS_ERR_WRITE;
+            }
+        }
+        // Devices, pipes and file systems without fallocate, decode in memory.
+        else if ((dstData = malloc(info.dstlen)) != NULL) {
+            retval = decdds_decode_part(ctx, src->data, src->len, faces, mips, (uint8_t*)dstData, info.dstlen, diagfn, user);
+
+            if (!retval) {
+                retval = writeall(fd, (const uint8_t*)dstData, info.dstlen);
+            }
+
+            free(dstData);
+        }
+        else {
+            retval = DECDDS_ERR_MEM;
+        }
+    }
+
+    if (close(fd) != 0 && !retval) {
+        retval = DECDDS_ERR_WRITE;
+    }
+
+    if (tmpFileName) {
+        if (!retval && rename(tmpFileName, dstFileName) != 0) {
+            retval = DECDDS_ERR_WRITE;
+        }
+
+        if (retval) {
+            unlink(tmpFileName);
+        }
+
+        free(tmpFileName);
+    }
+
+    if (retval) {
+        return retval;
+    }
+
+    *dstLen = info.dstlen;
+    return 0;
+}
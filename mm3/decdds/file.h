@@ -0,0 +1,32 @@
+/*
+ * decdds - Midtown Madness 3 CDDS extractor
+ *
+ * License: As is
+ * Author:  Daniel Stien <daniel@stien.org>
+ * URL:     https://github.com/dstien/gameformats
+ */
+
+#ifndef DECDDS_FILE_H
+#define DECDDS_FILE_H
+
+#include "decdds.h"
+
+// Input file contents, memory-mapped when possible.
+typedef struct decdds_file_t {
+    const uint8_t *data;
+    uint32_t       len;
+    int            mapped;
+} decdds_file_t;
+
+int decdds_file_open(decdds_file_t *file, const char *fileName);
+
+void decdds_file_close(decdds_file_t *file);
+
+// Decode the first faces and mips of src into dstFileName, 0 for all. The
+// output is sized from the header and mapped so the image is decoded in
+// place, or written from memory if it can't be mapped. Regular files are
+// written to a temporary file and renamed over dstFileName on success, on
+// failure it is removed and an existing output is left as it was.
+int decdds_file_extract(decdds_ctx_t *ctx, const decdds_file_t *src, const char *dstFileName, uint32_t faces, uint32_t mips, uint32_t *dstLen, decdds_diag_fn diagfn, void *user);
+
+#endif
@@ -10,8 +10,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-
+#include "batch.h"
 #include "decdds.h"
+#include "file.h"
 
 void panic(const char *fmt)
 {
@@ -19,6 +20,12 @@ void panic(const char *fmt)
     abort();
 }
 
+void diag(void *user, const char *msg)
+{
+    (void)user;
+    fputs(msg, stdout);
+}
+
 void usage()
 {
     fprintf(stderr, DECDDS_USAGE);
@@ -28,17 +35,32 @@ void usage()
 int main(int argc, const char* argv[])
 {
     char *srcFileName = NULL, *dstFileName = NULL;
-    FILE *srcFile, *dstFile;
-    uint8_t *srcData, *dstData = NULL;
-    int32_t srcLen;
+    char *listFileName = NULL, *threadsArg = NULL, **switchArg = NULL;
+    char **names;
+    int count = 0;
+    int batch = 0;
+    int threads = 0;
+    decdds_opts_t opts = { 0, 0, 0 };
+    char *facesArg = NULL, *mipsArg = NULL;
+    decdds_ctx_t ctx;
+    decdds_file_t srcFile;
     uint32_t dstLen;
     int retval;
     int verbosity = 1;
 
+    if ((names = (char**)malloc(argc * sizeof(char*))) == NULL) {
+        panic("malloc() failed.\n");
+    }
+
     // Parse options.
     for (int i = 1; i < argc; ++i) {
+        // Switch argument
+        if (switchArg != NULL) {
+            *switchArg = (char*)argv[i];
+            switchArg = NULL;
+        }
         // Switches
-        if (argv[i][0] == '-') {
+        else if (argv[i][0] == '-') {
             for (int j = 1; argv[i][j] != 0; ++j) {
                 switch (argv[i][j]) {
                     case 'h':
@@ -48,6 +70,12 @@ int main(int argc, const char* argv[])
                         printf("Options:\n");
                         printf("  -v    increase verbosity\n");
                         printf("  -q    quiet\n");
+                        printf("  -b    extract all files given, *.cdds in directories\n");
+                        printf("  -j N  use N threads in batch mode, defaults to CPU count\n");
+                        printf("  -l F  also extract files listed in F, one per line, - for stdin\n");
+                        printf("  -i    print header info only, don't extract\n");
+                        printf("  -f N  extract the first N cube map faces only\n");
+                        printf("  -m N  extract the first N mip levels only\n");
                         printf("  -?    this helpful output\n\n");
                         return 0;
 
@@ -59,123 +87,124 @@ int main(int argc, const char* argv[])
                         verbosity = 0;
                         break;
 
+                    case 'b':
+                        batch = 1;
+                        break;
+
+                    case 'j':
+                        switchArg = &threadsArg;
+                        batch = 1;
+                        break;
+
+                    case 'l':
+                        switchArg = &listFileName;
+                        batch = 1;
+                        break;
+
+                    case 'i':
+                        opts.info = 1;
+                        break;
+
+                    case 'f':
+                        switchArg = &facesArg;
+                        break;
+
+                    case 'm':
+                        switchArg = &mipsArg;
+                        break;
+
                     default:
                         usage();
                 }
             }
         }
-        else if (srcFileName == NULL) {
-            srcFileName = (char*)argv[i];
-        }
-        else if (dstFileName == NULL) {
-            dstFileName = (char*)argv[i];
-        }
         else {
-            usage();
+            names[count++] = (char*)argv[i];
         }
     }
 
-    if (verbosity) {
-        printf(DECDDS_BANNER);
+    // Switch argument missing.
+    if (switchArg != NULL) {
+        usage();
     }
 
-    // No input file name given.
-    if (srcFileName == NULL) {
+    if (threadsArg != NULL && (threads = atoi(threadsArg)) <= 0) {
         usage();
     }
 
-    // Generate output file name if not specified.
-    if (dstFileName == NULL) {
-        char *srcExt = ".cdds";
-        char *dstExt = ".dds";
-        size_t lenSrcName = strlen(srcFileName);
-        size_t lenSrcExt = strlen(srcExt);
-        size_t lenDstExt = strlen(dstExt);
-
-        dstFileName = (char*)malloc(lenSrcName + lenDstExt + 1);
-        strncpy(dstFileName, srcFileName, lenSrcName + 1);
-
-        // Replace ".cdds" extension with ".dds".
-        if ((lenSrcName > lenSrcExt) && !strncmp(srcFileName + lenSrcName - lenSrcExt, srcExt, lenSrcExt)) {
-            strncpy(dstFileName + lenSrcName - lenSrcExt, dstExt, lenDstExt + 1);
-        }
-        // Append ".dds" extension if input file don't ends with ".cdds".
-        else {
-            strncpy(dstFileName + lenSrcName, dstExt, lenDstExt + 1);
-        }
+    if ((facesArg != NULL && (int)(opts.faces = atoi(facesArg)) <= 0) || (mipsArg != NULL && (int)(opts.mips = atoi(mipsArg)) <= 0)) {
+        usage();
     }
 
-    if ((srcFile = fopen(srcFileName, "rb")) == NULL) {
-        fprintf(stderr, "Error: Can't open input file \"%s\".\n", srcFileName);
-        return DECDDS_ERR_OPEN;
+    // More than an input and output file or a directory can only be a batch.
+    if (count > 2 || (count && decdds_isdir(names[0])) || (count > 1 && opts.info)) {
+        batch = 1;
     }
 
-    if (fseek(srcFile, 0, SEEK_END) != 0) {
-        panic("fseek() failed.\n");
+    if (verbosity) {
+        printf(DECDDS_BANNER);
     }
 
-    if ((srcLen = ftell(srcFile)) == -1) {
-        panic("ftell() failed.\n");
-    }
+    if (batch) {
+        // Nothing to extract.
+        if (!count && listFileName == NULL) {
+            usage();
+        }
 
-    if (fseek(srcFile, 0, SEEK_SET) != 0) {
-        panic("fseek() failed.\n");
+        retval = decdds_batch(names, count, listFileName, threads, &opts, verbosity);
+        free(names);
+        return retval;
     }
 
-    if ((srcData = (uint8_t*)malloc(srcLen)) == NULL) {
-        panic("malloc() failed.\n");
+    // No input file name given.
+    if (!count) {
+        usage();
     }
 
-    if (verbosity) {
-        printf("Reading \"%s\" (%d bytes)\n", srcFileName, srcLen);
+    srcFileName = names[0];
+    dstFileName = count > 1 ? names[1] : NULL;
+    free(names);
+
+    // Generate output file name if not specified.
+    if (dstFileName == NULL && (dstFileName = decdds_dstname(srcFileName)) == NULL) {
+        panic("malloc() failed.\n");
     }
 
-    if (fread(srcData, 1, (uint32_t)srcLen, srcFile) != (uint32_t)srcLen) {
-        fprintf(stderr, "Error: Can't read input file \"%s\".\n", srcFileName);
-        return DECDDS_ERR_READ;
+    if ((retval = decdds_file_open(&srcFile, srcFileName)) != 0) {
+        fprintf(stderr, "Error: Can't %s input file \"%s\".\n", retval == DECDDS_ERR_OPEN ? "open" : "read", srcFileName);
+        return retval;
     }
 
-    if (fclose(srcFile) != 0) {
-        panic("fclose() failed.\n");
+    if (verbosity) {
+        printf("Reading \"%s\" (%u bytes)\n", srcFileName, srcFile.len);
     }
 
-    if ((retval = decdds_extract(srcData, (uint32_t)srcLen, &dstData, &dstLen, verbosity)) == 0) {
-        if (verbosity) {
-            printf("Writing \"%s\" (%d bytes)\n", dstFileName, dstLen);
-        }
+    if (opts.info) {
+        decdds_info_t info;
 
-        if ((dstFile = fopen(dstFileName, "wb")) == NULL) {
-            fprintf(stderr, "Error: Can't create output file \"%s\".\n", dstFileName);
-            return DECDDS_ERR_OPEN;
+        if ((retval = decdds_peek_part(srcFile.data, srcFile.len, opts.faces, opts.mips, &info)) == 0) {
+            decdds_printinfo(srcFileName, &info);
         }
-
-        if (fwrite(dstData, 1, dstLen, dstFile) != dstLen) {
-            fprintf(stderr, "Error: Can't write output file \"%s\".\n", dstFileName);
-            return DECDDS_ERR_WRITE;
+        else {
+            fprintf(stderr, "Error: %s.\n", decdds_strerror(retval));
         }
-
-        if (fclose(dstFile) != 0) {
-            panic("fclose failed.\n");
+    }
+    else if ((retval = decdds_file_extract(&ctx, &srcFile, dstFileName, opts.faces, opts.mips, &dstLen, verbosity > 1 ? diag : NULL, NULL)) == 0) {
+        if (verbosity) {
+            printf("Writing \"%s\" (%u bytes)\n", dstFileName, dstLen);
         }
     }
+    else if (retval == DECDDS_ERR_OPEN) {
+        fprintf(stderr, "Error: Can't create output file \"%s\".\n", dstFileName);
+    }
+    else if (retval == DECDDS_ERR_WRITE) {
+        fprintf(stderr, "Error: Can't write output file \"%s\".\n", dstFileName);
+    }
     else {
-        switch (retval) {
-            case DECDDS_ERR_WRONGTYPE:
-                fprintf(stderr, "Error: Not a valid CDDS file\n");
-                break;
-
-            case DECDDS_ERR_MEM:
-                fprintf(stderr, "Error: Couldn't allocate memory.\n");
-                break;
-
-            default:
-                fprintf(stderr, "Error: Decoding failed.\n");
-                break;
-        }
+        fprintf(stderr, "Error: %s.\n", decdds_strerror(retval));
     }
 
-    free(srcData);
-    free(dstData);
+    decdds_file_close(&srcFile);
 
     return retval;
 }
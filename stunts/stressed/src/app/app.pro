@@ -47,13 +47,15 @@ RESOURCES +=  ../../resources/resources.qrc
 
 FORMS   += mainwindow.ui \
 
-HEADERS += mainwindow.h \
+HEADERS += decompdevice.h \
+           mainwindow.h \
            resource.h \
            resourcesmodel.h \
            settings.h \
            stunpack.h
 
-SOURCES += main.cpp \
+SOURCES += decompdevice.cpp \
+           main.cpp \
            mainwindow.cpp \
            resource.cpp \
            resourcesmodel.cpp \
@@ -0,0 +1,108 @@
+// stressed - Stunts/4D [Sports] Driving resource editor
+// Copyright (C) 2008-2013 Daniel Stien <daniel@stien.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+#include <cstring>
+
+#include "decompdevice.h"
+
+DecompDevice::DecompDevice(QObject* parent)
+: QIODevice(parent),
+  m_failed(false)
+{
+  m_stream.stage = NULL;
+}
+
+DecompDevice::~DecompDevice()
+{
+  close();
+}
+
+bool DecompDevice::open(OpenMode mode)
+{
+  if ((mode & ReadWrite) != ReadOnly) {
+    setErrorString(tr("Compressed files can only be read."));
+    return false;
+  }
+
+  // The stream reads the compressed data in place, it's kept until closed.
+  m_src.data = (uchar*)m_comp.constData();
+  m_src.len = m_comp.size();
+  m_src.offset = 0;
+
+  char errStr[256];
+  if (stpk_streamOpen(&m_stream, &m_src, 0, 0, errStr)) {
+    errStr[255] = '\0';
+    setErrorString(tr("Decompression failed with message \"%1\"").arg(errStr).simplified());
+    return false;
+  }
+
+  m_data.resize(m_stream.len);
+  m_failed = false;
+
+  return QIODevice::open(mode | Unbuffered);
+}
+
+void DecompDevice::close()
+{
+  if (isOpen()) {
+    stpk_streamClose(&m_stream);
+    m_data.clear();
+  }
+
+  QIODevice::close();
+}
+
+qint64 DecompDevice::readData(char* data, qint64 maxSize)
+{
+  qint64 len = qMin(maxSize, size() - pos());
+
+  if (len <= 0) {
+    return 0;
+  }
+
+  if (!decompress(pos() + len)) {
+    return -1;
+  }
+
+  memcpy(data, m_data.constData() + pos(), len);
+
+  return len;
+}
+
+// Decompress up to end, at least STEP_SIZE bytes at a time.
+bool DecompDevice::decompress(qint64 end)
+{
+  if (end <= m_stream.offset) {
+    return true;
+  }
+
+  if (m_failed) {
+    return false;
+  }
+
+  uint len = qMin(qMax(end - m_stream.offset, (qint64)STEP_SIZE), (qint64)(m_stream.len - m_stream.offset)), read;
+
+  char errStr[256];
+  if (stpk_streamRead(&m_stream, (uchar*)m_data.data() + m_stream.offset, len, &read, errStr)) {
+    errStr[255] = '\0';
+    setErrorString(tr("Decompression failed with message \"%1\"").arg(errStr).simplified());
+    m_failed = true;
+    return false;
+  }
+
+  return true;
+}
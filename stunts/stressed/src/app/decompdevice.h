@@ -0,0 +1,59 @@
+// stressed - Stunts/4D [Sports] Driving resource editor
+// Copyright (C) 2008-2013 Daniel Stien <daniel@stien.org>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+#ifndef DECOMPDEVICE_H
+#define DECOMPDEVICE_H
+
+#include <QIODevice>
+
+#include "stunpack.h"
+
+// Read-only device on a compressed resource file. Data is decompressed as
+// far as it's read, parsing doesn't wait for the whole file.
+class DecompDevice : public QIODevice
+{
+  Q_OBJECT
+
+public:
+  DecompDevice(QObject* parent = 0);
+  ~DecompDevice();
+
+  void              setData(const QByteArray& data) { m_comp = data; }
+
+  bool              open(OpenMode mode);
+  void              close();
+  bool              isSequential() const            { return false; }
+  qint64            size() const                    { return m_data.size(); }
+  bool              failed() const                  { return m_failed; }
+
+protected:
+  qint64            readData(char* data, qint64 maxSize);
+  qint64            writeData(const char* /*data*/, qint64 /*maxSize*/) { return -1; }
+
+private:
+  bool              decompress(qint64 end);
+
+  static const int  STEP_SIZE = 0x10000;
+
+  QByteArray        m_comp;
+  QByteArray        m_data;
+  stpk_Buffer       m_src;
+  stpk_Stream       m_stream;
+  bool              m_failed;
+};
+
+#endif
@@ -28,7 +28,7 @@
 #include "settings.h"
 
 const char MainWindow::FILE_SETTINGS_PATH[] = "paths/resource";
-const char MainWindow::FILE_FILTERS_LOAD[] =
+const char MainWindow::FILE_FILTERS[] =
     "All known resource files (*.vsh *.pvs *.esh *.pes *.3sh *.p3s *.vce *.pvc *.kms *.pkm *.sfx *.psf *.res *.pre);;"
     "Bitmaps (*.vsh *.pvs);;"
     "Icons (*.esh *.pes);;"
@@ -39,17 +39,6 @@ const char MainWindow::FILE_FILTERS_LOAD[] =
     "Misc (*.res *.pre);;"
     "All files (*)";
 
-const char MainWindow::FILE_FILTERS_SAVE[] =
-    "Unpacked resource files (*.vsh *.esh *.3sh *.vce *.kms *.sfx *.res);;"
-    "Bitmaps (*.vsh);;"
-    "Icons (*.esh);;"
-    "3d shapes (*.3sh);;"
-    "Voices (*.vce);;"
-    "Music (*.kms);;"
-    "Sound effects (*.sfx);;"
-    "Misc (*.res);;"
-    "All files (*)";
-
 MainWindow::MainWindow(QWidget* parent, Qt::WindowFlags flags)
 : QMainWindow(parent, flags)
 {
@@ -96,7 +85,8 @@ void MainWindow::loadFile(const QString& fileName)
 void MainWindow::saveFile(const QString& fileName)
 {
   try {
-    Resource::write(fileName, m_resourcesModel);
+    QString extension = QFileInfo(fileName).suffix();
+    Resource::write(fileName, m_resourcesModel, unpackedExtension(extension) != extension);
   }
   catch (QString msg) {
     QMessageBox::critical(
@@ -170,7 +160,7 @@ void MainWindow::open()
       this,
       tr("Open file"),
       m_currentFilePath,
-      FILE_FILTERS_LOAD,
+      FILE_FILTERS,
       &m_currentFileFilter);
 
   if (!fileName.isEmpty()) {
@@ -184,30 +174,11 @@ void MainWindow::save()
     saveAs();
   }
   else {
-    QString safeName = unpackedPathlessName(m_currentFileName);
-
-    if (safeName != QFileInfo(m_currentFileName).fileName()) {
-      if (changeToSafeFileName(safeName)) {
-        saveAsAsIs(true);
-      }
-    }
-    else {
-      saveFile(m_currentFileName);
-    }
+    saveFile(m_currentFileName);
   }
 }
 
 void MainWindow::saveAs()
-{
-  QString safeName = unpackedPathlessName(m_currentFileName);
-
-  bool nameWillChange = safeName != QFileInfo(m_currentFileName).fileName();
-  if (!nameWillChange || changeToSafeFileName(safeName)) {
-    saveAsAsIs(nameWillChange);
-  }
-}
-
-void MainWindow::saveAsAsIs(bool nameWasChanged)
 {
   m_currentFilePath = Settings().getFilePath(Settings::PATH_PATHS_RESOURCE);
 
@@ -215,70 +186,31 @@ void MainWindow::saveAsAsIs(bool nameWasChanged)
       this,
       tr("Save file"),
       m_currentFilePath,
-      FILE_FILTERS_SAVE,
+      FILE_FILTERS,
       &m_currentFileFilter);
 
   if (!fileName.isEmpty()) {
     Settings().setFilePath(Settings::PATH_PATHS_RESOURCE, m_currentFilePath = fileName);
     saveFile(fileName);
 
-    if (nameWasChanged) {
-      QFileInfo fileInfo = QFileInfo(fileName);
-      QString extension = fileInfo.suffix().toLower();
-
-      if (extension == "3sh" || extension == "vsh" || extension == "esh")
-      {
-        QMessageBox::information(
-              this,
-              QCoreApplication::applicationName(),
-              tr("Be sure to rename or move any %1 file from the Stunts "
-                 "directory, or the file just saved will not be loaded by "
-                 "the game.")
-                .arg(fileInfo.completeBaseName() + ".p" + extension.left(2)));
-      }
+    // The game prefers packed files.
+    QFileInfo fileInfo = QFileInfo(fileName);
+    QString extension = fileInfo.suffix().toLower();
+
+    if ((extension == "3sh" || extension == "vsh" || extension == "esh")
+        && QFileInfo(fileInfo.dir(), fileInfo.completeBaseName() + ".p" + extension.left(2)).exists())
+    {
+      QMessageBox::information(
+            this,
+            QCoreApplication::applicationName(),
+            tr("Be sure to rename or move any %1 file from the Stunts "
+               "directory, or the file just saved will not be loaded by "
+               "the game.")
+              .arg(fileInfo.completeBaseName() + ".p" + extension.left(2)));
     }
   }
 }
 
-bool MainWindow::changeToSafeFileName(const QString& safeFileName)
-{
-  int ret = QMessageBox::question(
-      this,
-      QCoreApplication::applicationName(),
-      tr("As stressed creates unpacked resource files, "
-         "the file name will be changed to %1 by default. "
-         "Continue saving?")
-        .arg(safeFileName),
-      QMessageBox::Ok | QMessageBox::Cancel);
-
-
-  switch (ret) {
-  case QMessageBox::Ok: {
-    QDir path = QDir(QFileInfo(m_currentFileName).path());
-    Settings().setFilePath(FILE_SETTINGS_PATH,
-                           m_currentFilePath = QFileInfo(path, safeFileName).filePath());
-    return true;
-  }
-  default:
-    return false;
-  }
-}
-
-QString MainWindow::unpackedPathlessName(const QString& fileName)
-{
-  QFileInfo fileInfo = QFileInfo(fileName);
-  if (fileName != "")
-  {
-    QString baseName = fileInfo.completeBaseName();
-    QString extension = fileInfo.suffix();
-    return baseName + "." + unpackedExtension(extension);
-  }
-  else
-  {
-    return fileInfo.fileName();
-  }
-}
-
 QString MainWindow::unpackedExtension(const QString& extension)
 {
   QString lowerExtension = extension.toLower();
@@ -69,9 +69,6 @@ private:
   void              updateWindowTitle();
   void              updateStatusBar();
   QString           unpackedExtension(const QString& extension);
-  QString           unpackedPathlessName(const QString& fileName);
-  bool              changeToSafeFileName(const QString& safeFileName);
-  void              saveAsAsIs(bool nameWasChanged);
 
   Ui::MainWindow    m_ui;
 
@@ -87,8 +84,7 @@ private:
   bool              m_modified;
 
   static const char FILE_SETTINGS_PATH[];
-  static const char FILE_FILTERS_LOAD[];
-  static const char FILE_FILTERS_SAVE[];
+  static const char FILE_FILTERS[];
 };
 
 #endif
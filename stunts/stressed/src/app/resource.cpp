@@ -15,6 +15,9 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
+#include <cstdlib>
+#include <cstring>
+
 #include <QBuffer>
 #include <QDataStream>
 #include <QFileInfo>
@@ -27,6 +30,7 @@
 #include "shape/shaperesource.h"
 #include "speed/speedresource.h"
 #include "text/textresource.h"
+#include "decompdevice.h"
 #include "resource.h"
 #include "resourcesmodel.h"
 #include "settings.h"
@@ -47,9 +51,7 @@ bool Resource::parse(const QString& fileName, ResourcesModel* resourcesModel, QW
 {
   bool modified = false;
 
-  stpk_Buffer compSrc, compDst;
-  compSrc.data = compDst.data = NULL;
-  QBuffer buf;
+  DecompDevice decomp;
 
   TocList toc;
 
@@ -75,40 +77,31 @@ bool Resource::parse(const QString& fileName, ResourcesModel* resourcesModel, QW
       quint32 decompSize = reportedSize >> 8;
 
       if ((compType >= 1) && (compType <= 2) && (fileSize <= STPK_MAX_SIZE) && (fileSize < decompSize)) {
-        compSrc.len = fileSize;
-        compSrc.offset = compDst.offset = 0;
+        QByteArray compData;
+
+        file.seek(0);
 
         try {
-          compSrc.data = new uchar[compSrc.len];
+          compData = file.readAll();
         }
         catch (std::bad_alloc& exc) {
-          compSrc.data = NULL;
           throw tr("Couldn't allocate memory for compressed file.");
         }
 
-        file.seek(0);
-        if (file.read((char*)compSrc.data, compSrc.len) != compSrc.len) {
+        if ((quint64)compData.size() != fileSize) {
           throw tr("Couldn't read compressed data to memory.");
         }
 
-        char errStr[256];
-        unsigned int res = stpk_decomp(&compSrc, &compDst, 0, 0, errStr);
-
-        delete[] compSrc.data;
-        compSrc.data = NULL;
+        // Decompressed as it's parsed.
+        decomp.setData(compData);
 
-        if (res) {
-          errStr[255] = '\0';
-          throw tr("Decompression failed with message \"%1\"").arg(errStr).simplified();
+        if (!decomp.open(QIODevice::ReadOnly)) {
+          throw decomp.errorString();
         }
 
-        buf.setData((char*)compDst.data, compDst.len);
-        buf.open(QIODevice::ReadOnly);
-        in.setDevice(&buf);
+        in.setDevice(&decomp);
 
-        actualSize = compDst.len;
-        delete[] compDst.data;
-        compDst.data = NULL;
+        actualSize = decomp.size();
       }
       // Data doesn't fit compression header, give up.
       else {
@@ -281,9 +274,6 @@ bool Resource::parse(const QString& fileName, ResourcesModel* resourcesModel, QW
     in.unsetDevice();
     file.close();
 
-    delete[] compSrc.data;
-    delete[] compDst.data;
-
     throw msg;
   }
 
@@ -303,15 +293,14 @@ bool Resource::tocPositionLessThan(const TocEntry &e1, const TocEntry &e2)
   return e1.pos < e2.pos;
 }
 
-void Resource::write(const QString& fileName, const ResourcesModel* resourcesModel)
+void Resource::write(const QString& fileName, const ResourcesModel* resourcesModel, bool pack)
 {
-  QFile file(fileName);
-
-  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-    throw tr("Couldn't open file for writing.");
-  }
+  // Build in memory, the whole file is needed for compression. The target
+  // isn't touched until the data is complete.
+  QBuffer buffer;
+  buffer.open(QIODevice::ReadWrite);
 
-  QDataStream out(&file);
+  QDataStream out(&buffer);
   out.setByteOrder(QDataStream::LittleEndian);
 
   quint16 numResources = resourcesModel->rowCount();
@@ -361,12 +350,70 @@ void Resource::write(const QString& fileName, const ResourcesModel* resourcesMod
   checkError(&out, tr("final file size"), true);
 
   out.unsetDevice();
+  buffer.close();
+
+  QByteArray data = pack ? compress(buffer.data()) : buffer.data();
+
+  QFile file(fileName);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    throw tr("Couldn't open file for writing.");
+  }
+
+  if (file.write(data) != data.size()) {
+    throw tr("Couldn't write file.");
+  }
+
   file.close();
 
   QFileInfo fileInfo(fileName);
   m_fileName = fileInfo.fileName();
 }
 
+// Returns the data packed. Packed files must be smaller than the data, or they
+// aren't recognised as packed when loaded. The result is unpacked again and
+// compared before it's returned.
+QByteArray Resource::compress(const QByteArray& data)
+{
+  stpk_Buffer src, dst, check;
+  char errStr[256];
+
+  src.data = (uchar*)data.constData();
+  src.len = data.size();
+  src.offset = 0;
+
+  if (stpk_comp(&src, &dst, 0, errStr)) {
+    errStr[255] = '\0';
+    throw tr("Compression failed with message \"%1\"").arg(errStr).simplified();
+  }
+
+  if (dst.data == NULL) {
+    throw tr("The data doesn't get any smaller when packed. Nothing was written, save it with an unpacked file extension instead.");
+  }
+
+  QByteArray packed((char*)dst.data, dst.len);
+  free(dst.data);
+
+  dst.data = (uchar*)packed.constData();
+  dst.len = packed.size();
+  dst.offset = 0;
+
+  check.data = NULL;
+  check.len = check.offset = 0;
+
+  bool same = !stpk_decomp(&dst, &check, 0, 0, errStr)
+      && check.len == src.len
+      && !memcmp(check.data, src.data, src.len);
+
+  free(check.data);
+
+  if (!same) {
+    throw tr("Compressed data didn't match the original. Nothing was written.");
+  }
+
+  return packed;
+}
+
 Resource* Resource::typeDialog(QWidget* parent)
 {
   bool ok;
@@ -415,6 +462,12 @@ void Resource::checkError(QDataStream* stream, const QString& what, bool write)
     case QDataStream::Ok:
       break;
     case QDataStream::ReadPastEnd:
+      // Decompression errors show up as a short read.
+      if (DecompDevice* decomp = qobject_cast<DecompDevice*>(stream->device())) {
+        if (decomp->failed()) {
+          throw decomp->errorString();
+        }
+      }
       throw tr("Reached unexpected end of file while %1 %2.").arg(action).arg(what);
     case QDataStream::ReadCorruptData:
       throw tr("Data corruption occured while %1 %2.").arg(action).arg(what);
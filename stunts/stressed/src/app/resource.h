@@ -20,6 +20,7 @@
 
 #include <QWidget>
 
+class QByteArray;
 class QDataStream;
 class QListWidget;
 class ResourcesModel;
@@ -42,7 +43,7 @@ public:
   virtual ~Resource() {};
 
   static bool       parse(const QString& fileName, ResourcesModel* resourcesModel, QWidget* parent = 0);
-  static void       write(const QString& fileName, const ResourcesModel* resourcesModel);
+  static void       write(const QString& fileName, const ResourcesModel* resourcesModel, bool pack = false);
   static Resource*  typeDialog(QWidget* parent = 0);
 
   static QString    fileName()        { return m_fileName; }
@@ -64,6 +65,7 @@ protected slots:
   virtual void      isModified();
 
 protected:
+  static QByteArray compress(const QByteArray& data);
   static void       checkError(QDataStream* stream, const QString& what, bool write = false);
   virtual void      parse(QDataStream* in) = 0;
   virtual void      write(QDataStream* out) const = 0;
@@ -18,6 +18,7 @@
  */
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +26,18 @@
 #include "stunpack.h"
 
 inline void stpk_getLength(stpk_Buffer *buf, uint *len);
+void stpk_putLength(uchar *data, uint len);
+
+static uint stpk_decompStream(stpk_Buffer *src, stpk_Buffer *dst, int maxPasses, int verbose, char *err);
+static uint stpk_stageOpen(stpk_Stage **last, stpk_Buffer *src, int verbose, char *err);
+static uint stpk_stageFill(stpk_Stage *stage, uint need, int verbose, char *err);
+static uint stpk_stageRead(stpk_Stage *stage, uchar *data, uint len, uint *read, int verbose, char *err);
+static uint stpk_stageDone(stpk_Stage *stage);
+static uint stpk_rleStreamInit(stpk_Stage *stage, int verbose, char *err);
+static uint stpk_rleStreamSeq(stpk_Stage *stage, uchar *data, uint len, uint *read, int verbose, char *err);
+static uint stpk_rleStreamOne(stpk_Stage *stage, uchar *data, uint len, uint *read, int verbose, char *err);
+static uint stpk_vleStreamInit(stpk_Stage *stage, int verbose, char *err);
+static uint stpk_vleStream(stpk_Stage *stage, uchar *data, uint len, uint *read, int verbose, char *err);
 
 // Decompress sub-files in source buffer.
 uint stpk_decomp(stpk_Buffer *src, stpk_Buffer *dst, int maxPasses, int verbose, char *err)
@@ -32,6 +45,12 @@ uint stpk_decomp(stpk_Buffer *src, stpk_Buffer *dst, int maxPasses, int verbose,
 	uchar passes, type, i;
 	uint retval = 1, finalLen;
 
+	// The reference decoders are only used for tracing, everything else
+	// decodes all passes at once through the stream.
+	if (verbose < 2) {
+		return stpk_decompStream(src, dst, maxPasses, verbose, err);
+	}
+
 	passes = src->data[src->offset];
 	if (STPK_GET_FLAG(passes, STPK_PASSES_RECUR)) {
 		src->offset++;
@@ -53,6 +72,11 @@ uint stpk_decomp(stpk_Buffer *src, stpk_Buffer *dst, int maxPasses, int verbose,
 		return 1;
 	}
 
+	if (!passes) {
+		STPK_ERR2("Invalid source file. Number of passes is 0\n");
+		return 1;
+	}
+
 	for (i = 0; i < passes; i++) {
 		STPK_NOVERBOSE("Pass %d/%d: ", i + 1, passes);
 		STPK_VERBOSE1("\nPass %d/%d\n", i + 1, passes);
@@ -178,8 +202,8 @@ freeTmpBuf:
 // Decode sequence runs.
 uint stpk_rleDecodeSeq(stpk_Buffer *src, stpk_Buffer *dst, uchar esc, int verbose, char *err)
 {
-	uchar cur;
-	uint progress = 0, seqOffset, rep, i;
+	uchar cur, *end;
+	uint progress = 0, seqOffset, seqLen, rep, len, i;
 
 	STPK_NOVERBOSE("[");
 
@@ -194,42 +218,45 @@ uint stpk_rleDecodeSeq(stpk_Buffer *src, stpk_Buffer *dst, uchar esc, int verbos
 		if (cur == esc) {
 			seqOffset = src->offset;
 
-			while ((cur = src->data[src->offset++]) != esc) {
-				if (src->offset >= src->len) {
-					STPK_ERR2("Reached end of source buffer before finding sequence end escape code %02X\n", esc);
-					return 1;
-				}
-
-				dst->data[dst->offset++] = cur;
+			// Sequence end escape code must be followed by the repetition count.
+			if ((end = (uchar*)memchr(src->data + seqOffset, esc, src->len - seqOffset)) == NULL || end + 1 >= src->data + src->len) {
+				STPK_ERR2("Reached end of source buffer before finding sequence end escape code %02X\n", esc);
+				return 1;
 			}
 
-			rep = src->data[src->offset++] - 1; // Already wrote sequence once.
-			STPK_VERBOSE2("%6d %6d %02X  %2.*X\n", src->offset, dst->offset, rep + 1, src->offset - seqOffset - 2, src->data[seqOffset]);
+			seqLen = end - (src->data + seqOffset);
+			src->offset = seqOffset + seqLen + 1;
+			rep = src->data[src->offset++];
+			len = seqLen * rep;
+			STPK_VERBOSE2("%6d %6d %02X  %2.*X\n", src->offset, dst->offset + seqLen, rep, seqLen, src->data[seqOffset]);
 
-			while (rep--) {
-				for (i = 0; i < (src->offset - seqOffset - 2); i++) {
-					if (dst->offset >= dst->len) {
-						STPK_ERR2("Reached end of temporary buffer while writing repeated sequence\n");
-						return 1;
-					}
+			// Bounds are checked once for the whole run. A count of 0 wraps around and never fits.
+			if ((!rep && seqLen) || len > dst->len - dst->offset) {
+				STPK_ERR2("Reached end of temporary buffer while writing repeated sequence\n");
+				return 1;
+			}
 
-					dst->data[dst->offset++] = src->data[seqOffset + i];
-				}
+			// Write the sequence once, then repeat by doubling what is already written.
+			memcpy(dst->data + dst->offset, src->data + seqOffset, seqLen);
+
+			for (i = seqLen; i < len; i *= 2) {
+				memcpy(dst->data + dst->offset + i, dst->data + dst->offset, i < len - i ? i : len - i);
 			}
 
+			dst->offset += len;
 		}
 		else {
-			dst->data[dst->offset++] = cur;
-			STPK_VERBOSE2("%6d %6d     %02X\n", src->offset, dst->offset, cur);
-
-			if (dst->offset > dst->len) {
+			if (dst->offset >= dst->len) {
 				STPK_ERR2("Reached end of temporary buffer while writing non-RLE byte\n");
 				return 1;
 			}
+
+			dst->data[dst->offset++] = cur;
+			STPK_VERBOSE2("%6d %6d     %02X\n", src->offset, dst->offset, cur);
 		}
 
 		// Progress bar.
-		if (verbose && (verbose < 3) && ((src->offset * 100) / src->len) >= (progress * 25)) {
+		while (verbose && (verbose < 3) && ((src->offset * 100) / src->len) >= (progress * 25)) {
 			printf("%4d%%", progress++ * 25);
 		}
 	}
@@ -267,15 +294,6 @@ uint stpk_rleDecodeOne(stpk_Buffer *src, stpk_Buffer *dst, uchar *esc, int verbo
 					cur = src->data[src->offset + 1];
 					src->offset += 2;
 					STPK_VERBOSE2("%6d %6d    %02X  %02X\n", src->offset, dst->offset, rep, cur);
-
-					while (rep--) {
-						if (dst->offset >= dst->len) {
-							STPK_ERR2("Reached end of temporary buffer while writing byte run\n");
-							return 1;
-						}
-
-						dst->data[dst->offset++] = cur;
-					}
 					break;
 
 				case 3:
@@ -283,31 +301,22 @@ uint stpk_rleDecodeOne(stpk_Buffer *src, stpk_Buffer *dst, uchar *esc, int verbo
 					cur = src->data[src->offset + 2];
 					src->offset += 3;
 					STPK_VERBOSE2("%6d %6d  %04X  %02X\n", src->offset, dst->offset, rep, cur);
-
-					while (rep--) {
-						if (dst->offset >= dst->len) {
-							STPK_ERR2("Reached end of temporary buffer while writing byte run\n");
-							return 1;
-						}
-
-						dst->data[dst->offset++] = cur;
-					}
 					break;
 
 				default:
 					rep = esc[cur] - 1;
 					cur = src->data[src->offset++];
 					STPK_VERBOSE2("%6d %6d    %02X  %02X\n", src->offset, dst->offset, rep, cur);
+			}
 
-					while (rep--) {
-						if (dst->offset >= dst->len) {
-							STPK_ERR2("Reached end of temporary buffer while writing byte run\n");
-							return 1;
-						}
-
-						dst->data[dst->offset++] = cur;
-					}
+			// Bounds are checked once for the whole run.
+			if (rep > dst->len - dst->offset) {
+				STPK_ERR2("Reached end of temporary buffer while writing byte run\n");
+				return 1;
 			}
+
+			memset(dst->data + dst->offset, cur, rep);
+			dst->offset += rep;
 		}
 		else {
 			dst->data[dst->offset++] = cur;
@@ -315,7 +324,7 @@ uint stpk_rleDecodeOne(stpk_Buffer *src, stpk_Buffer *dst, uchar *esc, int verbo
 		}
 
 		// Progress bar.
-		if (verbose && (verbose < 3) && ((src->offset * 100) / src->len) >= (progress * 25)) {
+		while (verbose && (verbose < 3) && ((src->offset * 100) / src->len) >= (progress * 25)) {
 			printf("%4d%%", progress++ * 25);
 		}
 	}
@@ -537,12 +546,1142 @@ uint stpk_vleDecode(stpk_Buffer *src, stpk_Buffer *dst, uchar *alphabet, uchar *
 	return 0;
 }
 
-// Read file length: WORD remainder + BYTE multiplier * 0x10000.
-inline void stpk_getLength(stpk_Buffer *buf, uint *len)
+// Generate lookup table of up to STPK_VLE_FAST_SYMBS codes of at most 8 bits
+// in the next STPK_VLE_FAST_BITS bits. No codes means the first one is escaped.
+void stpk_vleGenFast(uchar *symbols, uchar *widths, uint *fast)
 {
-	*len =  buf->data[buf->offset] | buf->data[buf->offset + 1] << 8; // Read remainder.
-	*len += 0x10000 * buf->data[buf->offset + 2]; // Add multiplier.
-	buf->offset += 3;
+	uint i, code, count, bits, symbs;
+
+	for (i = 0; i < STPK_VLE_FAST_LEN; i++) {
+		count = bits = symbs = 0;
+
+		while (count < STPK_VLE_FAST_SYMBS) {
+			// Next byte of the index, zero padded.
+			code = ((i << bits) >> (STPK_VLE_FAST_BITS - 8)) & 0xFF;
+
+			if (widths[code] > 8 || bits + widths[code] > STPK_VLE_FAST_BITS) {
+				break;
+			}
+
+			symbs |= symbols[code] << (8 * count);
+			bits += widths[code];
+			count++;
+		}
+
+		fast[i] = STPK_VLE_FAST_ENTRY(count, bits, symbs);
+	}
+}
+
+// Resolve escaped codes of up to widthsLen bits the way stpk_vleDecode()
+// walks esc1/esc2, for prefixes from escFirst up. Entries hold width and
+// alphabet index, 0 if unresolved.
+void stpk_vleGenFastEsc(uint widthsLen, uint escFirst, ushort *esc1, ushort *esc2, ushort *fastEsc)
+{
+	uint i, ind, len = (STPK_VLE_ALPH_LEN - escFirst) << (widthsLen - 8);
+	uint first = escFirst << (widthsLen - 8);
+	ushort curWord;
+
+	for (i = 0; i < len; i++) {
+		curWord = (first + i) >> (widthsLen - 8);
+		fastEsc[i] = 0;
+
+		for (ind = 8; ind < widthsLen; ind++) {
+			curWord = (curWord << 1) + (((first + i) >> (widthsLen - 1 - ind)) & 1);
+
+			if (curWord < esc2[ind]) {
+				curWord += esc1[ind];
+				fastEsc[i] = curWord > 0xFF ? STPK_VLE_FAST_ESC_BAD : (ind + 1) << 8 | curWord;
+				break;
+			}
+		}
+	}
+}
+
+// Decompress all passes at once through bounded buffers, only the final
+// output is allocated in full. Passes run interleaved, progress is shown for
+// the final output.
+static uint stpk_decompStream(stpk_Buffer *src, stpk_Buffer *dst, int maxPasses, int verbose, char *err)
+{
+	stpk_Stream stream;
+	uint retval = 1, step, read;
+
+	if (stpk_streamOpen(&stream, src, maxPasses, verbose, err)) {
+		return 1;
+	}
+
+	dst->len = stream.len;
+	dst->offset = 0;
+
+	if ((dst->data = (uchar*)malloc(sizeof(uchar) * dst->len)) == NULL) {
+		STPK_ERR2("Error allocating memory for destination buffer. (%s)\n", strerror(errno));
+		goto closeStream;
+	}
+
+	STPK_NOVERBOSE("Decompressing [");
+
+	step = verbose ? dst->len / 10 + 1 : dst->len;
+
+	while (dst->offset < dst->len) {
+		if (stpk_streamRead(&stream, dst->data + dst->offset, step, &read, err)) {
+			goto closeStream;
+		}
+
+		if (!read) {
+			STPK_ERR2("Reached unexpected end of source buffer\n");
+			goto closeStream;
+		}
+
+		dst->offset += read;
+		STPK_NOVERBOSE("%4d%%", (int)((uint64_t)dst->offset * 100 / dst->len));
+	}
+
+	STPK_NOVERBOSE("]\n");
+	retval = 0;
+
+closeStream:
+	stpk_streamClose(&stream);
+
+	return retval;
+}
+
+// Open stream on compressed source, which must be kept until the stream is
+// closed. Pass headers are parsed up front, decoding starts on first read.
+uint stpk_streamOpen(stpk_Stream *stream, stpk_Buffer *src, int maxPasses, int verbose, char *err)
+{
+	uchar passes, i;
+	uint finalLen;
+
+	stream->stage = NULL;
+	stream->offset = stream->len = 0;
+	stream->verbose = verbose;
+
+	if (src->len - src->offset < 4) {
+		STPK_ERR2("Reached EOF while parsing file header\n");
+		return 1;
+	}
+
+	passes = src->data[src->offset];
+	if (STPK_GET_FLAG(passes, STPK_PASSES_RECUR)) {
+		src->offset++;
+		passes &= STPK_PASSES_MASK;
+		stpk_getLength(src, &finalLen);
+	}
+	else {
+		passes = 1;
+	}
+
+	if (!passes) {
+		STPK_ERR2("Invalid source file. Number of passes is 0\n");
+		return 1;
+	}
+
+	if (maxPasses > 0 && maxPasses < passes) {
+		passes = maxPasses;
+	}
+
+	for (i = 0; i < passes; i++) {
+		if (stpk_stageOpen(&stream->stage, src, verbose, err)) {
+			stpk_streamClose(stream);
+			return 1;
+		}
+	}
+
+	stream->len = stream->stage->len;
+
+	return 0;
+}
+
+// Read the next len bytes of decompressed data, fewer only at the end.
+uint stpk_streamRead(stpk_Stream *stream, uchar *data, uint len, uint *read, char *err)
+{
+	if (len > stream->len - stream->offset) {
+		len = stream->len - stream->offset;
+	}
+
+	if (stpk_stageRead(stream->stage, data, len, read, stream->verbose, err)) {
+		return 1;
+	}
+
+	stream->offset += *read;
+
+	return 0;
+}
+
+void stpk_streamClose(stpk_Stream *stream)
+{
+	stpk_Stage *stage;
+
+	while ((stage = stream->stage) != NULL) {
+		stream->stage = stage->prev;
+
+		if (stage->inSize) {
+			free(stage->in.data);
+		}
+
+		free(stage->fastEsc);
+		free(stage);
+	}
+}
+
+// Add a pass reading from the last one, or from the compressed file if it's
+// the first.
+static uint stpk_stageOpen(stpk_Stage **last, stpk_Buffer *src, int verbose, char *err)
+{
+	stpk_Stage *stage;
+
+	if ((stage = (stpk_Stage*)calloc(1, sizeof(stpk_Stage))) == NULL) {
+		STPK_ERR2("Error allocating memory for decompression stage. (%s)\n", strerror(errno));
+		return 1;
+	}
+
+	stage->prev = *last;
+	*last = stage;
+
+	if (stage->prev == NULL) {
+		stage->in.data = src->data + src->offset;
+		stage->in.len = src->len - src->offset;
+	}
+	else {
+		if ((stage->in.data = (uchar*)malloc(sizeof(uchar) * STPK_STAGE_BUFLEN)) == NULL) {
+			STPK_ERR2("Error allocating memory for decompression stage. (%s)\n", strerror(errno));
+			return 1;
+		}
+
+		stage->inSize = STPK_STAGE_BUFLEN;
+	}
+
+	if (stpk_stageFill(stage, 4, verbose, err)) {
+		return 1;
+	}
+
+	if (stage->in.len - stage->in.offset < 4) {
+		STPK_ERR2("Reached EOF while parsing file header\n");
+		return 1;
+	}
+
+	stage->type = stage->in.data[stage->in.offset++];
+	stpk_getLength(&stage->in, &stage->len);
+
+	switch (stage->type) {
+		case STPK_TYPE_RLE:
+			return stpk_rleStreamInit(stage, verbose, err);
+		case STPK_TYPE_VLE:
+			return stpk_vleStreamInit(stage, verbose, err);
+		default:
+			STPK_ERR2("Error parsing source file. Expected type 1 (run-length) or 2 (variable-length), got %02X\n", stage->type);
+			return 1;
+	}
+}
+
+// Make at least need bytes available in the input window, fewer only at the
+// end of input. The window grows if need doesn't fit.
+static uint stpk_stageFill(stpk_Stage *stage, uint need, int verbose, char *err)
+{
+	stpk_Buffer *in = &stage->in;
+	uchar *data;
+	uint size, read;
+
+	if (in->len - in->offset >= need || stage->prev == NULL) {
+		return 0;
+	}
+
+	memmove(in->data, in->data + in->offset, in->len - in->offset);
+	in->len -= in->offset;
+	in->offset = 0;
+
+	if (need > stage->inSize) {
+		for (size = stage->inSize * 2; size < need; size *= 2);
+
+		if ((data = (uchar*)realloc(in->data, sizeof(uchar) * size)) == NULL) {
+			STPK_ERR2("Error allocating memory for decompression stage. (%s)\n", strerror(errno));
+			return 1;
+		}
+
+		in->data = data;
+		stage->inSize = size;
+	}
+
+	while (in->len < need && !stpk_stageDone(stage->prev)) {
+		if (stpk_stageRead(stage->prev, in->data + in->len, stage->inSize - in->len, &read, verbose, err)) {
+			return 1;
+		}
+
+		in->len += read;
+	}
+
+	return 0;
+}
+
+static uint stpk_stageRead(stpk_Stage *stage, uchar *data, uint len, uint *read, int verbose, char *err)
+{
+	switch (stage->type) {
+		case STPK_TYPE_RLE:
+			return stpk_rleStreamOne(stage, data, len, read, verbose, err);
+		case STPK_TYPE_VLE:
+			return stpk_vleStream(stage, data, len, read, verbose, err);
+		default:
+			return stpk_rleStreamSeq(stage, data, len, read, verbose, err);
+	}
+}
+
+// Whether all output is written. Sequence runs end with their input.
+static uint stpk_stageDone(stpk_Stage *stage)
+{
+	if (stage->type != STPK_STAGE_RLESEQ) {
+		return stage->offset >= stage->len;
+	}
+
+	return !stage->runLeft && stage->in.offset >= stage->in.len && (stage->prev == NULL || stpk_stageDone(stage->prev));
+}
+
+// Parse run-length header. Sequence runs get a stage of their own that takes
+// over the input, this one decodes single-byte runs from its output.
+static uint stpk_rleStreamInit(stpk_Stage *stage, int verbose, char *err)
+{
+	stpk_Buffer *in = &stage->in;
+	stpk_Stage *seq;
+	uint srcLen, i;
+	uchar escLen, esc[STPK_RLE_ESCLEN_MAX];
+
+	if (stpk_stageFill(stage, 5 + STPK_RLE_ESCLEN_MAX, verbose, err)) {
+		return 1;
+	}
+
+	if (in->len - in->offset < 5) {
+		STPK_ERR2("Reached end of source buffer while parsing run-length header\n");
+		return 1;
+	}
+
+	stpk_getLength(in, &srcLen);
+	in->offset++; // Unknown, 0.
+
+	escLen = in->data[in->offset++];
+
+	if ((escLen & STPK_RLE_ESCLEN_MASK) > STPK_RLE_ESCLEN_MAX) {
+		STPK_ERR2("escLen & STPK_RLE_ESCLEN_MASK greater than max length %02X, got %02X\n", STPK_RLE_ESCLEN_MAX, escLen & STPK_RLE_ESCLEN_MASK);
+		return 1;
+	}
+
+	if (in->len - in->offset < (uint)(escLen & STPK_RLE_ESCLEN_MASK)) {
+		STPK_ERR2("Reached end of source buffer while parsing run-length header\n");
+		return 1;
+	}
+
+	for (i = 0; i < (escLen & STPK_RLE_ESCLEN_MASK); i++) {
+		esc[i] = in->data[in->offset++];
+		stage->escLookup[esc[i]] = i + 1;
+	}
+
+	if (STPK_GET_FLAG(escLen, STPK_RLE_ESCLEN_NOSEQ)) {
+		return 0;
+	}
+
+	if ((seq = (stpk_Stage*)calloc(1, sizeof(stpk_Stage))) == NULL) {
+		STPK_ERR2("Error allocating memory for decompression stage. (%s)\n", strerror(errno));
+		return 1;
+	}
+
+	seq->type = STPK_STAGE_RLESEQ;
+	seq->prev = stage->prev;
+	seq->in = stage->in;
+	seq->inSize = stage->inSize;
+	seq->len = stage->len;
+	seq->esc = esc[STPK_RLE_ESCSEQ_POS];
+
+	stage->prev = seq;
+	stage->in.offset = stage->in.len = 0;
+
+	if ((stage->in.data = (uchar*)malloc(sizeof(uchar) * STPK_STAGE_BUFLEN)) == NULL) {
+		stage->inSize = 0;
+		STPK_ERR2("Error allocating memory for decompression stage. (%s)\n", strerror(errno));
+		return 1;
+	}
+
+	stage->inSize = STPK_STAGE_BUFLEN;
+
+	return 0;
+}
+
+// Decode sequence runs from the input window.
+static uint stpk_rleStreamSeq(stpk_Stage *stage, uchar *data, uint len, uint *read, int verbose, char *err)
+{
+	stpk_Buffer *in = &stage->in;
+	uchar *out = data, *end = data + len, *seq, *seqEnd;
+	uint avail, rep, n, i;
+
+	while (out < end) {
+		if (stage->runLeft) {
+			seq = in->data + in->offset + 1;
+			n = stage->runLeft < (uint)(end - out) ? stage->runLeft : (uint)(end - out);
+
+			// Up to one sequence from the window, then copies of what's written.
+			for (i = 0; i < n && i < stage->seqLen; i++) {
+				out[i] = seq[(stage->seqPos + i) % stage->seqLen];
+			}
+
+			for (; i < n; i += avail) {
+				rep = (i / stage->seqLen) * stage->seqLen;
+				avail = rep < n - i ? rep : n - i;
+				memcpy(out + i, out + i - rep, avail);
+			}
+
+			out += n;
+			stage->runLeft -= n;
+			stage->seqPos = (stage->seqPos + n) % stage->seqLen;
+
+			if (!stage->runLeft) {
+				in->offset += stage->seqLen + 3; // Escape codes and count.
+			}
+
+			continue;
+		}
+
+		if (stpk_stageFill(stage, 1, verbose, err)) {
+			return 1;
+		}
+
+		if (in->offset >= in->len) {
+			break;
+		}
+
+		if (in->data[in->offset] == stage->esc) {
+			// Whole sequence and its count must be in the window.
+			while ((seqEnd = (uchar*)memchr(in->data + in->offset + 1, stage->esc, in->len - in->offset - 1)) == NULL || seqEnd + 1 >= in->data + in->len) {
+				avail = in->len - in->offset;
+
+				if (stpk_stageFill(stage, avail + 1, verbose, err)) {
+					return 1;
+				}
+
+				if (in->len - in->offset <= avail) {
+					STPK_ERR2("Reached end of source buffer before finding sequence end escape code %02X\n", stage->esc);
+					return 1;
+				}
+			}
+
+			stage->seqLen = seqEnd - (in->data + in->offset + 1);
+			stage->seqPos = 0;
+			rep = seqEnd[1];
+
+			if ((!rep && stage->seqLen) || stage->seqLen * rep > stage->len - stage->offset - (out - data)) {
+				STPK_ERR2("Reached end of temporary buffer while writing repeated sequence\n");
+				return 1;
+			}
+
+			if (!(stage->runLeft = stage->seqLen * rep)) {
+				in->offset += stage->seqLen + 3;
+			}
+		}
+		else {
+			// Plain bytes up to the next sequence.
+			n = in->len - in->offset < (uint)(end - out) ? in->len - in->offset : (uint)(end - out);
+
+			if ((seqEnd = (uchar*)memchr(in->data + in->offset, stage->esc, n)) != NULL) {
+				n = seqEnd - (in->data + in->offset);
+			}
+
+			if (n > stage->len - stage->offset - (out - data)) {
+				STPK_ERR2("Reached end of temporary buffer while writing non-RLE byte\n");
+				return 1;
+			}
+
+			memcpy(out, in->data + in->offset, n);
+			out += n;
+			in->offset += n;
+		}
+	}
+
+	*read = out - data;
+	stage->offset += *read;
+
+	return 0;
+}
+
+// Decode single-byte runs from the input window.
+static uint stpk_rleStreamOne(stpk_Stage *stage, uchar *data, uint len, uint *read, int verbose, char *err)
+{
+	stpk_Buffer *in = &stage->in;
+	uchar *out = data, *end, *pos, *inEnd, cur;
+	uint rep, n;
+
+	end = data + (len < stage->len - stage->offset ? len : stage->len - stage->offset);
+
+	while (out < end) {
+		if (stage->runLeft) {
+			n = stage->runLeft < (uint)(end - out) ? stage->runLeft : (uint)(end - out);
+			memset(out, stage->runByte, n);
+			out += n;
+			stage->runLeft -= n;
+			continue;
+		}
+
+		if (stpk_stageFill(stage, 4, verbose, err)) {
+			return 1;
+		}
+
+		if (in->offset >= in->len) {
+			STPK_ERR2("Reached unexpected end of source buffer while decoding single-byte runs\n");
+			return 1;
+		}
+
+		cur = in->data[in->offset++];
+
+		if (stage->escLookup[cur]) {
+			n = stage->escLookup[cur] == 1 ? 2 : stage->escLookup[cur] == 3 ? 3 : 1;
+
+			if (in->len - in->offset < n) {
+				STPK_ERR2("Reached unexpected end of source buffer while decoding single-byte runs\n");
+				return 1;
+			}
+
+			switch (stage->escLookup[cur]) {
+				case 1:
+					rep = in->data[in->offset];
+					break;
+				case 3:
+					rep = in->data[in->offset] | in->data[in->offset + 1] << 8;
+					break;
+				default:
+					rep = stage->escLookup[cur] - 1;
+			}
+
+			in->offset += n;
+
+			if (rep > stage->len - stage->offset - (out - data)) {
+				STPK_ERR2("Reached end of temporary buffer while writing byte run\n");
+				return 1;
+			}
+
+			stage->runByte = in->data[in->offset - 1];
+			stage->runLeft = rep;
+		}
+		else {
+			*out++ = cur;
+
+			// Plain bytes up to the next escape code.
+			for (pos = in->data + in->offset, inEnd = in->data + in->len; out < end && pos < inEnd && !stage->escLookup[*pos]; pos++) {
+				*out++ = *pos;
+			}
+
+			in->offset = pos - in->data;
+		}
+	}
+
+	*read = out - data;
+	stage->offset += *read;
+
+	return 0;
+}
+
+// Parse variable-length header and generate lookup tables.
+static uint stpk_vleStreamInit(stpk_Stage *stage, int verbose, char *err)
+{
+	stpk_Buffer *in = &stage->in;
+	ushort esc1[STPK_VLE_ESCARR_LEN], esc2[STPK_VLE_ESCARR_LEN];
+	uint i, widthsOffset, alphLen;
+	uchar widthsLen;
+
+	if (stpk_stageFill(stage, STPK_STAGE_HDRLEN, verbose, err)) {
+		return 1;
+	}
+
+	if (in->offset >= in->len) {
+		STPK_ERR2("Reached end of source buffer while parsing variable-length header\n");
+		return 1;
+	}
+
+	widthsLen = in->data[in->offset++];
+	widthsOffset = in->offset;
+
+	if (STPK_GET_FLAG(widthsLen, STPK_VLE_WDTLEN_UNK)) {
+		STPK_ERR2("Invalid source file. Unknown flag set in widthsLen\n");
+		return 1;
+	}
+	else if ((widthsLen & STPK_VLE_WDTLEN_MASK) > STPK_VLE_WDTLEN_MAX) {
+		STPK_ERR2("widthsLen & STPK_VLE_WDTLEN_MASK greater than %02X, got %02X\n", STPK_VLE_WDTLEN_MAX, widthsLen & STPK_VLE_WDTLEN_MASK);
+		return 1;
+	}
+
+	if (in->len - in->offset < widthsLen) {
+		STPK_ERR2("Reached end of source buffer while parsing variable-length header\n");
+		return 1;
+	}
+
+	alphLen = stpk_vleGenEsc(in, esc1, esc2, widthsLen, 0);
+
+	if (alphLen > STPK_VLE_ALPH_LEN) {
+		STPK_ERR2("alphLen greater than %02X, got %02X\n", STPK_VLE_ALPH_LEN, alphLen);
+		return 1;
+	}
+
+	if (in->len - in->offset < alphLen) {
+		STPK_ERR2("Reached end of source buffer while parsing variable-length header\n");
+		return 1;
+	}
+
+	for (i = 0; i < alphLen; i++) stage->alphabet[i] = in->data[in->offset++];
+
+	i = in->offset;
+	in->offset = widthsOffset;
+	stpk_vleGenLookup(in, widthsLen, stage->alphabet, stage->symbols, stage->widths, 0);
+	in->offset = i;
+
+	stpk_vleGenFast(stage->symbols, stage->widths, stage->fast);
+
+	// Escapes only follow the prefixes left after the short codes.
+	for (stage->escFirst = 0; stage->escFirst < STPK_VLE_ALPH_LEN && stage->widths[stage->escFirst] <= 8; stage->escFirst++);
+
+	stage->widthsLen = widthsLen;
+
+	if (widthsLen > 8 && stage->escFirst < STPK_VLE_ALPH_LEN) {
+		if ((stage->fastEsc = (ushort*)malloc((sizeof(ushort) * (STPK_VLE_ALPH_LEN - stage->escFirst)) << (widthsLen - 8))) == NULL) {
+			STPK_ERR2("Error allocating memory for escape lookup table. (%s)\n", strerror(errno));
+			return 1;
+		}
+
+		stpk_vleGenFastEsc(widthsLen, stage->escFirst, esc1, esc2, stage->fastEsc);
+	}
+
+	return 0;
+}
+
+// Decode variable-length codes through lookup tables, several short codes per
+// lookup and escapes in one step. Same output as stpk_vleDecode(), the bit
+// buffer is kept between reads.
+static uint stpk_vleStream(stpk_Stage *stage, uchar *data, uint len, uint *read, int verbose, char *err)
+{
+	stpk_Buffer *in = &stage->in;
+	uchar *out = data, *end, *pos, *inEnd, code;
+	uint entry, width;
+	uint64_t bitBuf = stage->bitBuf;
+	int bitCount = stage->bitCount;
+
+	end = data + (len < stage->len - stage->offset ? len : stage->len - stage->offset);
+	pos = in->data + in->offset;
+	inEnd = in->data + in->len;
+
+	while (out < end) {
+		// Short codes while a full refill and all symbols of an entry fit.
+		while (end - out >= STPK_VLE_FAST_SYMBS && inEnd - pos >= 8) {
+			while (bitCount <= 56) {
+				bitBuf |= (uint64_t)*pos++ << (56 - bitCount);
+				bitCount += 8;
+			}
+
+			entry = stage->fast[bitBuf >> (64 - STPK_VLE_FAST_BITS)];
+
+			if (!STPK_VLE_FAST_COUNT(entry)) {
+				break;
+			}
+
+			out[0] = entry >> 8;
+			out[1] = entry >> 16;
+			out[2] = entry >> 24;
+			out += STPK_VLE_FAST_COUNT(entry);
+
+			width = STPK_VLE_FAST_WIDTH(entry);
+			bitBuf <<= width;
+			bitCount -= width;
+		}
+
+		if (out >= end) {
+			break;
+		}
+
+		// One code at a time near the ends, or escaped.
+		if (inEnd - pos < 8) {
+			in->offset = pos - in->data;
+
+			if (stpk_stageFill(stage, 8, verbose, err)) {
+				return 1;
+			}
+
+			pos = in->data + in->offset;
+			inEnd = in->data + in->len;
+		}
+
+		while (bitCount <= 56) {
+			if (pos < inEnd) {
+				bitBuf |= (uint64_t)*pos++ << (56 - bitCount);
+			}
+			else {
+				stage->pad++;
+			}
+
+			bitCount += 8;
+		}
+
+		code = bitBuf >> 56;
+
+		if (stage->widths[code] <= 8) {
+			*out++ = stage->symbols[code];
+			width = stage->widths[code];
+		}
+		else {
+			entry = stage->fastEsc != NULL ? stage->fastEsc[(bitBuf >> (64 - stage->widthsLen)) - (stage->escFirst << (stage->widthsLen - 8))] : 0;
+
+			if (!entry) {
+				STPK_ERR2("Escape array index out of bounds (%04X >= %04X)\n", stage->widthsLen, STPK_VLE_ESCARR_LEN);
+				return 1;
+			}
+
+			if (entry == STPK_VLE_FAST_ESC_BAD) {
+				STPK_ERR2("Alphabet index out of bounds (> %04X)\n", STPK_VLE_ALPH_LEN);
+				return 1;
+			}
+
+			*out++ = stage->alphabet[entry & 0xFF];
+			width = entry >> 8;
+		}
+
+		bitBuf <<= width;
+		bitCount -= width;
+
+		// Codes read into the zero padding past the end of input.
+		if (bitCount < (int)stage->pad * 8 && stage->offset + (out - data) < stage->len) {
+			STPK_ERR2("Reached unexpected end of source buffer while decoding variable-length compression codes\n");
+			return 1;
+		}
+	}
+
+	in->offset = pos - in->data;
+	stage->bitBuf = bitBuf;
+	stage->bitCount = bitCount;
+
+	*read = out - data;
+	stage->offset += *read;
+
+	return 0;
+}
+
+// Compress source into the smallest of run-length, variable-length or both
+// passes. Destination is left empty if none of them makes it smaller.
+uint stpk_comp(stpk_Buffer *src, stpk_Buffer *dst, int verbose, char *err)
+{
+	stpk_Buffer rle, vle, both;
+	uint retval = 1;
+
+	rle.data = vle.data = both.data = dst->data = NULL;
+	rle.len = vle.len = both.len = dst->len = dst->offset = 0;
+
+	if (src->len == 0 || src->len > STPK_MAX_SIZE) {
+		return 0;
+	}
+
+	if (stpk_compRLE(src, &rle, verbose, err) || stpk_compVLE(src, &vle, 0, verbose, err)) {
+		goto freeBufs;
+	}
+
+	// Variable-length pass on top of the run-length one, after a header for both.
+	if (rle.data != NULL && stpk_compVLE(&rle, &both, 4, verbose, err)) {
+		goto freeBufs;
+	}
+
+	if (both.data != NULL) {
+		both.data[0] = STPK_PASSES_RECUR | 2;
+		stpk_putLength(both.data + 1, src->len);
+	}
+
+	dst->len = src->len;
+
+	if (rle.data != NULL && rle.len < dst->len) {
+		*dst = rle;
+	}
+	if (vle.data != NULL && vle.len < dst->len) {
+		*dst = vle;
+	}
+	if (both.data != NULL && both.len < dst->len) {
+		*dst = both;
+	}
+
+	if (dst->data == NULL) {
+		dst->len = 0;
+	}
+
+	STPK_VERBOSE1("  %-10s %d\n", "rleLen", rle.len);
+	STPK_VERBOSE1("  %-10s %d\n", "vleLen", vle.len);
+	STPK_VERBOSE1("  %-10s %d\n", "bothLen", both.len);
+
+	retval = 0;
+
+freeBufs:
+	if (rle.data != dst->data) free(rle.data);
+	if (vle.data != dst->data) free(vle.data);
+	if (both.data != dst->data) free(both.data);
+
+	return retval;
+}
+
+// Run-length encode source. The least frequent bytes become escape codes,
+// sequence runs need one that isn't in the source. Destination is left
+// empty if the encoding isn't smaller.
+uint stpk_compRLE(stpk_Buffer *src, stpk_Buffer *dst, int verbose, char *err)
+{
+	uint freq[STPK_RLE_ESCLOOKUP_LEN], runs[STPK_RLE_ESCLEN_MAX], order[STPK_RLE_ESCLOOKUP_LEN];
+	uint i, j, len, escLen, seq, hdrLen;
+	int gain, bestGain;
+	uchar esc[STPK_RLE_ESCLEN_MAX], escLookup[STPK_RLE_ESCLOOKUP_LEN];
+	stpk_Buffer one;
+
+	dst->data = NULL;
+	dst->len = dst->offset = 0;
+
+	memset(freq, 0, sizeof(freq));
+	memset(runs, 0, sizeof(runs));
+
+	// Byte frequencies and short runs that could have an escape code of their own.
+	for (i = 0; i < src->len; i += len) {
+		for (len = 1; i + len < src->len && src->data[i + len] == src->data[i]; len++);
+
+		if (len < STPK_RLE_ESCLEN_MAX) {
+			runs[len]++;
+		}
+
+		freq[src->data[i]] += len;
+	}
+
+	// Least frequent first.
+	for (i = 0; i < STPK_RLE_ESCLOOKUP_LEN; i++) {
+		for (j = i; j > 0 && freq[order[j - 1]] > freq[i]; j--) {
+			order[j] = order[j - 1];
+		}
+
+		order[j] = i;
+	}
+
+	// Sequence runs need an unused byte as escape code, one that is no valid
+	// count for the shortest runs.
+	for (i = 0, seq = 0; i < STPK_RLE_ESCLOOKUP_LEN && !freq[order[i]]; i++) {
+		if (order[i] >= 3) {
+			j = order[i];
+			order[i] = order[0];
+			order[0] = j;
+			seq = 1;
+			break;
+		}
+	}
+
+	// Escape codes 3 and up encode runs of their own length, saving a byte
+	// each. Escape codes cost two extra bytes where they are plain bytes.
+	for (escLen = i = 3, gain = bestGain = 0; i < STPK_RLE_ESCLEN_MAX; i++) {
+		gain += (int)runs[i] - 2 * (int)freq[order[i]];
+
+		if (gain > bestGain) {
+			bestGain = gain;
+			escLen = i + 1;
+		}
+	}
+
+	// The unused byte is the sequence escape code.
+	esc[STPK_RLE_ESCSEQ_POS] = order[0];
+	esc[0] = order[1];
+	for (i = 2; i < escLen; i++) esc[i] = order[i];
+
+	memset(escLookup, 0, sizeof(escLookup));
+	for (i = 0; i < escLen; i++) escLookup[esc[i]] = i + 1;
+
+	// Single-byte runs, at most three bytes for each source byte.
+	one.len = src->len * 3;
+	one.offset = 0;
+
+	if ((one.data = (uchar*)malloc(sizeof(uchar) * one.len)) == NULL) {
+		STPK_ERR2("Error allocating memory for run-length buffer. (%s)\n", strerror(errno));
+		return 1;
+	}
+
+	for (i = 0; i < src->len; i += len) {
+		for (len = 1; i + len < src->len && src->data[i + len] == src->data[i]; len++);
+		stpk_rleEncodeRun(&one, src->data[i], len, esc, escLen, escLookup, seq);
+	}
+
+	// Sequence runs are decoded into a buffer of the final length, the
+	// single-byte runs must fit it.
+	if (one.offset > src->len) {
+		free(one.data);
+		return 0;
+	}
+
+	hdrLen = 9 + escLen;
+
+	if ((dst->data = (uchar*)malloc(sizeof(uchar) * (hdrLen + one.offset))) == NULL) {
+		STPK_ERR2("Error allocating memory for run-length buffer. (%s)\n", strerror(errno));
+		free(one.data);
+		return 1;
+	}
+
+	dst->offset = hdrLen;
+
+	if (seq) {
+		stpk_rleEncodeSeq(&one, dst, esc[STPK_RLE_ESCSEQ_POS]);
+	}
+	else {
+		memcpy(dst->data + dst->offset, one.data, one.offset);
+		dst->offset += one.offset;
+	}
+
+	free(one.data);
+
+	if (dst->offset - hdrLen >= src->len) {
+		free(dst->data);
+		dst->data = NULL;
+		dst->offset = 0;
+		return 0;
+	}
+
+	dst->data[0] = STPK_TYPE_RLE;
+	stpk_putLength(dst->data + 1, src->len);
+	stpk_putLength(dst->data + 4, dst->offset - hdrLen);
+	dst->data[7] = 0;
+	dst->data[8] = escLen | (seq ? 0 : STPK_RLE_ESCLEN_NOSEQ);
+	memcpy(dst->data + 9, esc, escLen);
+
+	dst->len = dst->offset;
+	dst->offset = 0;
+
+	STPK_VERBOSE1("  %-10s %d (no sequences = %d)\n", "escLen", escLen, !seq);
+	STPK_VERBOSE_ARR(esc, escLen, "esc");
+
+	return 0;
+}
+
+// Write run of len bytes as plain bytes or escape codes. Counts must not be
+// taken for the sequence escape code when sequences are on.
+void stpk_rleEncodeRun(stpk_Buffer *dst, uchar cur, uint len, uchar *esc, uint escLen, uchar *escLookup, uint seq)
+{
+	uchar *out = dst->data + dst->offset;
+	uchar seqEsc = esc[STPK_RLE_ESCSEQ_POS];
+	uint rep;
+
+	while (len) {
+		if (len <= 2 && !escLookup[cur]) {
+			*out++ = cur;
+			len--;
+		}
+		else if (len == 1 && !seq) {
+			*out++ = seqEsc; // Run of one.
+			*out++ = cur;
+			len = 0;
+		}
+		else if (len >= 3 && len < escLen) {
+			*out++ = esc[len];
+			*out++ = cur;
+			len = 0;
+		}
+		else if (len <= 0xFF) {
+			rep = (seq && len == seqEsc) ? len - 1 : len;
+			*out++ = esc[0];
+			*out++ = rep;
+			*out++ = cur;
+			len -= rep;
+		}
+		else {
+			for (rep = len < 0xFFFF ? len : 0xFFFF; seq && ((rep & 0xFF) == seqEsc || (rep >> 8) == seqEsc); rep--);
+			*out++ = esc[2];
+			*out++ = rep & 0xFF;
+			*out++ = rep >> 8;
+			*out++ = cur;
+			len -= rep;
+		}
+	}
+
+	dst->offset = out - dst->data;
+}
+
+// Replace repeated sequences in single-byte run data with sequence runs,
+// greedily taking the one that saves the most at each position.
+void stpk_rleEncodeSeq(stpk_Buffer *src, stpk_Buffer *dst, uchar esc)
+{
+	uint i, len, rep, save, bestLen, bestRep, bestSave;
+	uchar *data = src->data;
+
+	for (i = 0; i < src->offset;) {
+		bestLen = bestRep = bestSave = 0;
+
+		for (len = 1; len <= STPK_RLE_SEQ_MAX && i + 2 * len <= src->offset; len++) {
+			for (rep = 1; rep < 0xFF && i + (rep + 1) * len <= src->offset && data[i + rep * len] == data[i] && !memcmp(data + i, data + i + rep * len, len); rep++);
+
+			save = len * rep;
+			save = save > len + 3 ? save - len - 3 : 0;
+
+			if (save > bestSave) {
+				bestLen = len;
+				bestRep = rep;
+				bestSave = save;
+			}
+		}
+
+		if (bestSave) {
+			dst->data[dst->offset++] = esc;
+			memcpy(dst->data + dst->offset, data + i, bestLen);
+			dst->offset += bestLen;
+			dst->data[dst->offset++] = esc;
+			dst->data[dst->offset++] = bestRep;
+			i += bestLen * bestRep;
+		}
+		else {
+			dst->data[dst->offset++] = data[i++];
+		}
+	}
+}
+
+// Variable-length encode source with a canonical Huffman code, after hdrLen
+// bytes left for the caller. Destination is left empty if there are too
+// many codes of one width for the header.
+uint stpk_compVLE(stpk_Buffer *src, stpk_Buffer *dst, uint hdrLen, int verbose, char *err)
+{
+	uint freq[STPK_VLE_ALPH_LEN], codes[STPK_VLE_ALPH_LEN], counts[STPK_VLE_WDTLEN_MAX + 1];
+	uint i, width, widthsLen, alphLen = 0, code = 0, bits = 0, bitCount = 0;
+	uchar widths[STPK_VLE_ALPH_LEN], alphabet[STPK_VLE_ALPH_LEN], *out;
+
+	dst->data = NULL;
+	dst->len = dst->offset = 0;
+
+	memset(freq, 0, sizeof(freq));
+	memset(counts, 0, sizeof(counts));
+
+	for (i = 0; i < src->len; i++) freq[src->data[i]]++;
+
+	widthsLen = stpk_vleGenWidths(freq, widths);
+
+	// Alphabet ordered by width, codes counting up within each width.
+	for (width = 1; width <= widthsLen; width++, code <<= 1) {
+		for (i = 0; i < STPK_VLE_ALPH_LEN; i++) {
+			if (freq[i] && widths[i] == width) {
+				alphabet[alphLen++] = i;
+				codes[i] = code++;
+				counts[width]++;
+			}
+		}
+
+		if (counts[width] > 0xFF) {
+			return 0;
+		}
+	}
+
+	for (i = 0, bits = 0; i < STPK_VLE_ALPH_LEN; i++) bits += freq[i] * widths[i];
+
+	// The decoder reads a byte ahead of the codes.
+	dst->len = hdrLen + 5 + widthsLen + alphLen + (bits + 7) / 8 + 1;
+
+	if ((dst->data = (uchar*)malloc(sizeof(uchar) * dst->len)) == NULL) {
+		STPK_ERR2("Error allocating memory for variable-length buffer. (%s)\n", strerror(errno));
+		dst->len = 0;
+		return 1;
+	}
+
+	out = dst->data + hdrLen;
+	*out++ = STPK_TYPE_VLE;
+	stpk_putLength(out, src->len);
+	out += 3;
+	*out++ = widthsLen;
+	for (width = 1; width <= widthsLen; width++) *out++ = counts[width];
+	memcpy(out, alphabet, alphLen);
+	out += alphLen;
+
+	// Codes MSB first, last byte zero padded.
+	for (i = 0, bits = 0; i < src->len; i++) {
+		bits = (bits << widths[src->data[i]]) | codes[src->data[i]];
+		bitCount += widths[src->data[i]];
+
+		while (bitCount >= 8) {
+			bitCount -= 8;
+			*out++ = bits >> bitCount;
+		}
+	}
+
+	if (bitCount) {
+		*out++ = bits << (8 - bitCount);
+	}
+
+	*out = 0;
+
+	STPK_VERBOSE1("  %-10s %d\n", "widthsLen", widthsLen);
+	STPK_VERBOSE_ARR(alphabet, alphLen, "alphabet");
+
+	return 0;
+}
+
+// Huffman code widths for the bytes in use, limited to STPK_VLE_WDTLEN_MAX by
+// flattening the frequencies until they fit. Returns the longest width.
+uint stpk_vleGenWidths(uint *freq, uchar *widths)
+{
+	uint weight[STPK_VLE_ALPH_LEN * 2], parent[STPK_VLE_ALPH_LEN * 2], symbs[STPK_VLE_ALPH_LEN], scaled[STPK_VLE_ALPH_LEN];
+	uint i, j, a, b, count, nodes, maxWidth;
+	uchar active[STPK_VLE_ALPH_LEN * 2];
+
+	memcpy(scaled, freq, sizeof(scaled));
+	memset(widths, 0, STPK_VLE_ALPH_LEN);
+
+	for (;;) {
+		for (i = 0, count = 0; i < STPK_VLE_ALPH_LEN; i++) {
+			if (scaled[i]) {
+				symbs[count] = i;
+				weight[count] = scaled[i];
+				active[count++] = 1;
+			}
+		}
+
+		if (count == 1) {
+			widths[symbs[0]] = 1;
+			return 1;
+		}
+
+		// Merge the two lightest nodes until one is left.
+		for (nodes = count; nodes < count * 2 - 1; nodes++) {
+			for (a = b = nodes, i = 0; i < nodes; i++) {
+				if (!active[i]) {
+					continue;
+				}
+
+				if (a == nodes || weight[i] < weight[a]) {
+					b = a;
+					a = i;
+				}
+				else if (b == nodes || weight[i] < weight[b]) {
+					b = i;
+				}
+			}
+
+			weight[nodes] = weight[a] + weight[b];
+			parent[a] = parent[b] = nodes;
+			active[a] = active[b] = 0;
+			active[nodes] = 1;
+		}
+
+		for (i = 0, maxWidth = 0; i < count; i++) {
+			for (j = i, widths[symbs[i]] = 0; j != nodes - 1; j = parent[j]) widths[symbs[i]]++;
+
+			if (widths[symbs[i]] > maxWidth) {
+				maxWidth = widths[symbs[i]];
+			}
+		}
+
+		if (maxWidth <= STPK_VLE_WDTLEN_MAX) {
+			return maxWidth;
+		}
+
+		for (i = 0; i < STPK_VLE_ALPH_LEN; i++) {
+			if (scaled[i]) {
+				scaled[i] = scaled[i] / 2 + 1;
+			}
+		}
+	}
+}
+
+// Read file length: WORD remainder + BYTE multiplier * 0x10000.
+inline void stpk_getLength(stpk_Buffer *buf, uint *len)
+{
+	*len =  buf->data[buf->offset] | buf->data[buf->offset + 1] << 8; // Read remainder.
+	*len += 0x10000 * buf->data[buf->offset + 2]; // Add multiplier.
+	buf->offset += 3;
+}
+
+// Write file length, see stpk_getLength().
+void stpk_putLength(uchar *data, uint len)
+{
+	data[0] = len & 0xFF;
+	data[1] = (len >> 8) & 0xFF;
+	data[2] = len >> 16;
 }
 
 // Write bit values as string to stpk_b16. Used in verbose output.
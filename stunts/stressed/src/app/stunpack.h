@@ -20,6 +20,8 @@
 #ifndef STPK_STUNPACK_H
 #define STPK_STUNPACK_H
 
+#include <stdint.h>
+
 #define STPK_VERSION "0.1.0"
 #define STPK_NAME    "stunpack"
 #define STPK_BUGS    "daniel@stien.org"
@@ -52,6 +54,7 @@
 #define STPK_RLE_ESCLEN_NOSEQ  0x80
 #define STPK_RLE_ESCLOOKUP_LEN 0x100
 #define STPK_RLE_ESCSEQ_POS    0x01
+#define STPK_RLE_SEQ_MAX       0x40
 
 #define STPK_VLE_WDTLEN_MASK   0x7F
 #define STPK_VLE_WDTLEN_MAX    0x0F
@@ -62,6 +65,18 @@
 #define STPK_VLE_ESC_WIDTH     0x40
 #define STPK_VLE_BYTE_MSB      0x80
 
+#define STPK_VLE_FAST_BITS     12
+#define STPK_VLE_FAST_LEN      (1 << STPK_VLE_FAST_BITS)
+#define STPK_VLE_FAST_SYMBS    3
+#define STPK_VLE_FAST_ENTRY(count, bits, symbs) ((count) | ((bits) << 2) | ((symbs) << 8))
+#define STPK_VLE_FAST_COUNT(x) ((x) & 0x03)
+#define STPK_VLE_FAST_WIDTH(x) (((x) >> 2) & 0x3F)
+#define STPK_VLE_FAST_ESC_BAD  0xFFFF
+
+#define STPK_STAGE_RLESEQ      0x10
+#define STPK_STAGE_BUFLEN      0x1000
+#define STPK_STAGE_HDRLEN      0x110
+
 typedef unsigned char  uchar;
 typedef unsigned short ushort;
 typedef unsigned int   uint;
@@ -72,19 +87,69 @@ typedef struct {
 	uint  len;
 } stpk_Buffer;
 
+// One decoding step of a stream. Output is pulled on demand, a stage reads
+// its input through a bounded window filled from the previous stage or
+// straight from the compressed file.
+typedef struct stpk_Stage {
+	uchar type;
+	struct stpk_Stage *prev;
+	stpk_Buffer in;
+	uint  inSize; // 0 if the window is the compressed file.
+	uint  offset;
+	uint  len;    // Output length, upper limit for sequence runs.
+
+	// Run being written. Sequences are kept in the window after the escape code at in.offset.
+	uint  runLeft;
+	uint  seqLen;
+	uint  seqPos;
+	uchar runByte;
+
+	uchar esc, escLookup[STPK_RLE_ESCLOOKUP_LEN];
+
+	uint  widthsLen, escFirst, pad;
+	uchar alphabet[STPK_VLE_ALPH_LEN], symbols[STPK_VLE_ALPH_LEN], widths[STPK_VLE_ALPH_LEN];
+	uint  fast[STPK_VLE_FAST_LEN];
+	ushort *fastEsc;
+	uint64_t bitBuf;
+	int   bitCount;
+} stpk_Stage;
+
+typedef struct {
+	stpk_Stage *stage; // Last pass.
+	uint  offset;
+	uint  len;
+	int   verbose;
+} stpk_Stream;
+
 #ifdef __cplusplus
-extern "C"
+extern "C" {
 #endif
 uint stpk_decomp(stpk_Buffer *src, stpk_Buffer *dst, int maxPasses, int verbose, char *err);
+uint stpk_comp(stpk_Buffer *src, stpk_Buffer *dst, int verbose, char *err);
+uint stpk_streamOpen(stpk_Stream *stream, stpk_Buffer *src, int maxPasses, int verbose, char *err);
+uint stpk_streamRead(stpk_Stream *stream, uchar *data, uint len, uint *read, char *err);
+void stpk_streamClose(stpk_Stream *stream);
+#ifdef __cplusplus
+}
+#endif
+
+uint stpk_compRLE(stpk_Buffer *src, stpk_Buffer *dst, int verbose, char *err);
+void stpk_rleEncodeRun(stpk_Buffer *dst, uchar cur, uint len, uchar *esc, uint escLen, uchar *escLookup, uint seq);
+void stpk_rleEncodeSeq(stpk_Buffer *src, stpk_Buffer *dst, uchar esc);
 
 uint stpk_decompRLE(stpk_Buffer *src, stpk_Buffer *dst, int verbose, char *err);
 uint stpk_rleDecodeSeq(stpk_Buffer *src, stpk_Buffer *dst, uchar esc, int verbose, char *err);
 uint stpk_rleDecodeOne(stpk_Buffer *src, stpk_Buffer *dst, uchar *esc, int verbose, char *err);
 
+uint stpk_compVLE(stpk_Buffer *src, stpk_Buffer *dst, uint hdrLen, int verbose, char *err);
+uint stpk_vleGenWidths(uint *freq, uchar *widths);
+
 uint stpk_decompVLE(stpk_Buffer *src, stpk_Buffer *dst, int verbose, char *err);
 uint stpk_vleGenEsc(stpk_Buffer *src, ushort *esc1, ushort *esc2, uint widthsLen, int verbose);
 void stpk_vleGenLookup(stpk_Buffer *src, uint widthsLen, uchar *alphabet, uchar *symbols, uchar *widths, int verbose);
 uint stpk_vleDecode(stpk_Buffer *src, stpk_Buffer *dst, uchar *alphabet, uchar *symbols, uchar *widths, ushort *esc1, ushort *esc2, int verbose, char *err);
+void stpk_vleGenFast(uchar *symbols, uchar *widths, uint *fast);
+void stpk_vleGenFastEsc(uint widthsLen, uint escFirst, ushort *esc1, ushort *esc2, ushort *fastEsc);
 
 char *stpk_stringBits16(ushort val);
 void stpk_printArray(uchar *arr, uint len, char *name);
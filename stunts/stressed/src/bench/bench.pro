@@ -0,0 +1,14 @@
+TEMPLATE = app
+
+CONFIG += console warn_on
+CONFIG -= qt app_bundle
+
+TARGET = stpkbench
+
+DEPENDPATH  += ../app
+INCLUDEPATH += $$DEPENDPATH
+
+HEADERS += stunpack.h
+
+SOURCES += stpkbench.c \
+           stunpack.c
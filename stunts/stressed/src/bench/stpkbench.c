@@ -0,0 +1,259 @@
+/*
+ * stpkbench - Decompression benchmark for stunpack
+ * Copyright (C) 2008 Daniel Stien <daniel@stien.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stunpack.h"
+
+// Minimum run time per file.
+#define STPK_BENCH_SECONDS 1.0
+
+// Round trip input size and number of random mixes.
+#define STPK_BENCH_RTLEN 0x10000
+#define STPK_BENCH_MIXES 200
+
+// Read whole file, caller frees.
+uchar *stpk_benchRead(const char *fileName, uint *len)
+{
+	FILE *file;
+	uchar *data = NULL;
+	long size;
+
+	if ((file = fopen(fileName, "rb")) == NULL) {
+		fprintf(stderr, "Can't open \"%s\". (%s)\n", fileName, strerror(errno));
+		return NULL;
+	}
+
+	if (fseek(file, 0, SEEK_END) || (size = ftell(file)) <= 0 || size > STPK_MAX_SIZE || fseek(file, 0, SEEK_SET)) {
+		fprintf(stderr, "Can't get a valid file size for \"%s\".\n", fileName);
+	}
+	else if ((data = (uchar*)malloc(size)) == NULL) {
+		fprintf(stderr, "Error allocating memory for \"%s\". (%s)\n", fileName, strerror(errno));
+	}
+	else if (fread(data, 1, size, file) != (size_t)size) {
+		fprintf(stderr, "Can't read \"%s\".\n", fileName);
+		free(data);
+		data = NULL;
+	}
+	else {
+		*len = size;
+	}
+
+	fclose(file);
+
+	return data;
+}
+
+// Decompress through the stream stages, the source is left as is.
+uint stpk_benchDecomp(uchar *data, uint len, uint *dstLen, char *err)
+{
+	stpk_Buffer src, dst;
+	uint retval;
+
+	src.data = data;
+	src.len = len;
+	src.offset = 0;
+
+	dst.data = NULL;
+	dst.len = dst.offset = 0;
+
+	retval = stpk_decomp(&src, &dst, 0, 0, err);
+	*dstLen = dst.len;
+
+	free(dst.data);
+
+	return retval;
+}
+
+// Compress data and decompress it again, 1 on any difference. Data that
+// doesn't get smaller is left unpacked, which isn't a failure.
+uint stpk_benchRoundTrip(const char *name, uchar *data, uint len)
+{
+	stpk_Buffer src, dst, check;
+	uint retval = 1;
+	char err[256];
+
+	src.data = data;
+	src.len = len;
+	src.offset = 0;
+
+	err[0] = '\0';
+	if (stpk_comp(&src, &dst, 0, err)) {
+		printf("%-16s %8d %8s FAILED (%s)\n", name, len, "", err);
+		return 1;
+	}
+
+	if (dst.data == NULL) {
+		printf("%-16s %8d %8s unpacked\n", name, len, "");
+		return 0;
+	}
+
+	check.data = NULL;
+	check.len = check.offset = 0;
+
+	if (stpk_decomp(&dst, &check, 0, 0, err)) {
+		printf("%-16s %8d %8d FAILED (%s)\n", name, len, dst.len, err);
+	}
+	else if (check.len != len || memcmp(check.data, data, len)) {
+		printf("%-16s %8d %8d FAILED (differs)\n", name, len, dst.len);
+	}
+	else {
+		printf("%-16s %8d %8d ok\n", name, len, dst.len);
+		retval = 0;
+	}
+
+	free(dst.data);
+	free(check.data);
+
+	return retval;
+}
+
+// Round trip generated inputs and random mixes of them.
+int stpk_benchRoundTrips()
+{
+	uchar *data;
+	uint len, pos, run, mod, i, j, failed = 0;
+	char name[32];
+	const char *pattern = "abcabcabcXYZ";
+
+	if ((data = (uchar*)malloc(STPK_BENCH_RTLEN)) == NULL) {
+		fprintf(stderr, "Error allocating memory for round trip data. (%s)\n", strerror(errno));
+		return 1;
+	}
+
+	srand(1);
+
+	printf("%-16s %8s %8s\n", "input", "srcLen", "dstLen");
+
+	failed += stpk_benchRoundTrip("empty", data, 0);
+
+	data[0] = 'x';
+	failed += stpk_benchRoundTrip("one byte", data, 1);
+
+	memset(data, 0x41, STPK_BENCH_RTLEN);
+	failed += stpk_benchRoundTrip("uniform", data, STPK_BENCH_RTLEN);
+
+	for (i = 0; i < STPK_BENCH_RTLEN; i++) data[i] = rand();
+	failed += stpk_benchRoundTrip("random", data, STPK_BENCH_RTLEN);
+
+	for (pos = 0; pos < STPK_BENCH_RTLEN; pos += run) {
+		run = 1 + rand() % 300;
+		run = run < STPK_BENCH_RTLEN - pos ? run : STPK_BENCH_RTLEN - pos;
+		memset(data + pos, rand() % 8, run);
+	}
+	failed += stpk_benchRoundTrip("runs", data, STPK_BENCH_RTLEN);
+
+	for (i = 0; i < STPK_BENCH_RTLEN; i++) data[i] = pattern[i % strlen(pattern)];
+	failed += stpk_benchRoundTrip("periodic", data, STPK_BENCH_RTLEN);
+
+	// Runs, repeated patterns and noise of random lengths.
+	for (i = 0; i < STPK_BENCH_MIXES; i++) {
+		len = rand() % STPK_BENCH_RTLEN;
+
+		for (pos = 0; pos < len; pos += run) {
+			run = 1 + rand() % 600;
+			run = run < len - pos ? run : len - pos;
+
+			mod = 1 + rand() % 256;
+
+			switch (rand() % 3) {
+				case 0:
+					memset(data + pos, rand(), run);
+					break;
+				case 1:
+					for (j = 0; j < run; j++) data[pos + j] = pattern[j % (mod % strlen(pattern) + 1)];
+					break;
+				default:
+					for (j = 0; j < run; j++) data[pos + j] = rand() % mod;
+			}
+		}
+
+		snprintf(name, sizeof(name), "mix %d", i);
+		failed += stpk_benchRoundTrip(name, data, len);
+	}
+
+	free(data);
+
+	printf("%d failed\n", failed);
+
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	uchar *data;
+	uint len, dstLen, runs, files = 0;
+	double secs, totalSecs = 0, totalBytes = 0;
+	clock_t start;
+	char err[256];
+	int i;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: stpkbench FILE...\n"
+		                "       stpkbench -r\n");
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "-r")) {
+		return stpk_benchRoundTrips();
+	}
+
+	printf("%-16s %8s %8s %6s %10s %8s\n", "file", "srcLen", "dstLen", "runs", "us/run", "MB/s");
+
+	for (i = 1; i < argc; i++) {
+		if ((data = stpk_benchRead(argv[i], &len)) == NULL) {
+			continue;
+		}
+
+		// Warm up and skip files that aren't compressed.
+		err[0] = '\0';
+		if (stpk_benchDecomp(data, len, &dstLen, err)) {
+			fprintf(stderr, "Skipping \"%s\". (%s)\n", argv[i], err);
+			free(data);
+			continue;
+		}
+
+		runs = 0;
+		start = clock();
+
+		do {
+			stpk_benchDecomp(data, len, &dstLen, err);
+			runs++;
+			secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+		} while (secs < STPK_BENCH_SECONDS);
+
+		printf("%-16s %8d %8d %6d %10.1f %8.1f\n", argv[i], len, dstLen, runs, secs * 1e6 / runs, dstLen * (runs / secs) / 1e6);
+
+		totalSecs += secs / runs;
+		totalBytes += dstLen;
+		files++;
+
+		free(data);
+	}
+
+	if (files > 1) {
+		printf("%-16s %8s %8.0f %6s %10.1f %8.1f\n", "total", "", totalBytes, "", totalSecs * 1e6, totalBytes / totalSecs / 1e6);
+	}
+
+	return files ? 0 : 1;
+}